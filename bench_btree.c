@@ -0,0 +1,596 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "dberror.h"
+#include "btree_mgr.h"
+#include "tables.h"
+
+// multi-threaded throughput of the B+ tree index
+// usage: bench_btree [maxThreads] [numKeys] [opsPerThread] [poolPages]
+// the tree is opened with poolPages frames, by default four times its nodes, so lookups hit the pool and
+// time the latches rather than the file reads of a miss.
+// First compares lookups in trees of either node layout, then every run doubles the number of
+// threads up to maxThreads, with lookups only, then with and without the cache of inner nodes, and with
+// one insert in every ten operations, then compares findKeys batches against a loop of findKey calls and the insert
+// rate of each durability level on one thread, and last times the in-node search of int keys at several fanouts
+// and the search of full inner pages in either node layout
+// malloc, calloc and realloc are counted here to report the heap allocations of every operation
+
+#define BENCH_INDEX "benchidx"
+#define BENCH_SORTED_INDEX "benchidx_sorted"
+#define BENCH_BLOCKED_INDEX "benchidx_blocked"
+#define BENCH_BATCH 1000
+#define BENCH_NODE_KEYS 340 // int keys of a full inner page
+#define BENCH_NODE_PAGES 8192 // 32 MB of inner pages, more than the processor's caches hold
+
+// the allocator of the C library, wrapped below to count calls
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t count, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static long allocCount = 0;
+
+// work of one benchmark thread
+typedef struct BenchWork {
+  BTreeHandle *tree;
+  int id;
+  int threads;
+  int numKeys;
+  int ops;
+  int insertEvery; // 0 for lookups only
+  int round;
+  int errors;
+} BenchWork;
+
+// sorted input for the bulk loader: key i*2 maps to RID (i+1, i%7)
+typedef struct BenchInput {
+  int pos;
+  int size;
+} BenchInput;
+
+static RC nextBenchEntry (BT_BulkIterator *iterator, Value *key, RID *rid);
+static void *benchThread (void *arg);
+static double runRound (BTreeHandle *tree, int threads, int numKeys, int ops, int insertEvery, int round, double *allocs);
+static long allocations (void);
+static double now (void);
+static void compareBatchLookup (BTreeHandle *tree, int numKeys, int ops, int poolPages);
+static void compareInnerCache (BTreeHandle *tree, int maxThreads, int numKeys, int ops);
+static void compareDurability (BTreeHandle *tree, int numKeys, int ops);
+static void compareLayouts (int numKeys, int ops);
+static void compareNodeSearch (int ops);
+static void compareNodeLayouts (int ops);
+
+// ************************************************************
+int
+main (int argc, char **argv)
+{
+  int maxThreads = argc > 1 ? atoi(argv[1]) : 8;
+  int numKeys = argc > 2 ? atoi(argv[2]) : 100000;
+  int ops = argc > 3 ? atoi(argv[3]) : 20000;
+  int poolPages = argc > 4 ? atoi(argv[4]) : 0;
+  int threads, nodes, round = 0;
+  double base;
+  BTreeHandle *tree = NULL;
+  BT_BulkIterator iterator;
+  BenchInput input = { 0, numKeys };
+
+  // first, while no other tree is open and the disk is not busy writing back
+  compareLayouts(numKeys, ops);
+
+  iterator.next = nextBenchEntry;
+  iterator.mgmtData = &input;
+  if (bulkLoadBtree(BENCH_INDEX, DT_INT, &iterator, 1) != RC_OK || openBtree(&tree, BENCH_INDEX) != RC_OK)
+    {
+      printf("could not build the benchmark index\n");
+      return 1;
+    }
+  // findKeys against findKey through the default pool first, where most leaves are read from the file
+  compareBatchLookup(tree, numKeys, ops, BT_DEFAULT_POOL_PAGES);
+
+  // room for every node and for the ones the splits of the mixed rounds add, the bulk loaded leaves are full
+  getNumNodes(tree, &nodes);
+  closeBtree(tree);
+  if (poolPages <= 0)
+    poolPages = 4 * nodes;
+  if (openBtreeWithPoolSize(&tree, BENCH_INDEX, poolPages) != RC_OK)
+    {
+      printf("could not open the benchmark index\n");
+      return 1;
+    }
+
+  printf("\n%d keys in %d nodes, %d operations per thread, %d pool frames\n", numKeys, nodes, ops, poolPages);
+  printf("%-12s %8s %14s %8s %10s\n", "workload", "threads", "ops/s", "speedup", "allocs/op");
+
+  // a round before the timed ones reads the tree into the pool
+  runRound(tree, 1, numKeys, ops, 0, round++, NULL);
+  base = 0;
+  for(threads = 1; threads <= maxThreads; threads *= 2)
+    {
+      double allocs, rate = runRound(tree, threads, numKeys, ops, 0, round++, &allocs);
+      if (threads == 1)
+        base = rate;
+      printf("%-12s %8d %14.0f %8.2f %10.2f\n", "lookup", threads, rate, rate / base, allocs);
+    }
+
+  // before the inserts leave dirty pages for the lookups to write back
+  compareInnerCache(tree, maxThreads, numKeys, ops);
+
+  base = 0;
+  for(threads = 1; threads <= maxThreads; threads *= 2)
+    {
+      double allocs, rate = runRound(tree, threads, numKeys, ops, 10, round++, &allocs);
+      if (threads == 1)
+        base = rate;
+      printf("%-12s %8d %14.0f %8.2f %10.2f\n", "90/10 mixed", threads, rate, rate / base, allocs);
+    }
+
+  compareBatchLookup(tree, numKeys, ops, poolPages);
+  compareDurability(tree, numKeys, ops);
+
+  closeBtree(tree);
+  deleteBtree(BENCH_INDEX);
+
+  compareNodeSearch(ops);
+  compareNodeLayouts(ops);
+  return 0;
+}
+
+// ************************************************************
+double
+runRound (BTreeHandle *tree, int threads, int numKeys, int ops, int insertEvery, int round, double *allocs)
+{
+  pthread_t *ids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+  BenchWork *work = (BenchWork *) malloc(threads * sizeof(BenchWork));
+  int i, errors = 0;
+  long allocStart = allocations();
+  double start, elapsed;
+
+  start = now();
+  for(i = 0; i < threads; i++)
+    {
+      work[i].tree = tree;
+      work[i].id = i;
+      work[i].threads = threads;
+      work[i].numKeys = numKeys;
+      work[i].ops = ops;
+      work[i].insertEvery = insertEvery;
+      work[i].round = round;
+      work[i].errors = 0;
+      pthread_create(&ids[i], NULL, benchThread, &work[i]);
+    }
+  for(i = 0; i < threads; i++)
+    {
+      pthread_join(ids[i], NULL);
+      errors += work[i].errors;
+    }
+  elapsed = now() - start;
+  if (allocs != NULL)
+    *allocs = (double) (allocations() - allocStart) / ((double) threads * ops);
+
+  if (errors > 0)
+    printf("%d operations failed\n", errors);
+  free(ids);
+  free(work);
+
+  return (double) threads * ops / elapsed;
+}
+
+// ************************************************************
+void
+compareBatchLookup (BTreeHandle *tree, int numKeys, int ops, int poolPages)
+{
+  Value *keys = (Value *) malloc(BENCH_BATCH * sizeof(Value));
+  RID *rids = (RID *) malloc(BENCH_BATCH * sizeof(RID));
+  RC *rcs = (RC *) malloc(BENCH_BATCH * sizeof(RC));
+  unsigned int seed = 4711;
+  int batches = (ops + BENCH_BATCH - 1) / BENCH_BATCH;
+  int b, i, errors = 0;
+  long loopAllocs = 0, batchAllocs = 0, allocStart;
+  double start, loopTime = 0, batchTime = 0;
+
+  // both sides probe the same random keys, half of them are odd and may be missing
+  for(b = 0; b < batches; b++)
+    {
+      for(i = 0; i < BENCH_BATCH; i++)
+        {
+          keys[i].dt = DT_INT;
+          keys[i].v.intV = rand_r(&seed) % (2 * numKeys);
+        }
+
+      allocStart = allocations();
+      start = now();
+      for(i = 0; i < BENCH_BATCH; i++)
+        rcs[i] = findKey(tree, &keys[i], &rids[i]);
+      loopTime += now() - start;
+      loopAllocs += allocations() - allocStart;
+
+      allocStart = allocations();
+      start = now();
+      if (findKeys(tree, keys, rids, rcs, BENCH_BATCH) != RC_OK)
+        errors++;
+      batchTime += now() - start;
+      batchAllocs += allocations() - allocStart;
+    }
+
+  if (errors > 0)
+    printf("%d batches failed\n", errors);
+  printf("\n%-12s %8s %8s %14s %8s %10s\n", "lookup", "frames", "batch", "ops/s", "speedup", "allocs/op");
+  printf("%-12s %8d %8d %14.0f %8.2f %10.2f\n", "findKey", poolPages, 1, batches * BENCH_BATCH / loopTime, 1.0,
+         (double) loopAllocs / (batches * BENCH_BATCH));
+  printf("%-12s %8d %8d %14.0f %8.2f %10.2f\n", "findKeys", poolPages, BENCH_BATCH, batches * BENCH_BATCH / batchTime, loopTime / batchTime,
+         (double) batchAllocs / (batches * BENCH_BATCH));
+
+  free(keys);
+  free(rids);
+  free(rcs);
+}
+
+// ************************************************************
+void
+compareInnerCache (BTreeHandle *tree, int maxThreads, int numKeys, int ops)
+{
+  int enabled, threads, nodes, r;
+  long bytes;
+  double base = 0, rate;
+
+  // lookups only, a round before the timed ones fills the cache, the best of three rounds counts
+  printf("\n%-12s %8s %14s %8s %12s\n", "inner cache", "threads", "ops/s", "speedup", "cache bytes");
+  for(enabled = 0; enabled <= 1; enabled++)
+    {
+      setInnerNodeCache(tree, enabled);
+      runRound(tree, 1, numKeys, ops, 0, 0, NULL);
+      for(threads = 1; threads <= maxThreads; threads *= 2)
+        {
+          for(rate = 0, r = 0; r < 3; r++)
+            {
+              double roundRate = runRound(tree, threads, numKeys, ops, 0, threads + r, NULL);
+              if (roundRate > rate)
+                rate = roundRate;
+            }
+          if (threads == 1 && !enabled)
+            base = rate;
+          getInnerNodeCacheSize(tree, &nodes, &bytes);
+          printf("%-12s %8d %14.0f %8.2f %12ld\n", enabled ? "on" : "off", threads, rate, rate / base, bytes);
+        }
+    }
+  setInnerNodeCache(tree, 0);
+}
+
+// ************************************************************
+void
+compareLayouts (int numKeys, int ops)
+{
+  char *names[] = { "sorted", "blocked" };
+  char *files[] = { BENCH_SORTED_INDEX, BENCH_BLOCKED_INDEX };
+  int layouts[] = { BT_LAYOUT_SORTED, BT_LAYOUT_BLOCKED };
+  BTreeHandle *tree;
+  BT_BulkIterator iterator;
+  BenchInput input;
+  Value *keys = (Value *) malloc(BENCH_BATCH * sizeof(Value));
+  RID *rids = (RID *) malloc(BENCH_BATCH * sizeof(RID));
+  RC *rcs = (RC *) malloc(BENCH_BATCH * sizeof(RC));
+  int batches = (ops + BENCH_BATCH - 1) / BENCH_BATCH;
+  int t, r, b, i, errors = 0;
+  double start, loopTime, batchTime, loopRate[2] = { 0, 0 }, batchRate[2] = { 0, 0 };
+
+  // the same keys in two fresh trees, one per layout
+  iterator.next = nextBenchEntry;
+  iterator.mgmtData = &input;
+  for(t = 0; t < 2; t++)
+    {
+      input.pos = 0;
+      input.size = numKeys;
+      if (bulkLoadBtreeWithLayout(files[t], DT_INT, &iterator, 1, layouts[t]) != RC_OK)
+        {
+          printf("could not build the %s index\n", names[t]);
+          free(keys);
+          free(rids);
+          free(rcs);
+          return;
+        }
+    }
+
+  // both trees are probed with the same random keys, taking turns, and the best of three rounds counts.
+  // The buffer manager keeps process-wide state, so only one of them is open at a time.
+  for(r = 0; r < 3; r++)
+    for(t = 0; t < 2; t++)
+      {
+        unsigned int seed = 4711 + r;
+        if (openBtree(&tree, files[t]) != RC_OK)
+          {
+            errors++;
+            continue;
+          }
+        loopTime = batchTime = 0;
+        for(b = 0; b < batches; b++)
+          {
+            for(i = 0; i < BENCH_BATCH; i++)
+              {
+                keys[i].dt = DT_INT;
+                keys[i].v.intV = rand_r(&seed) % (2 * numKeys);
+              }
+            start = now();
+            for(i = 0; i < BENCH_BATCH; i++)
+              findKey(tree, &keys[i], &rids[i]);
+            loopTime += now() - start;
+            start = now();
+            if (findKeys(tree, keys, rids, rcs, BENCH_BATCH) != RC_OK)
+              errors++;
+            batchTime += now() - start;
+          }
+        if (batches * BENCH_BATCH / loopTime > loopRate[t])
+          loopRate[t] = batches * BENCH_BATCH / loopTime;
+        if (batches * BENCH_BATCH / batchTime > batchRate[t])
+          batchRate[t] = batches * BENCH_BATCH / batchTime;
+        closeBtree(tree);
+      }
+
+  for(t = 0; t < 2; t++)
+    deleteBtree(files[t]);
+  printf("\n%-12s %14s %14s\n", "layout", "findKey/s", "findKeys/s");
+  for(t = 0; t < 2; t++)
+    printf("%-12s %14.0f %14.0f\n", names[t], loopRate[t], batchRate[t]);
+  if (errors > 0)
+    printf("%d batches failed\n", errors);
+  free(keys);
+  free(rids);
+  free(rcs);
+}
+
+// ************************************************************
+void
+compareDurability (BTreeHandle *tree, int numKeys, int ops)
+{
+  char *names[] = { "per-op", "per-batch", "async" };
+  int levels[] = { BT_DURABILITY_OP, BT_DURABILITY_BATCH, BT_DURABILITY_ASYNC };
+  Value *keys = (Value *) malloc(BENCH_BATCH * sizeof(Value));
+  RID *rids = (RID *) malloc(BENCH_BATCH * sizeof(RID));
+  int next = 2 * numKeys; // above every key inserted so far
+  int l, i, errors = 0;
+  double start, elapsed;
+
+  // per-batch inserts go through insertKeys, the other levels insert one key per call;
+  // the time includes making the last change durable
+  printf("\n%-12s %8s %14s\n", "durability", "batch", "inserts/s");
+  for(l = 0; l < 3; l++)
+    {
+      setDurability(tree, levels[l]);
+      start = now();
+      for(i = 0; i < ops; i++)
+        {
+          keys[i % BENCH_BATCH].dt = DT_INT;
+          keys[i % BENCH_BATCH].v.intV = next + i;
+          rids[i % BENCH_BATCH].page = next + i;
+          rids[i % BENCH_BATCH].slot = 0;
+          if (levels[l] != BT_DURABILITY_BATCH)
+            {
+              if (insertKey(tree, &keys[i % BENCH_BATCH], rids[i % BENCH_BATCH]) != RC_OK)
+                errors++;
+            }
+          else if (i % BENCH_BATCH == BENCH_BATCH - 1 || i == ops - 1)
+            {
+              if (insertKeys(tree, keys, rids, i % BENCH_BATCH + 1) != RC_OK)
+                errors++;
+            }
+        }
+      flushBtree(tree);
+      elapsed = now() - start;
+      printf("%-12s %8d %14.0f\n", names[l], levels[l] == BT_DURABILITY_BATCH ? BENCH_BATCH : 1, ops / elapsed);
+      next += ops;
+    }
+  setDurability(tree, BT_DURABILITY_OP);
+
+  if (errors > 0)
+    printf("%d inserts failed\n", errors);
+  free(keys);
+  free(rids);
+}
+
+// ************************************************************
+void
+compareNodeSearch (int ops)
+{
+  char *names[] = { "linear", "binary", (char *) getIntSearchName() };
+  int methods[] = { BT_SEARCH_LINEAR, BT_SEARCH_BINARY, BT_SEARCH_SIMD };
+  int fanouts[] = { 16, 64, 128, 340 }; // 340 int keys fill a page
+  int *keys = (int *) malloc(340 * sizeof(int));
+  int *probes = (int *) malloc(ops * sizeof(int));
+  unsigned int seed = 4711;
+  int f, m, i, rounds = 50;
+  long sum;
+  double start, elapsed, base;
+
+  // the keys of a node are the even numbers, half of the probes are missing, every probe
+  // is searched as a leaf lookup and as an inner node's child selection
+  for(i = 0; i < 340; i++)
+    keys[i] = 2 * i;
+  printf("\n%-12s %8s %14s %8s\n", "node search", "fanout", "searches/s", "speedup");
+  for(f = 0; f < 4; f++)
+    {
+      for(i = 0; i < ops; i++)
+        probes[i] = rand_r(&seed) % (2 * fanouts[f]);
+      base = 0;
+      sum = 0;
+      for(m = 0; m < 3; m++)
+        {
+          start = now();
+          for(int r = 0; r < rounds; r++)
+            for(i = 0; i < ops; i++)
+              sum += searchIntKeys(keys, fanouts[f], probes[i], i & 1, methods[m]);
+          elapsed = now() - start;
+          if (m == 0)
+            base = elapsed;
+          printf("%-12s %8d %14.0f %8.2f\n", names[m], fanouts[f], (double) rounds * ops / elapsed, base / elapsed);
+        }
+      if (sum == 0)
+        printf("no key was found\n"); // keeps the searches from being optimized away
+    }
+
+  free(keys);
+  free(probes);
+}
+
+// ************************************************************
+void
+compareNodeLayouts (int ops)
+{
+  char *names[] = { "sorted", "blocked" };
+  int layouts[] = { BT_LAYOUT_SORTED, BT_LAYOUT_BLOCKED };
+  int pageCounts[] = { 1, BENCH_NODE_PAGES };
+  int *keys = (int *) malloc(BENCH_NODE_KEYS * sizeof(int));
+  int *probes = (int *) malloc(2 * ops * sizeof(int)); // page and key of each probe
+  char *pages[2];
+  unsigned int seed = 4711;
+  int t, p, b, i, rounds = 20;
+  long sum = 0;
+  double start, elapsed, rate[2];
+
+  // the same full inner page in both layouts, copied into every page buffer, searched right in the buffer
+  // like a descent searches a frame, with the probes spread over one page that stays in the processor's
+  // caches and over many pages that do not
+  for(i = 0; i < BENCH_NODE_KEYS; i++)
+    keys[i] = 2 * i;
+  for(t = 0; t < 2; t++)
+    {
+      pages[t] = (char *) aligned_alloc(64, (size_t) BENCH_NODE_PAGES * PAGE_SIZE);
+      if (formatIntNode(pages[t], keys, BENCH_NODE_KEYS, layouts[t]) != RC_OK)
+        {
+          printf("could not lay out the %s node\n", names[t]);
+          for(p = 0; p <= t; p++)
+            free(pages[p]);
+          free(keys);
+          free(probes);
+          return;
+        }
+      for(p = 1; p < BENCH_NODE_PAGES; p++)
+        memcpy(pages[t] + (long) p * PAGE_SIZE, pages[t], PAGE_SIZE);
+    }
+
+  printf("\n%-12s %8s %14s %8s\n", "node layout", "pages", "searches/s", "speedup");
+  for(p = 0; p < 2; p++)
+    {
+      for(i = 0; i < ops; i++)
+        {
+          probes[2 * i] = rand_r(&seed) % pageCounts[p];
+          probes[2 * i + 1] = rand_r(&seed) % (2 * BENCH_NODE_KEYS);
+        }
+      // the layouts take turns, the best of three rounds counts
+      rate[0] = rate[1] = 0;
+      for(b = 0; b < 3; b++)
+        for(t = 0; t < 2; t++)
+          {
+            start = now();
+            for(int r = 0; r < rounds; r++)
+              for(i = 0; i < ops; i++)
+                sum += searchIntNode(pages[t] + (long) probes[2 * i] * PAGE_SIZE, probes[2 * i + 1], 1, layouts[t]);
+            elapsed = now() - start;
+            if ((double) rounds * ops / elapsed > rate[t])
+              rate[t] = (double) rounds * ops / elapsed;
+          }
+      for(t = 0; t < 2; t++)
+        printf("%-12s %8d %14.0f %8.2f\n", names[t], pageCounts[p], rate[t], rate[t] / rate[0]);
+    }
+  if (sum == 0)
+    printf("no child was picked\n"); // keeps the searches from being optimized away
+
+  for(t = 0; t < 2; t++)
+    free(pages[t]);
+  free(keys);
+  free(probes);
+}
+
+// ************************************************************
+void *
+benchThread (void *arg)
+{
+  BenchWork *work = (BenchWork *) arg;
+  unsigned int seed = work->round * 1000 + work->id;
+  int i;
+  Value key;
+  RID rid;
+
+  key.dt = DT_INT;
+  for(i = 0; i < work->ops; i++)
+    {
+      if (work->insertEvery > 0 && i % work->insertEvery == 0)
+        {
+          // odd keys are never bulk loaded, one that an earlier insert already added is left as it is
+          RID newRid = { work->round + 1, work->id };
+          RC rc;
+          key.v.intV = 2 * (rand_r(&seed) % work->numKeys) + 1;
+          rc = insertKey(work->tree, &key, newRid);
+          if (rc != RC_OK && rc != RC_IM_KEY_ALREADY_EXISTS)
+            work->errors++;
+        }
+      else
+        {
+          key.v.intV = 2 * (rand_r(&seed) % work->numKeys);
+          if (findKey(work->tree, &key, &rid) != RC_OK)
+            work->errors++;
+        }
+    }
+
+  return NULL;
+}
+
+// ************************************************************
+RC
+nextBenchEntry (BT_BulkIterator *iterator, Value *key, RID *rid)
+{
+  BenchInput *input = (BenchInput *) iterator->mgmtData;
+
+  if (input->pos == input->size)
+    return RC_IM_NO_MORE_ENTRIES;
+
+  key->dt = DT_INT;
+  key->v.intV = input->pos * 2;
+  rid->page = input->pos + 1;
+  rid->slot = input->pos % 7;
+  input->pos++;
+
+  return RC_OK;
+}
+
+// ************************************************************
+double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ************************************************************
+long
+allocations (void)
+{
+  return __atomic_load_n(&allocCount, __ATOMIC_RELAXED);
+}
+
+// ************************************************************
+void *
+malloc (size_t size)
+{
+  __atomic_add_fetch(&allocCount, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+// ************************************************************
+void *
+calloc (size_t count, size_t size)
+{
+  __atomic_add_fetch(&allocCount, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(count, size);
+}
+
+// ************************************************************
+void *
+realloc (void *ptr, size_t size)
+{
+  __atomic_add_fetch(&allocCount, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
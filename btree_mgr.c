@@ -1,12 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "buffer_mgr_stat.h"
 #include "dberror.h"
 #include "storage_mgr.h"
 #include "btree_mgr.h"
 #include "buffer_mgr.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
 
 //************************************Data Structures*************************************
 
@@ -15,14 +21,150 @@ typedef struct page_struct_data{
     int leaf;
     int entry_number;
     
-    int parent_Node;
     int page_Number;
+    int right_Sibling; // next leaf to the right, -1 if none
+    int left_Sibling; // previous leaf to the left, -1 if none
 
-    float *pointer_to_pages; 
-    int *keys; 
+    PageNumber *pointer_to_pages; // children of an inner node
+    RID *rids; // record ids of a leaf, stored as exact page and slot numbers
+    char *keys; // keySize bytes per key, an int or a NUL terminated string
     
 }page_struct_data;
 
+//Fixed header stored at the start of every node page, followed by the key array and the pointer array
+typedef struct node_Header{
+    int leaf;
+    int entry_number;
+    int right_Sibling;
+    int left_Sibling;
+}node_Header;
+
+//Offsets of the packed key and pointer arrays inside a node page, a leaf keeps
+//its RIDs where an inner node keeps its child page numbers
+#define NODE_KEY_OFFSET sizeof(node_Header)
+#define NODE_POINTER_OFFSET(maxEntries) (sizeof(node_Header) + (maxEntries)*sizeof(int))
+
+//Inner nodes of a tree with the blocked layout also keep the first key of every cache line of their key array
+//behind the children, a search reads those and then the one line its key is in. The frame starts on a cache
+//line, so the first line of keys is cut short by the node header.
+#define CACHE_LINE_SIZE 64
+#define LINE_KEYS (int)(CACHE_LINE_SIZE/sizeof(int))
+#define FIRST_LINE_KEYS (int)((CACHE_LINE_SIZE-NODE_KEY_OFFSET)/sizeof(int))
+#define NODE_LINE_OFFSET(maxEntries) ((NODE_POINTER_OFFSET(maxEntries)+((maxEntries)+1)*sizeof(PageNumber)+CACHE_LINE_SIZE-1)/CACHE_LINE_SIZE*CACHE_LINE_SIZE)
+#define LINE_START(line) ((line) == 0 ? 0 : FIRST_LINE_KEYS+((line)-1)*LINE_KEYS)
+#define NODE_LINES(entries) ((entries) <= FIRST_LINE_KEYS ? 1 : 1+((entries)-FIRST_LINE_KEYS+LINE_KEYS-1)/LINE_KEYS)
+
+//String keys are kept in slotted pages. The string header and the slots follow the node header, then come
+//the RIDs of a leaf or the children of an inner node. Key bytes are stored from the end of the page downwards,
+//the prefix that every key of the page shares is stored once at the very end and each slot holds the rest.
+typedef struct string_Header{
+    unsigned short prefixLength;
+    unsigned short keyBytes; // bytes taken by the prefix and the rest of the keys at the end of the page
+}string_Header;
+
+typedef struct key_Slot{
+    unsigned short offset;
+    unsigned short length;
+}key_Slot;
+
+#define STRING_SLOT_OFFSET (sizeof(node_Header) + sizeof(string_Header))
+#define STRING_POINTER_OFFSET(entries) (STRING_SLOT_OFFSET + (entries)*sizeof(key_Slot))
+
+//Typed view of a node page in a pinned frame, its arrays point right into the frame. The RIDs or children
+//of a string page move with its number of slots, so the view is taken again once that changes.
+typedef struct node_View{
+    node_Header *header;
+    int *intKeys; // NULL on a string page
+    string_Header *strings; // NULL on an int page
+    key_Slot *slots;
+    RID *rids; // of a leaf
+    PageNumber *children; // of an inner node
+}node_View;
+
+//Bytes of the RID behind the key of a non-unique tree, and a byte above the first of any encoded RID.
+//Every entry of a key lies between the key and the key followed by that byte.
+#define RID_KEY_BYTES 10
+#define RID_KEY_CEILING 0x90
+
+//Room for a key of any type, a key that is moved around on its own is kept in a buffer this large
+#define BTREE_KEY_SIZE (BT_MAX_KEY_LENGTH+1)
+//Key i of an array of decoded keys
+#define KEY_AT(treeData,keys,i) ((keys)+(long)(i)*(treeData)->keySize)
+
+//Heap bytes of a cached inner node, which keeps just its keys and children
+#define CACHED_NODE_BYTES(treeData,entries) ((long)sizeof(page_struct_data)+(long)((entries) > 0 ? (entries) : 1)*(treeData)->keySize+((entries)+1)*(long)sizeof(PageNumber))
+
+//Upper bound on the number of levels, used to size the descent path
+#define BTREE_MAX_HEIGHT 32
+
+//Node latches are kept in chunks that are added as the file grows, so a latch never moves once handed out
+#define BTREE_LATCH_CHUNK_SIZE 1024
+#define BTREE_LATCH_CHUNKS 1024
+
+//Latch modes and the operations a writer descends for
+#define LATCH_SHARED 0
+#define LATCH_EXCLUSIVE 1
+#define BTREE_OP_INSERT 0
+#define BTREE_OP_DELETE 1
+
+//Leaf flag written into the header of a page given up by a merge
+#define FREED_NODE -1
+
+//The free page list is kept in page 0 behind the metadata, a count and then the page numbers. A list too long
+//for the page is written as FREE_LIST_OVERFLOW and found again on open from the FREED_NODE headers.
+#define FREE_LIST_OFFSET sizeof(file_Metadata)
+#define FREE_LIST_SLOTS ((int)((PAGE_SIZE-FREE_LIST_OFFSET)/sizeof(int))-1)
+#define FREE_LIST_OVERFLOW -1
+
+//Write-ahead log records
+#define WAL_BEFORE_IMAGE 1 // whole page before its first change since the last checkpoint
+#define WAL_PAGE_CHANGE 2 // bytes of a page that a change has rewritten
+#define WAL_COMMIT 3 // all records of the operation are in the log before it
+
+//Pages are compared in blocks of this many bytes, a change is logged in whole blocks
+#define WAL_CHANGE_BLOCK 32
+
+//The log, kept next to the index file in idxId.wal, is checkpointed into the index file and emptied once it grows past this size
+#define WAL_CHECKPOINT_SIZE (8*1024*1024)
+//A commit hands a buffer this large to the operating system even if its durability level lets it return right away
+#define WAL_BUFFER_LIMIT (256*1024)
+
+//Header of a log record, followed by length bytes that go to offset in the page
+typedef struct wal_Record{
+    int type;
+    int op; // operation that wrote the record, numbered from 1 in each log
+    int pageNumber; // for a commit, the new root if the operation changed it and -1 otherwise
+    int offset;
+    int length;
+}wal_Record;
+
+//Write-ahead log of an open tree
+typedef struct wal_Log{
+    int fd; // -1 while nothing is logged
+    char *fileName;
+    int durability;
+    // records not written yet, the spare buffer is the one being written meanwhile
+    char *buffer;
+    char *spare;
+    long bufferSize;
+    long bufferCapacity;
+    long spareCapacity;
+    // log sequence numbers count the bytes appended since the tree was opened
+    long long appendedLsn;
+    long long writtenLsn; // handed to the operating system
+    long long durableLsn; // synced to disk
+    long long checkpointLsn; // the log file starts here
+    // end of the last record of each page, guarded by the latch
+    long long *pageLsn;
+    int pageLsnCapacity;
+    int lastOp;
+    int writing; // one thread writes the buffer for everyone waiting
+    pthread_mutex_t latch;
+    pthread_cond_t written;
+    // changing operations hold it shared, a checkpoint exclusively
+    pthread_rwlock_t checkpointLatch;
+}wal_Log;
+
 //Meta data of the file
 typedef struct file_Metadata{
     // Root page number of the B+ tree.
@@ -33,6 +175,21 @@ typedef struct file_Metadata{
     int keyType; // optional value
     // Maximum number of entries allowed per page.
     int maxEntriesPerPage;
+    // Highest page number handed out so far, freed pages below it are reused first
+    int lastPage_Number;
+    // Attributes of a key and their types, keyType is how the keys are stored. Files written
+    // before composite keys have no attributes, their keys are single ints or strings.
+    int keyAttrs;
+    int attrTypes[BT_MAX_KEY_ATTRS];
+    // A key may be stored with several RIDs. Each entry then is the encoded key followed by its encoded RID,
+    // so the entries of a key lie next to each other in RID order.
+    int nonUnique;
+    // BT_LAYOUT_SORTED or BT_LAYOUT_BLOCKED for the inner nodes of int keys
+    int nodeLayout;
+    // Levels of the tree and the length of all keys in the leaves, kept up to date by every change for
+    // getTreeCounters. Files written before them have a height of 0 and are counted on open.
+    int height;
+    long keyBytes;
     
 }file_Metadata;
 
@@ -43,61 +200,252 @@ typedef struct tree_DS{
     file_Metadata fMD;
     BM_PageHandle* pageHandler;
     BM_BufferPool* bufferManager;
+    // bytes of a key in a decoded node
+    int keySize;
+    // Values that make up one key of a call, and whether they are encoded into a byte string
+    int keyAttrs;
+    int normalizedKeys;
+
+    // pages given up by merges, handed out again before the file grows
+    int *freePages;
+    int freePageCount;
+    int freePageCapacity;
+
+    // taken before the root node's latch by the writers that may replace the root,
+    // readers latch the root without it and read rootpage_Number again, see latchRoot
+    pthread_rwlock_t rootLatch;
+    // guards the counters in fMD and the free page list
+    pthread_mutex_t metaLatch;
+    // one reader/writer latch per page
+    pthread_rwlock_t *nodeLatches[BTREE_LATCH_CHUNKS];
+
+    // decoded inner nodes by page, in chunks next to the latches. An entry is read under its node's shared
+    // latch and dropped under its exclusive one, whenever the page is written.
+    int innerCache;
+    page_struct_data **innerNodes[BTREE_LATCH_CHUNKS];
+    long innerCacheNodes;
+    long innerCacheBytes;
+
+    wal_Log log;
 
 }tree_DS;
 
+//Changing operation the current thread is in, its records and commit carry the same number
+typedef struct wal_Op{
+    int op; // 0 until the first record
+    int newRoot;
+    // pages merged away, free for others only once the operation is committed
+    int freedPages[BTREE_MAX_HEIGHT];
+    int freedCount;
+}wal_Op;
+
 //Key Data, it has key and left and right pointer_to_pages
 typedef struct data{
 
-    float left;
-    int key;
-    float right;
+    PageNumber left;
+    char key[BTREE_KEY_SIZE];
+    PageNumber right;
 
 }data;
 
+//Nodes of one level written by the bulk loader, waiting for their parents
+typedef struct bulk_Level{
+    char *keys; // smallest key below each node
+    PageNumber *pages;
+    int count;
+    int capacity;
+    char lastKey[BTREE_KEY_SIZE]; // largest key of the last leaf, the next leaf's key is cut against it
+}bulk_Level;
+
+//One (key, RID) pair of a batch insert
+typedef struct batch_Entry{
+    char *key;
+    RID rid;
+}batch_Entry;
+
+//One probe of a batch lookup, with its place in the caller's arrays
+typedef struct probe_Entry{
+    char *key;
+    int index;
+}probe_Entry;
+
 //Struct data typer for scanning data
 typedef struct scan_tree_data{
-    int *leafPage; //entry of leaf pages 
-    int cuurent_page;//Page Number of current page
-    int current_page_is_loaded;
+    int cuurent_page;//Page Number of current page, the next one is found through its right sibling
     page_struct_data cuurent_pageData;
-    int nextPagePosInLeafPages;
     int curr_page_position;
-    // Total number of leaf pages in the B+ tree.
-    int number_of_leaf_pages;
-    
+    // Last key handed out, or the bound the scan starts at before that, to find the way back after a concurrent merge
+    char last_Key[BTREE_KEY_SIZE];
+    int skip_Equal;
+    // Bound the scan ends at, the upper one or for a descending scan the lower one
+    int has_End_Bound;
+    char end_Key[BTREE_KEY_SIZE];
+    int end_Inclusive;
+    int end_Prefix; // the scan ends with the keys that start with end_Key
+    // A descending scan hands out the entries in front of curr_page_position and moves on to the left sibling
+    int descending;
+    // Strings of the key nextEntryWithKey handed out last
+    char key_Strings[BTREE_KEY_SIZE];
 
 }scan_tree_data;
 
-//Global variables
-static int counter = 0;       
-BT_ScanHandle* scanHandle;
-scan_tree_data* scanMetadata;
-BTreeHandle* tree_Handle;   
-tree_DS* b_Tree_Mgmt;
-
 /************************************************Prototype of helper methods******************************************************/
-int parseIntBySeperator(char **ptr, char c);
 RC readMetaData(BM_BufferPool* bm,BM_PageHandle* ph,file_Metadata* fmd,int pageNumber);
-float parseFloatBySeperator(char **ptr, char c);
-RC readPageData(BM_BufferPool* bufferManager, BM_PageHandle* pageHandler, page_struct_data* page_struct_data, int pageNumber);
-page_struct_data findLeafPageforInsertion(BM_BufferPool* bufferManager, BM_PageHandle* pageHandler, page_struct_data root, int key);
-RC newkeyAndPtrToLeaf(page_struct_data* pageData, int key, RID rid);
-RC allocate_Memory(char **data);
-RC free_Memory(char **data);
-RC formatKeyPointerData(page_struct_data* pd, char* data);
-RC formatMetaData(file_Metadata* fmd,char* content);
-RC prepareContentWrite(page_struct_data* pd,char* content);
-RC writetoBuffer(BM_BufferPool* bm,BM_PageHandle* ph,char* content,int pageNumber);
-// Updates parent node pointers to reflect changes in child nodes (like after a split)
-RC propagatesplitUp(BTreeHandle *tree,int pageNumber,data kd);
-RC updateParentPointer(BTreeHandle* tree,page_struct_data node);
+RC writeMetaData(BM_BufferPool* bm,BM_PageHandle* ph,file_Metadata* fmd,int* freePages,int freeCount,int pageNumber);
+RC readFreeList(tree_DS* treeData);
+RC pushFreePage(tree_DS* treeData, int pageNumber);
+RC readPageData(tree_DS* treeData, page_struct_data* page_struct_data, int pageNumber);
+RC decodeNodePage(tree_DS* treeData, char* pageData, page_struct_data* page_struct_data, int pageNumber);
+RC formatNodePage(tree_DS* treeData, char* pageData, page_struct_data* page_struct_data);
+RC writePageData(tree_DS* treeData, page_struct_data* page_struct_data);
+int getMaxEntriesPerPage(DataType keyType);
+int getKeySize(DataType keyType);
+// Composite, float and bool keys are stored as strings of their encoded attributes
+RC setKeyTypes(file_Metadata* fMD, int keyAttrs, DataType* keyTypes, int nonUnique);
+RC setKeyLayout(tree_DS* treeData);
+RC setNodeLayout(file_Metadata* fMD, int layout);
+RC encodeKey(tree_DS* treeData, Value* values, int count, char* key);
+int encodeBits(unsigned char* out, unsigned int bits);
+// The attributes of a stored key, strings are written to the given buffer of BTREE_KEY_SIZE bytes
+RC keyToValues(tree_DS* treeData, char* key, Value* values, char* strings);
+unsigned int decodeBits(unsigned char* in);
+// Entries of a non-unique tree, the RID goes behind the encoded key
+RC appendRid(char* key, RID rid);
+RC keyCeiling(char* key, char* ceiling);
+// Key helpers, a decoded key takes keySize bytes whatever its type
+RC valueToKey(tree_DS* treeData, Value* value, char* key);
+int compareKeys(DataType keyType, char* left, char* right);
+int commonPrefix(char* left, char* right);
+RC shortestSeparator(tree_DS* treeData, char* left, char* right, char* separator);
+// Length a key is counted with in the statistics
+int keyLength(tree_DS* treeData, char* key);
+// Level-order pass over the latched pages of the tree for getTreeStats
+RC walkTreeLevels(tree_DS* treeData, BT_Stats* stats);
+// Position of the first key not smaller than key, or with upper of the first key larger than it
+int searchNode(tree_DS* treeData, page_struct_data* node, char* key, int upper);
+int searchPage(tree_DS* treeData, char* pageData, int from, char* key, int upper);
+// Looks the key up in a latched node right in its frame, returns whether it is a leaf and otherwise the key's child
+int findChildPage(tree_DS* treeData, int pageNumber, char* key, int* childPage, char* upperKey);
+// Frame access, a leaf is searched and changed right in its pinned frame and the change is logged from a copy
+RC viewNodePage(tree_DS* treeData, char* pageData, node_View* view);
+RC copyPageKey(tree_DS* treeData, char* pageData, int index, char* key);
+RC findInLeaf(tree_DS* treeData, int pageNumber, char* key, RID* result);
+// done tells whether the leaf could take the change without a split or running underfull
+RC insertIntoLeaf(tree_DS* treeData, int pageNumber, char* key, RID rid, int* done);
+RC deleteFromLeaf(tree_DS* treeData, int pageNumber, char* key, RID* rid, int isRoot, int* done);
+// Inner node cache, a latched node is looked up or added, a node being written is dropped
+page_struct_data* cachedInnerNode(tree_DS* treeData, int pageNumber);
+page_struct_data* cacheInnerNode(tree_DS* treeData, char* pageData, int pageNumber);
+RC dropCachedNode(tree_DS* treeData, int pageNumber);
+// Searches of packed int keys, searchInts is the fastest one this processor has
+int searchIntsLinear(int* keys, int low, int high, int value, int upper);
+int searchIntsBinary(int* keys, int low, int high, int value, int upper);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+int searchIntsSse(int* keys, int low, int high, int value, int upper);
+int searchIntsAvx2(int* keys, int low, int high, int value, int upper);
+#endif
+void chooseIntSearch(void);
+// Space checks, string keys are limited by the bytes of a page as well as by the number of entries
+int stringPageSize(tree_DS* treeData, int leaf, char* keys, int count, int prefix);
+int fitsInNode(tree_DS* treeData, int leaf, char* keys, int count, int limit);
+int isUnderfull(tree_DS* treeData, int leaf, char* keys, int count);
+int fitsWithKey(tree_DS* treeData, int leaf, char* keys, int count, char* key, int front);
+// Spreads units over as few pieces as fit, takes receives the number of units of each piece
+int planPieces(tree_DS* treeData, int leaf, char* keys, int units, int perPiece, int limit, int** takes);
+void moveSplitPoint(tree_DS* treeData, page_struct_data* node, int* takes);
+RC allocatePageData(tree_DS* treeData, page_struct_data* pageData);
+RC freePageData(page_struct_data* pageData);
+RC growPageData(tree_DS* treeData, page_struct_data* pageData, int capacity);
+int allocateNodePage(tree_DS* treeData);
+// Returns the page of a merged away node to the free list
+RC freeNodePage(tree_DS* treeData, int pageNumber);
+// Latch helpers, nodes are latched top-down and leaves left to right
+pthread_rwlock_t* nodeLatch(tree_DS* treeData, int pageNumber);
+RC addNodeLatches(tree_DS* treeData, int lastPage);
+RC latchNode(tree_DS* treeData, int pageNumber, int mode);
+RC unlatchNode(tree_DS* treeData, int pageNumber);
+int isSafeNode(tree_DS* treeData, page_struct_data* node, int op, int count, int isRoot);
+RC releaseAncestors(tree_DS* treeData, int *path, int from, int to, int *rootHeld);
+RC releaseSiblings(tree_DS* treeData, int *siblings, int from, int to);
+// Latches the current root in the given mode and returns its page
+int latchRoot(tree_DS* treeData, int mode);
+// Descends with shared latch coupling, only the returned leaf stays latched in the given mode.
+// upperKey, if given, receives the separator right of the leaf, it is left alone for the rightmost leaf.
+int descendToLeaf(tree_DS* treeData, char* key, int leafMode, int *depth, char *upperKey);
+// The same, with the leaf copied out
+page_struct_data findLeafPage(tree_DS* treeData, char* key, int leafMode, int *depth);
+// Descends with exclusive latches, ancestors of a node that cannot split or underflow are let go on the way.
+// With siblings, a delete also latches the sibling each node it keeps would be rebalanced with.
+page_struct_data findLeafPageforInsertion(tree_DS* treeData, char* key, int op, int count, int *path, int *depth, int *latched, int *rootHeld, char *upperKey, int *siblings);
+// Merges a sorted run of entries into a leaf in one pass, keys the leaf already holds are left out
+int mergeIntoLeaf(tree_DS* treeData, page_struct_data* leaf, batch_Entry* entries, int count, long* bytes);
+int compareBatchEntries(const void *left, const void *right);
+int compareProbes(const void *left, const void *right);
+// Resolves sorted probes below a latched node, every node on the way is read once for all probes that pass it
+RC probeSubtree(tree_DS* treeData, int pageNumber, probe_Entry* probes, int count, RID* results, RC* rcs, int *isLeaf);
+// Descends into the children the probes of a node were grouped by, and frees the groups
+RC probeChildren(tree_DS* treeData, probe_Entry* probes, RID* results, RC* rcs, PageNumber* childPages, int* groupStart, int groups);
+// Searches the sorted probes of one leaf right in its frame
+RC probeLeaf(tree_DS* treeData, char* pageData, probe_Entry* probes, int count, RID* results, RC* rcs);
+RC newkeyAndPtrToLeaf(tree_DS* treeData, page_struct_data* pageData, char* key, RID rid);
+// Inserts the separator of a split node into its parent, taken from the descent path
+RC propagatesplitUp(BTreeHandle *tree,int *path,int level,data *separators,int count);
+// Splits a node that holds more than maxEntriesPerPage entries, handing back a separator per new page
+RC splitNode(tree_DS* treeData, page_struct_data* node, data** separators, int* count);
 // Inserts a key and its corresponding pointer in a non-leaf page of the B+ tree
-RC insertKeyPointer(page_struct_data* page,data kd);
+RC insertKeyPointer(tree_DS* treeData, page_struct_data* page, data* kd);
+// Bulk loading helpers, nodes are written sequentially without the buffer pool
+RC addToBulkLevel(tree_DS* treeData, bulk_Level* level, char* key, PageNumber page);
+RC writeBulkNode(tree_DS* treeData, page_struct_data* node, char* pageBuffer, bulk_Level* level);
+RC bulkLoadLeaves(tree_DS* treeData, BT_BulkIterator* iterator, int fill, int fillSize, bulk_Level* level, char* pageBuffer, int* nextPage);
+PageNumber bulkLoadInnerLevels(tree_DS* treeData, int fill, int fillSize, bulk_Level* children, char* pageBuffer, int* nextPage);
 // Deletes a key from a leaf page in the B+ tree.
-RC deletekeyInLeaf(page_struct_data* pg, int key);
-// Identifies the leaf pages of the B+ tree, starting from the root
-RC findLeafPage(page_struct_data root,BM_BufferPool* bm,BM_PageHandle* ph,int* leafPages);
+// With rid, the key is only deleted while it still points to that record.
+RC deletekeyInLeaf(tree_DS* treeData, page_struct_data* pg, char* key, RID* rid);
+// Points a leaf back at a new left neighbour without decoding the rest of the page
+RC setLeftSibling(tree_DS* treeData, int pageNumber, int leftPage);
+// Borrows from or merges with a sibling once a node on the descent path runs below half full
+RC rebalanceNode(tree_DS* treeData, int *path, int *siblings, int level, page_struct_data* node);
+// Copies a leaf for a scan and skips the keys it has already handed out
+RC loadScanLeaf(tree_DS* treeData, scan_tree_data* scan, int pageNumber);
+RC beginTreeScan(BTreeHandle *tree, scan_tree_data* scan, BT_ScanHandle **handle);
+// Creates a tree file or bulk loads one, for every kind of key
+RC createTree(char *idxId, int keyAttrs, DataType *keyTypes, int nonUnique, int layout, int n);
+RC bulkLoadTree(char *idxId, int keyAttrs, DataType *keyTypes, int nonUnique, int layout, BT_BulkIterator *iterator, float fillFactor);
+// First entry of a non-unique tree that starts with the given key, storedKey receives the whole entry
+RC findFirstEntry(BTreeHandle *tree, char* key, RID* result, char* storedKey);
+// Deletes one stored entry, with the latching and rebalancing of a delete
+RC deleteStoredKey(tree_DS* treeData, char* oldKey, RID* rid);
+// Write-ahead log, page images are logged under the node's exclusive latch while the page is pinned
+RC openLog(tree_DS* treeData, char *idxId);
+RC removeLog(char *idxId);
+RC closeLog(tree_DS* treeData);
+long long appendLog(wal_Log* log, int type, int pageNumber, int offset, char* data, int length);
+RC logPageChange(tree_DS* treeData, int pageNumber, char* oldData, char* newData);
+RC forceLog(wal_Log* log, long long lsn, int sync);
+RC logWriteBack(PageNumber pageNumber, void *hookData);
+RC logFlushPage(PageNumber pageNumber, void *hookData);
+// A changing operation runs between beginOp and endOp, it is committed before its latches are let go
+RC beginOp(tree_DS* treeData);
+long long commitOp(tree_DS* treeData);
+RC endOp(tree_DS* treeData, long long commitLsn, int isBatch);
+RC checkpointTree(tree_DS* treeData);
+// Crash recovery: committed page images are redone, pages only changed by unfinished operations get their old content back
+int recoverFromLog(tree_DS* treeData, int *newRoot);
+// Walks the recovered tree to recount it, relink its leaves and collect unreachable pages
+RC repairTree(tree_DS* treeData);
+
+
+//The changing operation of this thread, a thread is in at most one at a time
+static _Thread_local wal_Op currentOp;
+
+//Int key search picked for the processor on first use
+static pthread_once_t intSearchOnce = PTHREAD_ONCE_INIT;
+static int (*searchInts)(int* keys, int low, int high, int value, int upper);
+static const char *intSearchName;
+
+//qsort passes no context along, so the key type of the batch a thread sorts is kept here
+static _Thread_local DataType sortKeyType;
 
 //Initializing the index manager
 
@@ -117,73 +465,113 @@ extern RC shutdownIndexManager (){
 //Create brtree
 // Function to create a B-tree
 RC createBtree (char *idxId, DataType keyType, int n) {
+    return createCompositeBtree(idxId, 1, &keyType, n);
+}
 
-    // Allocate memory for various tree structures
-    printf("Allocating memory for tree structures...\n");
-    b_Tree_Mgmt = (tree_DS*)malloc(sizeof(tree_DS));
-    tree_Handle = (BTreeHandle*)malloc(sizeof(BTreeHandle));
-    scanHandle = (BT_ScanHandle*)malloc(sizeof(BT_ScanHandle));
-    scanMetadata = (scan_tree_data*)malloc(sizeof(scan_tree_data));
+// Function to create a B-tree over keys made of several attributes
+RC createCompositeBtree (char *idxId, int keyAttrs, DataType *keyTypes, int n) {
+    return createTree(idxId, keyAttrs, keyTypes, 0, BT_LAYOUT_SORTED, n);
+}
 
-    // Initialize buffer pool, page handler, and scan handler
-    printf("Initializing buffer pool and page handler...\n");
-    b_Tree_Mgmt->bufferManager = MAKE_POOL();
-    b_Tree_Mgmt->pageHandler = MAKE_PAGE_HANDLE();
-    tree_Handle->mgmtData = b_Tree_Mgmt;
-    scanHandle->mgmtData = scanMetadata;
+// Function to create a B-tree in which several records may have the same key
+RC createNonUniqueBtree (char *idxId, int keyAttrs, DataType *keyTypes, int n) {
+    return createTree(idxId, keyAttrs, keyTypes, 1, BT_LAYOUT_SORTED, n);
+}
+
+// Function to create a B-tree whose inner nodes lay their keys out for fewer cache misses
+RC createBtreeWithLayout (char *idxId, DataType keyType, int n, int layout) {
+    return createTree(idxId, 1, &keyType, 0, layout, n);
+}
+
+// Writes the empty tree of a new index file
+RC createTree (char *idxId, int keyAttrs, DataType *keyTypes, int nonUnique, int layout, int n) {
+
+    file_Metadata fMD;
+    RC result = setKeyTypes(&fMD, keyAttrs, keyTypes, nonUnique);
+    if (result == RC_OK) {
+        result = setNodeLayout(&fMD, layout);
+    }
+    if (result != RC_OK) {
+        return result;
+    }
 
-    // Create a new page file for the B-tree
+    // n <= 0 sizes the nodes so that each one fills a whole page
+    int maxEntries = getMaxEntriesPerPage(fMD.keyType);
+    if (n > maxEntries) {
+        printf("Nodes with %d entries do not fit into a page.\n", n);
+        return RC_IM_N_TO_LAGE;
+    }
+    if (n <= 0) {
+        n = maxEntries;
+    }
+
+    // The tree data only lives until the empty tree is on disk, openBtree sets up its own
+    printf("Initializing buffer pool and page handler...\n");
+    tree_DS treeData;
+    treeData.bufferManager = MAKE_POOL();
+    treeData.pageHandler = MAKE_PAGE_HANDLE();
+    treeData.fMD = fMD;
+    setKeyLayout(&treeData);
+    treeData.log.fd = -1; // the empty tree is written straight to the new file
+    treeData.innerCache = 0;
+
+    // Create a new page file for the B-tree, a log left over from an old one under the same name would be replayed on it
     printf("Creating page file: %s\n", idxId);
     createPageFile(idxId);
+    removeLog(idxId);
 
     // Open the newly created page file and link it to the file handler
     printf("Opening page file...\n");
-    int result = openPageFile(idxId, &(b_Tree_Mgmt->fileHandler));
+    result = openPageFile(idxId, &treeData.fileHandler);
     if (result != RC_OK) {
         printf("Error opening page file.\n");
+        free(treeData.bufferManager);
+        free(treeData.pageHandler);
         return result;
     }
 
     // Initialize B-tree metadata
     printf("Initializing B-tree metadata...\n");
-    b_Tree_Mgmt->fMD.number_of_pageNodes = 1;
-    b_Tree_Mgmt->fMD.rootpage_Number = 1;
-    b_Tree_Mgmt->fMD.entry_Number = 0;
-    b_Tree_Mgmt->fMD.maxEntriesPerPage = n;
+    treeData.fMD.number_of_pageNodes = 1;
+    treeData.fMD.lastPage_Number = 1;
+    treeData.fMD.rootpage_Number = 1;
+    treeData.fMD.entry_Number = 0;
+    treeData.fMD.maxEntriesPerPage = n;
+    treeData.fMD.height = 1;
+    treeData.fMD.keyBytes = 0;
 
     // Initialize the buffer pool and ensure a capacity of at least 2 pages
     printf("Initializing buffer pool...\n");
-    initBufferPool(b_Tree_Mgmt->bufferManager, idxId, 10, RS_FIFO, NULL);
+    initBufferPool(treeData.bufferManager, idxId, 10, RS_FIFO, NULL);
     printf("Ensuring buffer pool capacity of at least 2 pages...\n");
-    ensureCapacity(2, &(b_Tree_Mgmt->fileHandler));
-
-    // Allocate memory for writing metadata to the buffer
-    printf("Allocating memory for metadata...\n");
-    char *data_str;
-    allocate_Memory(&data_str);
-    printf("Formatting metadata and writing to buffer...\n");
-    formatMetaData(&(b_Tree_Mgmt->fMD), data_str);
-    writetoBuffer(b_Tree_Mgmt->bufferManager, b_Tree_Mgmt->pageHandler, data_str, 0);
-    free_Memory(&data_str);
-
-    // Allocate memory for initializing the root page
+    ensureCapacity(2, &treeData.fileHandler);
+
+    // Write the metadata to page 0
+    printf("Writing metadata to buffer...\n");
+    writeMetaData(treeData.bufferManager, treeData.pageHandler, &treeData.fMD, NULL, 0, 0);
+
+    // Initialize the root page
     printf("Setting up root page...\n");
-    allocate_Memory(&data_str);
     page_struct_data root;
     root.page_Number = 1;
     root.leaf = 1;            // Indicating it's a leaf node
-    root.parent_Node = -1;     // No parent for root
+    root.right_Sibling = -1;   // No sibling leaves yet
+    root.left_Sibling = -1;
     root.entry_number = 0;     // No entries initially
+    root.keys = NULL;
+    root.pointer_to_pages = NULL;
+    root.rids = NULL;
     
     // Write root page to buffer
     printf("Writing root page to buffer...\n");
-    prepareContentWrite(&root, data_str);
-    writetoBuffer(b_Tree_Mgmt->bufferManager, b_Tree_Mgmt->pageHandler, data_str, b_Tree_Mgmt->fMD.rootpage_Number);
-    free_Memory(&data_str);
+    writePageData(&treeData, &root);
 
     // Shutdown the buffer pool after writing
     printf("Shutting down buffer pool...\n");
-    shutdownBufferPool(b_Tree_Mgmt->bufferManager);
+    shutdownBufferPool(treeData.bufferManager);
+    closePageFile(&treeData.fileHandler);
+    free(treeData.bufferManager);
+    free(treeData.pageHandler);
 
     printf("B-tree creation complete.\n");
     
@@ -191,50 +579,218 @@ RC createBtree (char *idxId, DataType keyType, int n) {
 }
 
 
+// Function to build a B-tree bottom-up from (key, RID) pairs delivered in ascending key order
+RC bulkLoadBtree (char *idxId, DataType keyType, BT_BulkIterator *iterator, float fillFactor) {
+    return bulkLoadCompositeBtree(idxId, 1, &keyType, iterator, fillFactor);
+}
+
+// Function to bulk load a B-tree over keys made of several attributes
+RC bulkLoadCompositeBtree (char *idxId, int keyAttrs, DataType *keyTypes, BT_BulkIterator *iterator, float fillFactor) {
+    return bulkLoadTree(idxId, keyAttrs, keyTypes, 0, BT_LAYOUT_SORTED, iterator, fillFactor);
+}
+
+// Function to bulk load a B-tree in which several records may have the same key
+RC bulkLoadNonUniqueBtree (char *idxId, int keyAttrs, DataType *keyTypes, BT_BulkIterator *iterator, float fillFactor) {
+    return bulkLoadTree(idxId, keyAttrs, keyTypes, 1, BT_LAYOUT_SORTED, iterator, fillFactor);
+}
+
+// Function to bulk load a B-tree whose inner nodes lay their keys out for fewer cache misses
+RC bulkLoadBtreeWithLayout (char *idxId, DataType keyType, BT_BulkIterator *iterator, float fillFactor, int layout) {
+    return bulkLoadTree(idxId, 1, &keyType, 0, layout, iterator, fillFactor);
+}
+
+// Builds a new index file bottom-up
+RC bulkLoadTree (char *idxId, int keyAttrs, DataType *keyTypes, int nonUnique, int layout, BT_BulkIterator *iterator, float fillFactor) {
+
+    // a fill factor outside (0,1] falls back to completely filled nodes
+    if (fillFactor <= 0 || fillFactor > 1) {
+        fillFactor = 1;
+    }
+
+    tree_DS bulkData;
+    RC result = setKeyTypes(&bulkData.fMD, keyAttrs, keyTypes, nonUnique);
+    if (result == RC_OK) {
+        result = setNodeLayout(&bulkData.fMD, layout);
+    }
+    if (result != RC_OK) {
+        return result;
+    }
+    bulkData.fMD.maxEntriesPerPage = getMaxEntriesPerPage(bulkData.fMD.keyType);
+    bulkData.fMD.entry_Number = 0;
+    bulkData.fMD.number_of_pageNodes = 0;
+    bulkData.fMD.height = 1;
+    bulkData.fMD.keyBytes = 0;
+    setKeyLayout(&bulkData);
+
+    // nodes take fill entries, nodes with string keys also stop once they fill fillSize bytes
+    int fill = (int)(fillFactor * bulkData.fMD.maxEntriesPerPage);
+    if (fill < 1) {
+        fill = 1;
+    }
+    int fillSize = (int)(fillFactor * PAGE_SIZE);
+
+    printf("Creating page file for bulk load: %s\n", idxId);
+    result = createPageFile(idxId);
+    if (result != RC_OK) {
+        return result;
+    }
+    removeLog(idxId);
+    result = openPageFile(idxId, &bulkData.fileHandler);
+    if (result != RC_OK) {
+        return result;
+    }
+
+    char *pageBuffer = (char*)malloc(PAGE_SIZE);
+    bulk_Level children;
+    children.keys = NULL;
+    children.pages = NULL;
+    children.count = 0;
+    children.capacity = 0;
+    int nextPage = 1; // page 0 holds the metadata
+
+    // leaves go to pages 1..L, then every inner level follows the one below it
+    result = bulkLoadLeaves(&bulkData, iterator, fill, fillSize, &children, pageBuffer, &nextPage);
+    if (result == RC_OK) {
+        bulkData.fMD.rootpage_Number = bulkLoadInnerLevels(&bulkData, fill, fillSize, &children, pageBuffer, &nextPage);
+        bulkData.fMD.number_of_pageNodes = nextPage - 1;
+        bulkData.fMD.lastPage_Number = nextPage - 1;
+
+        // metadata is written last, once the root is known
+        memset(pageBuffer, '\0', PAGE_SIZE);
+        memcpy(pageBuffer, &bulkData.fMD, sizeof(file_Metadata));
+        result = writeBlock(0, &bulkData.fileHandler, pageBuffer);
+        printf("Bulk loaded %d entries into %d nodes.\n", bulkData.fMD.entry_Number, bulkData.fMD.number_of_pageNodes);
+    }
+
+    free(children.keys);
+    free(children.pages);
+    free(pageBuffer);
+    closePageFile(&bulkData.fileHandler);
+
+    return result;
+}
+
 // Function to open an existing B-tree
 extern RC openBtree (BTreeHandle **tree, char *idxId) {
+    return openBtreeWithPoolSize(tree, idxId, BT_DEFAULT_POOL_PAGES);
+}
+
+// Function to open an existing B-tree with a buffer pool of the given number of frames
+extern RC openBtreeWithPoolSize (BTreeHandle **tree, char *idxId, int poolPages) {
+
+    // All state of the open tree hangs off its own handle, so several trees can be open together
+    tree_DS *treeData = (tree_DS*)malloc(sizeof(tree_DS));
+    BTreeHandle *treeHandle = (BTreeHandle*)malloc(sizeof(BTreeHandle));
+    treeHandle->idxId = (char*)malloc(strlen(idxId)+1); // the caller's name may not outlive the handle
+    strcpy(treeHandle->idxId, idxId);
 
     // Open the page file for the B-tree
     printf("Opening page file: %s\n", idxId);
-    int rt_val = openPageFile(idxId, &(b_Tree_Mgmt->fileHandler)); 
+    int rt_val = openPageFile(treeHandle->idxId, &(treeData->fileHandler)); 
 
     // Check if the file was successfully opened
     if (rt_val != RC_OK) {
         printf("Failed to open page file. Error code: %d\n", rt_val);
+        free(treeHandle->idxId);
+        free(treeData);
+        free(treeHandle);
         return rt_val; 
     }
     printf("Page file opened successfully.\n");
 
+    // Open the log, a crash may have left changes in it that the index file does not have yet
+    rt_val = openLog(treeData, treeHandle->idxId);
+    if (rt_val != RC_OK) {
+        printf("Failed to open the log. Error code: %d\n", rt_val);
+        free(treeHandle->idxId);
+        free(treeData);
+        free(treeHandle);
+        return rt_val;
+    }
+    int newRoot;
+    int recovered = recoverFromLog(treeData, &newRoot);
+
     // Initialize the buffer manager and page handler for the B-tree
     printf("Initializing buffer manager and page handler...\n");
-    b_Tree_Mgmt->bufferManager = MAKE_POOL();
-    b_Tree_Mgmt->pageHandler = MAKE_PAGE_HANDLE();
-    initBufferPool(b_Tree_Mgmt->bufferManager, idxId, 10, RS_FIFO, NULL);
+    treeData->bufferManager = MAKE_POOL();
+    treeData->pageHandler = MAKE_PAGE_HANDLE();
+    initBufferPool(treeData->bufferManager, treeHandle->idxId, poolPages > 0 ? poolPages : BT_DEFAULT_POOL_PAGES, RS_FIFO, NULL);
+    setWriteBackHook(treeData->bufferManager, logWriteBack, logFlushPage, treeData); // no page reaches the file before its log records
     printf("Buffer pool initialized.\n");
 
     // Read the metadata from the B-tree file
     printf("Reading metadata from B-tree file...\n");
     file_Metadata fmd;
-    RC metaReadStatus = readMetaData(b_Tree_Mgmt->bufferManager, b_Tree_Mgmt->pageHandler, &fmd, 0);
+    RC metaReadStatus = readMetaData(treeData->bufferManager, treeData->pageHandler, &fmd, 0);
     
     if (metaReadStatus != RC_OK) {
         printf("Failed to read metadata. Error code: %d\n", metaReadStatus);
+        shutdownBufferPool(treeData->bufferManager);
+        closeLog(treeData);
+        free(treeData->bufferManager);
+        free(treeData->pageHandler);
+        free(treeHandle->idxId);
+        free(treeData);
+        free(treeHandle);
         return metaReadStatus;
     }
     printf("Metadata read successfully.\n");
 
     // Set up the tree handle and B-tree manager data using the read metadata
     printf("Setting up tree handle and B-tree management data...\n");
-    tree_Handle->idxId = idxId;
-    tree_Handle->keyType = fmd.keyType;
-    b_Tree_Mgmt->fMD.number_of_pageNodes = fmd.number_of_pageNodes;
-    b_Tree_Mgmt->fMD.maxEntriesPerPage = fmd.maxEntriesPerPage;
-    b_Tree_Mgmt->fMD.rootpage_Number = fmd.rootpage_Number;
-    b_Tree_Mgmt->fMD.entry_Number = fmd.entry_Number;
+    treeHandle->keyType = fmd.keyAttrs > 0 ? fmd.attrTypes[0] : fmd.keyType;
+    treeData->fMD.number_of_pageNodes = fmd.number_of_pageNodes;
+    treeData->fMD.lastPage_Number = fmd.lastPage_Number;
+    treeData->fMD.keyType = fmd.keyType;
+    treeData->fMD.maxEntriesPerPage = fmd.maxEntriesPerPage;
+    treeData->fMD.rootpage_Number = fmd.rootpage_Number;
+    treeData->fMD.entry_Number = fmd.entry_Number;
+    treeData->fMD.keyAttrs = fmd.keyAttrs;
+    memcpy(treeData->fMD.attrTypes, fmd.attrTypes, sizeof(fmd.attrTypes));
+    treeData->fMD.nonUnique = fmd.nonUnique;
+    treeData->fMD.nodeLayout = fmd.nodeLayout;
+    treeData->fMD.height = fmd.height;
+    treeData->fMD.keyBytes = fmd.keyBytes;
+    setKeyLayout(treeData);
+    treeData->freePages = NULL;
+    treeData->freePageCount = 0;
+    treeData->freePageCapacity = 0;
+
+    // Latches for every page in the file, allocateNodePage adds more as the file grows
+    pthread_rwlock_init(&treeData->rootLatch, NULL);
+    pthread_mutex_init(&treeData->metaLatch, NULL);
+    memset(treeData->nodeLatches, 0, sizeof(treeData->nodeLatches));
+    memset(treeData->innerNodes, 0, sizeof(treeData->innerNodes));
+    treeData->innerCache = 0;
+    treeData->innerCacheNodes = 0;
+    treeData->innerCacheBytes = 0;
+    addNodeLatches(treeData, fmd.lastPage_Number);
+
+    // After a crash the root may have moved and the counters are recounted from the recovered tree,
+    // which also finds the free pages again
+    if (!recovered) {
+        readFreeList(treeData);
+        if (treeData->fMD.height == 0) {
+            BT_Stats stats;
+            walkTreeLevels(treeData, &stats);
+            treeData->fMD.height = stats.height;
+            treeData->fMD.keyBytes = stats.keyBytes;
+        }
+    }
+    else {
+        printf("Repairing the recovered B-tree...\n");
+        if (newRoot != -1) {
+            treeData->fMD.rootpage_Number = newRoot;
+        }
+        beginOp(treeData);
+        repairTree(treeData);
+        endOp(treeData, commitOp(treeData), 1);
+        checkpointTree(treeData);
+    }
 
     // Link the management data to the tree handle
-    tree_Handle->mgmtData = b_Tree_Mgmt;
-    *tree = tree_Handle;
+    treeHandle->mgmtData = treeData;
+    *tree = treeHandle;
 
     printf("B-tree opened and initialized successfully.\n");
 
@@ -246,15 +802,12 @@ extern RC closeBtree (BTreeHandle *tree) {
 
     // Get the buffer manager from the tree's management data
     printf("Retrieving buffer manager for the B-tree.\n");
-    BM_BufferPool *bm = ((tree_DS*)tree->mgmtData)->bufferManager;
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    BM_BufferPool *bm = treeData->bufferManager;
     
-    // Prepare to write metadata back to disk before closing
-    printf("Writing B-tree metadata to disk before closing...\n");
-    char *data_str;
-    allocate_Memory(&data_str); // Allocate memory for the data
-    formatMetaData(&(b_Tree_Mgmt->fMD), data_str); // Format the metadata
-    writetoBuffer(b_Tree_Mgmt->bufferManager, b_Tree_Mgmt->pageHandler, data_str, 0); // Write metadata to disk
-    free_Memory(&data_str); // Free the memory allocated for the data
+    // A last checkpoint writes every page and the metadata to disk and empties the log
+    printf("Writing B-tree pages and metadata to disk before closing...\n");
+    checkpointTree(treeData);
     printf("Metadata written to disk successfully.\n");
 
     // Shutdown the buffer pool to release resources
@@ -264,9 +817,22 @@ extern RC closeBtree (BTreeHandle *tree) {
 
     // Free the allocated memory for the B-tree's data structures
     printf("Freeing allocated memory for B-tree structures...\n");
-    free(b_Tree_Mgmt->bufferManager);
-    free(b_Tree_Mgmt->pageHandler);
-    free(tree->mgmtData);
+    closePageFile(&treeData->fileHandler);
+    closeLog(treeData);
+    free(treeData->bufferManager);
+    free(treeData->pageHandler);
+    free(treeData->freePages);
+    setInnerNodeCache(tree, 0);
+    for(int chunk = 0; chunk < BTREE_LATCH_CHUNKS && treeData->nodeLatches[chunk] != NULL; chunk++){
+        for(int i = 0; i < BTREE_LATCH_CHUNK_SIZE; i++){
+            pthread_rwlock_destroy(&treeData->nodeLatches[chunk][i]);
+        }
+        free(treeData->nodeLatches[chunk]);
+    }
+    pthread_rwlock_destroy(&treeData->rootLatch);
+    pthread_mutex_destroy(&treeData->metaLatch);
+    free(treeData);
+    free(tree->idxId);
     free(tree);
     printf("Memory freed successfully. B-tree closed.\n");
 
@@ -277,6 +843,74 @@ extern RC closeBtree (BTreeHandle *tree) {
 extern RC deleteBtree (char *idxId){
     remove(idxId);
 
+    removeLog(idxId); // the log of a tree that was not closed goes with it
+
+    return RC_OK;
+}
+
+// Pick how soon changes are durable
+extern RC setDurability (BTreeHandle *tree, int level){
+    if (level != BT_DURABILITY_OP && level != BT_DURABILITY_BATCH && level != BT_DURABILITY_ASYNC) {
+        return RC_ERROR;
+    }
+    wal_Log *log = &((tree_DS*)tree->mgmtData)->log;
+    pthread_mutex_lock(&log->latch);
+    log->durability = level;
+    pthread_mutex_unlock(&log->latch);
+    return RC_OK;
+}
+
+// Make every change so far durable, the pages themselves are written lazily
+extern RC flushBtree (BTreeHandle *tree){
+    wal_Log *log = &((tree_DS*)tree->mgmtData)->log;
+    pthread_mutex_lock(&log->latch);
+    long long appended = log->appendedLsn;
+    pthread_mutex_unlock(&log->latch);
+    return forceLog(log,appended,1);
+}
+
+// Keep the inner nodes decoded in memory, so a lookup only pins its leaf. Nodes are added on their first
+// search and dropped whenever their page is written, turning the cache off frees them and their slots.
+extern RC setInnerNodeCache (BTreeHandle *tree, int enabled){
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    // new chunks of latches are added under the metadata latch
+    pthread_mutex_lock(&treeData->metaLatch);
+    if(enabled && !treeData->innerCache){
+        for(int chunk = 0; chunk < BTREE_LATCH_CHUNKS && treeData->nodeLatches[chunk] != NULL; chunk++){
+            treeData->innerNodes[chunk] = (page_struct_data**)calloc(BTREE_LATCH_CHUNK_SIZE,sizeof(page_struct_data*));
+        }
+    }
+    else if(!enabled && treeData->innerCache){
+        for(int chunk = 0; chunk < BTREE_LATCH_CHUNKS && treeData->innerNodes[chunk] != NULL; chunk++){
+            for(int i = 0; i < BTREE_LATCH_CHUNK_SIZE; i++){
+                dropCachedNode(treeData,chunk*BTREE_LATCH_CHUNK_SIZE+i);
+            }
+        }
+        treeData->innerCache = 0;
+        for(int chunk = 0; chunk < BTREE_LATCH_CHUNKS && treeData->innerNodes[chunk] != NULL; chunk++){
+            free(treeData->innerNodes[chunk]);
+            treeData->innerNodes[chunk] = NULL;
+        }
+    }
+    treeData->innerCache = enabled != 0;
+    pthread_mutex_unlock(&treeData->metaLatch);
+    return RC_OK;
+}
+
+// Nodes in the cache and the heap bytes they take, the page slots they hang off included
+extern RC getInnerNodeCacheSize (BTreeHandle *tree, int *nodes, long *bytes){
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    if(!treeData->innerCache){
+        *nodes = 0;
+        *bytes = 0;
+        return RC_OK;
+    }
+    long slots = 0;
+    for(int chunk = 0; chunk < BTREE_LATCH_CHUNKS && treeData->innerNodes[chunk] != NULL; chunk++){
+        slots += BTREE_LATCH_CHUNK_SIZE;
+    }
+    *nodes = (int)__atomic_load_n(&treeData->innerCacheNodes,__ATOMIC_RELAXED);
+    *bytes = __atomic_load_n(&treeData->innerCacheBytes,__ATOMIC_RELAXED)+slots*(long)sizeof(page_struct_data*);
     return RC_OK;
 }
 
@@ -285,565 +919,2556 @@ extern RC deleteBtree (char *idxId){
 // Get the number of nodes in the B-tree
 RC getNumNodes(BTreeHandle *tree, int *result) {
     printf("Fetching the number of nodes in the B-tree...\n");
-    *result = ((tree_DS*)tree->mgmtData)->fMD.number_of_pageNodes; // Retrieve the number of page nodes
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    pthread_mutex_lock(&treeData->metaLatch);
+    *result = treeData->fMD.number_of_pageNodes;
+    pthread_mutex_unlock(&treeData->metaLatch);
     printf("Number of nodes: %d\n", *result);
     return RC_OK;
 }
 
+// Get the number of pages that merges gave up and new nodes have not taken again
+RC getNumFreePages(BTreeHandle *tree, int *result) {
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    pthread_mutex_lock(&treeData->metaLatch);
+    *result = treeData->freePageCount;
+    pthread_mutex_unlock(&treeData->metaLatch);
+    return RC_OK;
+}
+
 // Get the key type used in the B-tree
 RC getKeyType(BTreeHandle *tree, DataType *result) {
     printf("Retrieving the key type for the B-tree...\n");
-    *result = ((tree_DS*)tree->mgmtData)->fMD.keyType; // Retrieve the key type
+    *result = tree->keyType; // Retrieve the key type, the first attribute's for a composite key
     printf("Key type retrieved successfully.\n");
     return RC_OK;
 }
 
+// Get the number of attributes of a key and their types
+RC getKeyAttrs(BTreeHandle *tree, int *keyAttrs, DataType *keyTypes) {
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    *keyAttrs = treeData->keyAttrs;
+    for (int i = 0; i < treeData->keyAttrs; i++) {
+        keyTypes[i] = treeData->fMD.keyAttrs > 0 ? treeData->fMD.attrTypes[i] : treeData->fMD.keyType;
+    }
+    return RC_OK;
+}
+
 // Get the number of entries in the B-tree
 RC getNumEntries(BTreeHandle *tree, int *result) {
     printf("Fetching the number of entries in the B-tree...\n");
-    *result = ((tree_DS*)tree->mgmtData)->fMD.entry_Number; // Retrieve the number of entries
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    pthread_mutex_lock(&treeData->metaLatch);
+    *result = treeData->fMD.entry_Number;
+    pthread_mutex_unlock(&treeData->metaLatch);
     printf("Number of entries: %d\n", *result);
     return RC_OK;
 }
 
-//***************************************Initializing the Helper functions****************************
-
-int parseIntBySeperator(char **ptr, char c) {
-    // Store the current pointer position
-    char *tempPtr = *ptr;
-    char *val = (char*)malloc(100);
-
-    // Clear memory for 'val'
-    memset(val, '\0', 100);
+// Get the statistics that every change keeps up to date, without reading a page
+RC getTreeCounters(BTreeHandle *tree, BT_Stats *stats) {
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    memset(stats, 0, sizeof(BT_Stats));
+    pthread_mutex_lock(&treeData->metaLatch);
+    stats->height = treeData->fMD.height;
+    stats->nodes = treeData->fMD.number_of_pageNodes;
+    stats->entries = treeData->fMD.entry_Number;
+    stats->freePages = treeData->freePageCount;
+    stats->keyBytes = treeData->fMD.keyBytes;
+    pthread_mutex_unlock(&treeData->metaLatch);
+    return getInnerNodeCacheSize(tree, &stats->cachedNodes, &stats->cacheBytes);
+}
 
-    // Loop through the string until the separator is found
-    for (int i = 0; *tempPtr != c; i++, tempPtr++) {
-        val[i] = *tempPtr;  // Store each character in 'val'
+// Get the statistics of every level from one pass over the tree's pages. The levels are walked one node at
+// a time, so call it while no other thread changes the tree.
+RC getTreeStats(BTreeHandle *tree, BT_Stats *stats) {
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    RC rc = walkTreeLevels(treeData, stats);
+    if (rc != RC_OK) {
+        return rc;
     }
+    pthread_mutex_lock(&treeData->metaLatch);
+    stats->freePages = treeData->freePageCount;
+    pthread_mutex_unlock(&treeData->metaLatch);
+    return getInnerNodeCacheSize(tree, &stats->cachedNodes, &stats->cacheBytes);
+}
 
-    // Convert the extracted string into an integer
-    int extractedValue = atoi(val);
-
-    // Update the original pointer position
-    *ptr = tempPtr;
-
-    // Free the dynamically allocated memory
-    free(val);
+//Visits the levels from the root down, each page latched shared and pinned once. The children of a level are
+//collected in key order for the next one, the pass ends at the leaves.
+RC walkTreeLevels(tree_DS* treeData, BT_Stats* stats){
+    BM_PageHandle handle;
+    node_View view;
+    int maxEntries = treeData->fMD.maxEntriesPerPage;
+    int levelSize = 1, isLeaf = 0;
+    long separatorBytes = 0;
+    PageNumber *level = (PageNumber*)malloc(sizeof(PageNumber));
+
+    memset(stats,0,sizeof(BT_Stats));
+    level[0] = __atomic_load_n(&treeData->fMD.rootpage_Number,__ATOMIC_ACQUIRE);
+
+    while(!isLeaf && stats->height < BT_MAX_LEVELS){
+        PageNumber *next = NULL;
+        int depth = stats->height, nextSize = 0;
+        float fillSum = 0;
+        stats->minFill[depth] = 1;
+        for(int i = 0; i < levelSize; i++){
+            latchNode(treeData,level[i],LATCH_SHARED);
+            pinPage(treeData->bufferManager,&handle,level[i]);
+            viewNodePage(treeData,handle.data,&view);
+            int entries = view.header->entry_number;
+            isLeaf = view.header->leaf;
+
+            // a page is as full as its entries or, for string keys, its bytes make it
+            float fill = (float)entries/maxEntries;
+            long keyBytes = (long)entries*sizeof(int);
+            if(view.strings != NULL){
+                int used = STRING_POINTER_OFFSET(entries)+(isLeaf ? entries*sizeof(RID) : (entries+1)*sizeof(PageNumber))+view.strings->keyBytes;
+                if((float)used/PAGE_SIZE > fill){
+                    fill = (float)used/PAGE_SIZE;
+                }
+                keyBytes = view.strings->keyBytes;
+            }
+            fillSum += fill;
+            stats->minFill[depth] = fill < stats->minFill[depth] ? fill : stats->minFill[depth];
+            stats->maxFill[depth] = fill > stats->maxFill[depth] ? fill : stats->maxFill[depth];
+            stats->storedKeyBytes += keyBytes;
+
+            for(int k = 0; k < entries; k++){
+                int length = view.strings != NULL ? view.strings->prefixLength+view.slots[k].length : sizeof(int);
+                if(isLeaf){
+                    stats->keyBytes += length;
+                }
+                else{
+                    separatorBytes += length;
+                }
+            }
+            if(isLeaf){
+                stats->entries += entries;
+            }
+            else{
+                stats->separators += entries;
+                next = (PageNumber*)realloc(next,(nextSize+entries+1)*sizeof(PageNumber));
+                memcpy(&next[nextSize],view.children,(entries+1)*sizeof(PageNumber));
+                nextSize += entries+1;
+            }
+            unpinPage(treeData->bufferManager,&handle);
+            unlatchNode(treeData,level[i]);
+        }
+        stats->pages[depth] = levelSize;
+        stats->avgFill[depth] = fillSum/levelSize;
+        stats->nodes += levelSize;
+        stats->height++;
+        free(level);
+        level = next;
+        levelSize = nextSize;
+    }
+    free(level);
 
-    // Return the integer value
-    return extractedValue;
+    stats->avgSeparatorLength = stats->separators > 0 ? (float)separatorBytes/stats->separators : 0;
+    return isLeaf ? RC_OK : RC_ERROR;
 }
 
+//***************************************Initializing the Helper functions****************************
+
 RC readMetaData(BM_BufferPool* bufferManager,BM_PageHandle* pageHandler,file_Metadata* fMD,int page_Number){
-    //Read the index metadata from page 0 
+    //Read the index metadata from page 0, it is stored as a packed binary struct
     pinPage(bufferManager,pageHandler,page_Number);
+    memcpy(fMD,pageHandler->data,sizeof(file_Metadata));
+    unpinPage(bufferManager,pageHandler);
 
-    char *cursor = pageHandler->data;
+    return RC_OK;
+}
 
-    //printf("I am here");
-    cursor++; // Skip initial marker
-    // Extract the data between first $ and next $ : root node's page number
-    fMD->rootpage_Number = parseIntBySeperator(&cursor,'$');
+RC writeMetaData(BM_BufferPool* bufferManager,BM_PageHandle* pageHandler,file_Metadata* fMD,int* freePages,int freeCount,int page_Number){
+    //Write the index metadata into page 0, followed by the free page list
+    pinPage(bufferManager,pageHandler,page_Number);
+    memset(pageHandler->data,'\0',PAGE_SIZE);
+    memcpy(pageHandler->data,fMD,sizeof(file_Metadata));
+    int *freeList = (int*)(pageHandler->data+FREE_LIST_OFFSET);
+    if(freeCount > FREE_LIST_SLOTS){
+        freeList[0] = FREE_LIST_OVERFLOW;
+    }
+    else{
+        freeList[0] = freeCount;
+        if(freeCount > 0){
+            memcpy(&freeList[1],freePages,freeCount*sizeof(int));
+        }
+    }
+    markDirty(bufferManager,pageHandler);
+    unpinPage(bufferManager,pageHandler);
 
-    //printf("I am done");
-    cursor++; // Skip the next section
-    fMD->number_of_pageNodes = parseIntBySeperator(&cursor,'$');
+    return RC_OK;
+}
 
-    cursor++; // Skip the next section
-    fMD->entry_Number = parseIntBySeperator(&cursor,'$');
+//Loads the free page list that the last checkpoint left in page 0. Files written before the list have zeros
+//there, an empty list.
+RC readFreeList(tree_DS* treeData){
+    BM_PageHandle handle;
+    pinPage(treeData->bufferManager,&handle,0);
+    int *freeList = (int*)(handle.data+FREE_LIST_OFFSET);
+    int count = freeList[0];
+    for(int i = 0; i < count; i++){
+        pushFreePage(treeData,freeList[i+1]);
+    }
+    unpinPage(treeData->bufferManager,&handle);
+    if(count == FREE_LIST_OVERFLOW){
+        // every page that was merged away and not taken again is still marked in its header
+        for(int pageNumber = 1; pageNumber <= treeData->fMD.lastPage_Number; pageNumber++){
+            pinPage(treeData->bufferManager,&handle,pageNumber);
+            if(((node_Header*)handle.data)->leaf == FREED_NODE){
+                pushFreePage(treeData,pageNumber);
+            }
+            unpinPage(treeData->bufferManager,&handle);
+        }
+    }
+    return RC_OK;
+}
 
-    cursor++; // Skip the next section
-    fMD->maxEntriesPerPage = parseIntBySeperator(&cursor,'$');
+//Appends a page to the free list, the caller holds the metadata latch or has the tree to itself
+RC pushFreePage(tree_DS* treeData, int pageNumber){
+    if(treeData->freePageCount == treeData->freePageCapacity){
+        treeData->freePageCapacity = treeData->freePageCapacity > 0 ? 2*treeData->freePageCapacity : 16;
+        treeData->freePages = (int*)realloc(treeData->freePages,treeData->freePageCapacity*sizeof(int));
+    }
+    treeData->freePages[treeData->freePageCount++] = pageNumber;
+    return RC_OK;
+}
 
-    cursor++; // Skip the next section
-    fMD->keyType = parseIntBySeperator(&cursor,'$');
+RC readPageData(tree_DS* treeData, page_struct_data* page_struct_data, int pageNumber){
+    
+    BM_BufferPool *bufferManager = treeData->bufferManager;
+    BM_PageHandle handle; // every caller pins through its own handle, the tree's one is shared between threads
+    BM_PageHandle *pageHandler = &handle;
 
+    // the node's latch keeps its content stable while it is decoded out of the frame
+    pinPage(bufferManager,pageHandler,pageNumber); // pinning the page
+    decodeNodePage(treeData,pageHandler->data,page_struct_data,pageNumber);
     unpinPage(bufferManager,pageHandler);
 
     return RC_OK;
 }
 
+RC decodeNodePage(tree_DS* treeData, char* pageData, page_struct_data* page_struct_data, int pageNumber){
+
+    int maxEntries = treeData->fMD.maxEntriesPerPage;
+
+    // reading the fixed header
+    node_Header *header = (node_Header*)pageData;
+    page_struct_data->leaf = header->leaf;
+    page_struct_data->entry_number = header->entry_number;
+    page_struct_data->right_Sibling = header->right_Sibling;
+    page_struct_data->left_Sibling = header->left_Sibling;
+    page_struct_data->page_Number = pageNumber;
+
+    allocatePageData(treeData,page_struct_data);
+    int entries = page_struct_data->entry_number;
+    if(entries > 0 && treeData->fMD.keyType == DT_STRING){
+        // every key is put back together from the page's prefix and the rest in its slot
+        string_Header *strings = (string_Header*)(pageData+sizeof(node_Header));
+        key_Slot *slots = (key_Slot*)(pageData+STRING_SLOT_OFFSET);
+        char *prefix = pageData+PAGE_SIZE-strings->prefixLength;
+        for(int i = 0; i < entries; i++){
+            char *key = KEY_AT(treeData,page_struct_data->keys,i);
+            memcpy(key,prefix,strings->prefixLength);
+            memcpy(key+strings->prefixLength,pageData+slots[i].offset,slots[i].length);
+            key[strings->prefixLength+slots[i].length] = '\0';
+        }
+        if(page_struct_data->leaf){
+            memcpy(page_struct_data->rids,pageData+STRING_POINTER_OFFSET(entries),entries*sizeof(RID));
+        }
+        else{
+            memcpy(page_struct_data->pointer_to_pages,pageData+STRING_POINTER_OFFSET(entries),(entries+1)*sizeof(PageNumber));
+        }
+    }
+    else if(entries > 0){
+        // copying the packed key and pointer arrays out of the frame
+        memcpy(page_struct_data->keys,pageData+NODE_KEY_OFFSET,entries*sizeof(int));
+        if(page_struct_data->leaf){
+            memcpy(page_struct_data->rids,pageData+NODE_POINTER_OFFSET(maxEntries),entries*sizeof(RID));
+        }
+        else{
+            memcpy(page_struct_data->pointer_to_pages,pageData+NODE_POINTER_OFFSET(maxEntries),(entries+1)*sizeof(PageNumber));
+        }
+    }
 
-float getDataBySeperatorForFloat(char **ptr, char c){
-    char *tempPtr = *ptr;
-    char *val=(char*)malloc(100);
+    return RC_OK;
+}
 
-    //printf("\nstart float seperator\n");
+//Serializes a node into a page sized buffer
+RC formatNodePage(tree_DS* treeData, char* pageData, page_struct_data* page_struct_data){
+
+    int maxEntries = treeData->fMD.maxEntriesPerPage;
+    int entries = page_struct_data->entry_number;
+    memset(pageData,'\0',PAGE_SIZE);
+
+    // writing the fixed header
+    node_Header *header = (node_Header*)pageData;
+    header->leaf = page_struct_data->leaf;
+    header->entry_number = page_struct_data->entry_number;
+    header->right_Sibling = page_struct_data->right_Sibling;
+    header->left_Sibling = page_struct_data->left_Sibling;
+
+    if(treeData->fMD.keyType == DT_STRING){
+        // the keys are sorted, so the prefix of the first and the last one is shared by all of them
+        string_Header *strings = (string_Header*)(pageData+sizeof(node_Header));
+        key_Slot *slots = (key_Slot*)(pageData+STRING_SLOT_OFFSET);
+        int prefix = entries > 0 ? commonPrefix(page_struct_data->keys,KEY_AT(treeData,page_struct_data->keys,entries-1)) : 0;
+        int end = PAGE_SIZE-prefix;
+        memcpy(pageData+end,page_struct_data->keys,prefix);
+        for(int i = 0; i < entries; i++){
+            char *key = KEY_AT(treeData,page_struct_data->keys,i)+prefix;
+            int length = strlen(key);
+            end -= length;
+            memcpy(pageData+end,key,length);
+            slots[i].offset = end;
+            slots[i].length = length;
+        }
+        strings->prefixLength = prefix;
+        strings->keyBytes = PAGE_SIZE-end;
 
-    memset(val,'\0',sizeof(val));
-    for(int i=0;*tempPtr!=c;tempPtr++,i++){
-        val[i]=*tempPtr;
+        if(page_struct_data->leaf){
+            memcpy(pageData+STRING_POINTER_OFFSET(entries),page_struct_data->rids,entries*sizeof(RID));
+        }
+        else{
+            memcpy(pageData+STRING_POINTER_OFFSET(entries),page_struct_data->pointer_to_pages,(entries+1)*sizeof(PageNumber));
+        }
+        return RC_OK;
     }
-    
-    //printf("\nloop start!\n");
-    // int index=0;
-    // while(*tempPtr!=c){
-    //     val[index]=*tempPtr;
-    //     tempPtr++;
-    //     index++;
-    // }
-    //printf("\nloop done!\n");
-    
-    *ptr=tempPtr;
-    float val2=atof(val);
-    free(val);
 
-   // printf("\nend float seperator\n");
+    // writing the key and pointer arrays in place
+    if(entries > 0){
+        memcpy(pageData+NODE_KEY_OFFSET,page_struct_data->keys,entries*sizeof(int));
+        if(page_struct_data->leaf){
+            memcpy(pageData+NODE_POINTER_OFFSET(maxEntries),page_struct_data->rids,entries*sizeof(RID));
+        }
+        else{
+            memcpy(pageData+NODE_POINTER_OFFSET(maxEntries),page_struct_data->pointer_to_pages,(entries+1)*sizeof(PageNumber));
+        }
+    }
+    if(!page_struct_data->leaf && treeData->fMD.nodeLayout == BT_LAYOUT_BLOCKED){
+        int *keys = (int*)page_struct_data->keys;
+        int *lines = (int*)(pageData+NODE_LINE_OFFSET(maxEntries));
+        for(int line = 0; LINE_START(line) < entries; line++){
+            lines[line] = keys[LINE_START(line)];
+        }
+    }
 
-    return val2;
+    return RC_OK;
 }
 
-RC readPageData(BM_BufferPool* bufferManager, BM_PageHandle* pageHandler, page_struct_data* page_struct_data, int pageNumber){
-    
-    pinPage(bufferManager,pageHandler,pageNumber); // pinning the page
+RC writePageData(tree_DS* treeData, page_struct_data* page_struct_data){
 
-    char *pageHandlerData=pageHandler->data;
-    pageHandlerData++; // skip the inital character
+    BM_BufferPool *bufferManager = treeData->bufferManager;
+    BM_PageHandle handle;
+    BM_PageHandle *pageHandler = &handle;
+    char pageData[PAGE_SIZE];
 
-    //printf("\nskip initial character\n");
+    // the new content is laid out next to the frame, so the log can take the bytes that differ
+    formatNodePage(treeData,pageData,page_struct_data);
+    dropCachedNode(treeData,page_struct_data->page_Number);
 
-    // reading data
-    page_struct_data->leaf =parseIntBySeperator(&pageHandlerData,'$');
-    pageHandlerData++;
+    // Pin the page with specified index to modify its contents
+    pinPage(bufferManager,pageHandler,page_struct_data->page_Number);
+    logPageChange(treeData,page_struct_data->page_Number,pageHandler->data,pageData);
+    memcpy(pageHandler->data,pageData,PAGE_SIZE);
 
-    page_struct_data->entry_number =parseIntBySeperator(&pageHandlerData,'$');
-    pageHandlerData++;
-    
-    page_struct_data->parent_Node =parseIntBySeperator(&pageHandlerData,'$');
-    pageHandlerData++;
+    // Mark the page as dirty since its content has been changed
+    markDirty(bufferManager,pageHandler);
+    unpinPage(bufferManager,pageHandler);
 
-    page_struct_data->page_Number =parseIntBySeperator(&pageHandlerData,'$');
-    pageHandlerData++;
+    return RC_OK;
+}
 
-    //printf("\ndone seperating!\n");
+//Largest number of keys that fit in one node page for the given key type
+int getMaxEntriesPerPage(DataType keyType){
+    // a string leaf needs a slot and a RID per key even if the prefix covers the whole key
+    if(keyType == DT_STRING){
+        return (PAGE_SIZE - STRING_SLOT_OFFSET) / (sizeof(key_Slot) + sizeof(RID));
+    }
+    // header + n keys + n RIDs must fit into a single page, n RIDs also cover the n+1 children of an inner node
+    return (PAGE_SIZE - sizeof(node_Header)) / (sizeof(int) + sizeof(RID));
+}
 
-    int index=0;
-    float *children=malloc((page_struct_data->entry_number+1)*sizeof(float));
-    int *key=malloc(page_struct_data->entry_number*sizeof(int));
+//Bytes of a decoded key, a string key is kept at its longest so keys can be moved around like ints
+int getKeySize(DataType keyType){
+    return keyType == DT_STRING ? BTREE_KEY_SIZE : sizeof(int);
+}
 
-    if(page_struct_data->entry_number>0){
-        while(index<page_struct_data->entry_number){
-            children[index] = getDataBySeperatorForFloat(&pageHandlerData,'$');
-            pageHandlerData++;
-            key[index] = parseIntBySeperator(&pageHandlerData,'$');
-            pageHandlerData++;
-            index++;
+//Fills in the attributes of a new tree's keys. A single int or string of a unique tree is stored as it is,
+//every other key is encoded into a string whose bytes compare like its attributes.
+RC setKeyTypes(file_Metadata* fMD, int keyAttrs, DataType* keyTypes, int nonUnique){
+    if(keyAttrs < 1 || keyAttrs > BT_MAX_KEY_ATTRS){
+        return RC_ERROR;
+    }
+    memset(fMD->attrTypes,0,sizeof(fMD->attrTypes));
+    for(int i = 0; i < keyAttrs; i++){
+        if(keyTypes[i] < DT_INT || keyTypes[i] > DT_BOOL){
+            return RC_RM_UNKOWN_DATATYPE;
         }
-        children[index]=getDataBySeperatorForFloat(&pageHandlerData,'$');
+        fMD->attrTypes[i] = keyTypes[i];
     }
+    fMD->keyAttrs = keyAttrs;
+    fMD->nonUnique = nonUnique != 0;
+    fMD->keyType = keyAttrs == 1 && keyTypes[0] == DT_INT && !nonUnique ? DT_INT : DT_STRING;
+    return RC_OK;
+}
 
-    //printf("\ndone final seprate!\n");
-
-    page_struct_data->pointer_to_pages=children;
-    page_struct_data->keys=key;
-    unpinPage(bufferManager,pageHandler);
-
+//Derives how the keys of a call are turned into decoded keys from the metadata
+RC setKeyLayout(tree_DS* treeData){
+    file_Metadata *fMD = &treeData->fMD;
+    treeData->keySize = getKeySize(fMD->keyType);
+    treeData->keyAttrs = fMD->keyAttrs > 0 ? fMD->keyAttrs : 1;
+    treeData->normalizedKeys = fMD->keyAttrs > 1 || fMD->nonUnique || (fMD->keyAttrs == 1 && fMD->attrTypes[0] != DT_INT && fMD->attrTypes[0] != DT_STRING);
     return RC_OK;
 }
 
-page_struct_data findLeafPageforInsertion(BM_BufferPool* bufferManager, BM_PageHandle* pageHandler, page_struct_data root, int key){
-    if(root.leaf){
-        return root;
+//The blocked layout keeps ints in their lines, string pages have a layout of their own
+RC setNodeLayout(file_Metadata* fMD, int layout){
+    if(layout != BT_LAYOUT_SORTED && (layout != BT_LAYOUT_BLOCKED || fMD->keyType != DT_INT)){
+        return RC_ERROR;
     }
-    else{
-        if(key<root.keys[0]){
-            int pageSearchNumber = round(root.pointer_to_pages[0]*10)/10;
-            page_struct_data searchPage;
-            readPageData(bufferManager,pageHandler,&searchPage,pageSearchNumber);
-            return findLeafPageforInsertion(bufferManager,pageHandler,searchPage,key);
+    fMD->nodeLayout = layout;
+    return RC_OK;
+}
+
+//Encodes the first count attributes of a key so that strcmp on the result orders keys like their attributes.
+//The bytes are never 0, so the key is stored like any string key and an encoded prefix of attributes is a
+//prefix of every key that starts with them. Ints and floats take five bytes of seven bits each with the high
+//bit set, a bool one byte, and a string its bytes with 1 and 2 escaped behind a 2, ended by a 1.
+RC encodeKey(tree_DS* treeData, Value* values, int count, char* key){
+    unsigned char *out = (unsigned char*)key;
+    int length = 0;
+
+    for(int i = 0; i < count; i++){
+        if(values[i].dt != (DataType)treeData->fMD.attrTypes[i]){
+            return RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE;
         }
-        else{
-            int foundPage=0;
-            size_t index;
-            for(index=0; index < root.entry_number-1;index++){
-                if(key>=root.keys[index] && key<root.keys[index+1]){
-                    page_struct_data searchInPage;
-                    foundPage=1;
-                    int pageSearchNumber=round(root.pointer_to_pages[index+1]*10)/10;
-                    readPageData(bufferManager,pageHandler,&searchInPage,pageSearchNumber);
-                    return findLeafPageforInsertion(bufferManager,pageHandler,searchInPage,key);
+        unsigned int bits;
+        switch(values[i].dt){
+        case DT_BOOL:
+            if(length+1 > BT_MAX_KEY_LENGTH){
+                return RC_IM_KEY_TOO_LONG;
+            }
+            out[length++] = 0x80 | (values[i].v.boolV != 0);
+            continue;
+        case DT_STRING:
+            for(unsigned char *c = (unsigned char*)values[i].v.stringV; *c != '\0'; c++){
+                if(length+2 > BT_MAX_KEY_LENGTH){
+                    return RC_IM_KEY_TOO_LONG;
+                }
+                if(*c <= 2){
+                    out[length++] = 2;
+                    out[length++] = *c+1;
+                }
+                else{
+                    out[length++] = *c;
                 }
-                //index++;
             }
-            if(!foundPage){
-                int pageSearchNumber = round(root.pointer_to_pages[root.entry_number]*10)/10;
-                page_struct_data searchPage;
-                readPageData(bufferManager,pageHandler,&searchPage,pageSearchNumber);
-                return findLeafPageforInsertion(bufferManager,pageHandler,searchPage,key);
+            if(length+1 > BT_MAX_KEY_LENGTH){
+                return RC_IM_KEY_TOO_LONG;
             }
+            out[length++] = 1;
+            continue;
+        case DT_FLOAT:{
+            float value = values[i].v.floatV == 0 ? 0 : values[i].v.floatV; // -0 and 0 are the same key
+            memcpy(&bits,&value,sizeof(bits));
+            // negative floats order backwards, flipping all of their bits turns that around
+            bits = (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+            break;
+        }
+        default:
+            bits = (unsigned int)values[i].v.intV ^ 0x80000000u;
+            break;
+        }
+        if(length+5 > BT_MAX_KEY_LENGTH){
+            return RC_IM_KEY_TOO_LONG;
         }
+        length += encodeBits(&out[length],bits);
     }
+    out[length] = '\0';
+    return RC_OK;
 }
 
-RC newkeyAndPtrToLeaf(page_struct_data* pageData, int key, RID rid)
-{
-    float *children=(float*)malloc(sizeof(int)*10);
-    int *keys=(int*)malloc(sizeof(int)*10);
-    
-    int index=0;
-    while(index< pageData->entry_number&& key> pageData->keys[index]){
-        keys[index]=pageData->keys[index];
-        children[index] = pageData->pointer_to_pages[index];
-        index++;
+//Writes 32 bits as five bytes of seven bits each, none of them 0 and ordered like the bits
+int encodeBits(unsigned char* out, unsigned int bits){
+    int length = 0;
+    for(int shift = 28; shift >= 0; shift -= 7){
+        out[length++] = 0x80 | ((bits >> shift) & 0x7F);
     }
+    return length;
+}
 
-    if(index<pageData->entry_number && key == pageData->keys[index]){
-        return RC_IM_KEY_ALREADY_EXISTS;
+//Reads back five bytes written by encodeBits
+unsigned int decodeBits(unsigned char* in){
+    unsigned int bits = 0;
+    for(int i = 0; i < 5; i++){
+        bits = (bits << 7) | (in[i] & 0x7F);
     }
-    else{
-        float cPointer= rid.page+ rid.slot*0.1;
-        keys[index]= key;
-        children[index] = cPointer;
-        index++;
+    return bits;
+}
+
+//Turns a stored key back into its attributes. A key of a single int or string is the value itself, an encoded
+//key is read like encodeKey wrote it, and the RID behind the entry of a non-unique tree is left alone.
+//A decoded string is never longer than its encoding, so all strings of a key fit into one key's bytes.
+RC keyToValues(tree_DS* treeData, char* key, Value* values, char* strings){
+    if(!treeData->normalizedKeys){
+        values[0].dt = treeData->fMD.keyType;
+        if(treeData->fMD.keyType == DT_INT){
+            memcpy(&values[0].v.intV,key,sizeof(int));
+        }
+        else{
+            strcpy(strings,key);
+            values[0].v.stringV = strings;
+        }
+        return RC_OK;
     }
 
-    while(index < pageData->entry_number+1){
-        children[index]=pageData->pointer_to_pages[index-1];
-        keys[index]= pageData->keys[index-1];
-        index++;
+    unsigned char *in = (unsigned char*)key;
+    for(int i = 0; i < treeData->keyAttrs; i++){
+        values[i].dt = (DataType)treeData->fMD.attrTypes[i];
+        switch(values[i].dt){
+        case DT_BOOL:
+            values[i].v.boolV = *in++ & 1;
+            break;
+        case DT_STRING:
+            values[i].v.stringV = strings;
+            for(; *in != 1; in++){
+                // 1 and 2 are escaped behind a 2
+                *strings++ = *in == 2 ? *++in - 1 : *in;
+            }
+            *strings++ = '\0';
+            in++;
+            break;
+        case DT_FLOAT:{
+            unsigned int bits = decodeBits(in);
+            bits = (bits & 0x80000000u) ? bits & 0x7FFFFFFFu : ~bits;
+            memcpy(&values[i].v.floatV,&bits,sizeof(bits));
+            in += 5;
+            break;
+        }
+        default:
+            values[i].v.intV = (int)(decodeBits(in) ^ 0x80000000u);
+            in += 5;
+            break;
+        }
     }
+    return RC_OK;
+}
 
-    children[index]=-1;
-    free(pageData->keys);
-    free(pageData->pointer_to_pages);
-    pageData->keys= keys;
-    pageData->pointer_to_pages=children;
-    pageData->entry_number++;
+//Puts the RID behind an encoded key, page first so the entries of a key are in the order of their pages.
+//valueToKey leaves room for it.
+RC appendRid(char* key, RID rid){
+    unsigned char *out = (unsigned char*)key + strlen(key);
+    out += encodeBits(out,(unsigned int)rid.page ^ 0x80000000u);
+    out += encodeBits(out,(unsigned int)rid.slot ^ 0x80000000u);
+    *out = '\0';
+    return RC_OK;
+}
+
+//The smallest string above every entry of the key
+RC keyCeiling(char* key, char* ceiling){
+    int length = strlen(key);
+    memmove(ceiling,key,length);
+    ceiling[length] = (char)RID_KEY_CEILING;
+    ceiling[length+1] = '\0';
     return RC_OK;
 }
 
-RC allocate_Memory(char **data){
-    *data=(char*)malloc(50*sizeof(char));
-    memset(*data,'\0',50);
-    //printf("space allocated");
+//Allocates the key and pointer arrays of a node, with room for one overflow entry before a split
+RC allocatePageData(tree_DS* treeData, page_struct_data* pageData){
+    int maxEntries = treeData->fMD.maxEntriesPerPage;
+    pageData->keys = (char*)malloc((maxEntries+1)*treeData->keySize);
+    pageData->pointer_to_pages = (PageNumber*)malloc((maxEntries+2)*sizeof(PageNumber));
+    pageData->rids = (RID*)malloc((maxEntries+1)*sizeof(RID));
+    return RC_OK;
 }
 
-RC free_Memory(char **data){
-    free(*data);
-    //printf("space deallocated");
+//Makes room for more than one overflow entry, which a batch can put into a node before it is split
+RC growPageData(tree_DS* treeData, page_struct_data* pageData, int capacity){
+    if(capacity <= treeData->fMD.maxEntriesPerPage+1){
+        return RC_OK;
+    }
+    pageData->keys = (char*)realloc(pageData->keys,(long)capacity*treeData->keySize);
+    pageData->pointer_to_pages = (PageNumber*)realloc(pageData->pointer_to_pages,(capacity+1)*sizeof(PageNumber));
+    pageData->rids = (RID*)realloc(pageData->rids,capacity*sizeof(RID));
+    return RC_OK;
 }
-RC formatKeyPointerData(page_struct_data* page_struct_data, char* content){
-    //printf("key pointer formated data");
-    char *cursor = content;
-    int index = 0;
-    
-    while(index < page_struct_data->entry_number) {
-        int childValue = round(page_struct_data->pointer_to_pages[index]*10);
-        int slot =  childValue % 10;
-        int pageNum =  childValue / 10;
 
-        sprintf(cursor,"%d.%d$",pageNum,slot);
-        cursor += 4;
-        sprintf(cursor,"%d$",page_struct_data->keys[index]);
-        if(page_struct_data->keys[index] >=10){
-            cursor += 3;
+//Turns the key of a call into the decoded form, a string key longer than BT_MAX_KEY_LENGTH cannot be stored
+RC valueToKey(tree_DS* treeData, Value* value, char* key){
+    if(treeData->fMD.nonUnique){
+        RC rc = encodeKey(treeData,value,treeData->keyAttrs,key);
+        if(rc == RC_OK && strlen(key)+RID_KEY_BYTES > BT_MAX_KEY_LENGTH){
+            return RC_IM_KEY_TOO_LONG;
         }
-        else{
-            cursor += 2;
+        return rc;
+    }
+    if(treeData->normalizedKeys){
+        return encodeKey(treeData,value,treeData->keyAttrs,key);
+    }
+    if(treeData->fMD.keyType == DT_STRING){
+        if(strlen(value->v.stringV) > BT_MAX_KEY_LENGTH){
+            return RC_IM_KEY_TOO_LONG;
         }
-        index++;
+        strcpy(key,value->v.stringV);
+        return RC_OK;
     }
-    sprintf(cursor,"%0.1f$",page_struct_data->pointer_to_pages[index]);
-    //printf("key pointer formated!");
+    memcpy(key,&value->v.intV,sizeof(int));
+    return RC_OK;
 }
 
-RC formatMetaData(file_Metadata* fMD,char* data){
-    //Create metadata for this index tree
-    sprintf (data,"$%d$%d$%d$%d$%d$",fMD->rootpage_Number,fMD->number_of_pageNodes,fMD->entry_Number,fMD->maxEntriesPerPage,fMD->keyType);
+int compareKeys(DataType keyType, char* left, char* right){
+    if(keyType == DT_STRING){
+        return strcmp(left,right);
+    }
+    int leftKey, rightKey;
+    memcpy(&leftKey,left,sizeof(int));
+    memcpy(&rightKey,right,sizeof(int));
+    return (leftKey > rightKey) - (leftKey < rightKey);
 }
 
-
-RC prepareContentWrite(page_struct_data* pageData,char* content){
-    sprintf (content,"$%d$%d$%d$%d$",pageData->leaf,pageData->entry_number,pageData->parent_Node,pageData->page_Number);
-    //printf("number of entries: %d",pd->entry_number);
-    if(pageData->entry_number > 0){
-        char* keysAndpointer_to_pages;
-        allocate_Memory(&keysAndpointer_to_pages);
-        formatKeyPointerData(pageData,keysAndpointer_to_pages);
-        sprintf (content+strlen(content),"%s",keysAndpointer_to_pages);
-        //sprintf(content + offset, "%s", keysAndpointer_to_pages); // Append formatted key-pointer data to content
-        free_Memory(&keysAndpointer_to_pages);
+//Number of leading bytes two strings agree on
+int commonPrefix(char* left, char* right){
+    int length = 0;
+    while(left[length] != '\0' && left[length] == right[length]){
+        length++;
     }
-    //printf("page prepared");
+    return length;
 }
 
-RC writetoBuffer(BM_BufferPool* bufferManager,BM_PageHandle* pageHandler,char* content,int pageNumber){
-    //printf("page write\n");
-    // Pin the page with specified index to modify its contents
-    pinPage(bufferManager,pageHandler,pageNumber);
-    //printf("page pinned");
-    // Clear existing data in the page buffer and set new content
-    memset(pageHandler->data,'\0',100); // Clear up to 100 characters
-    sprintf(pageHandler->data,"%s",content); // Copy new data into the page
-    // Mark the page as dirty since its content has been changed
-    markDirty(bufferManager,pageHandler);
-    unpinPage(bufferManager,pageHandler); 
+//The shortest prefix of right that still sorts above left. Keys between the last key of a leaf and the first
+//of the next one go to either leaf, so this separates them as well as the whole key and leaves more room
+//in the inner nodes. Int keys are kept whole.
+RC shortestSeparator(tree_DS* treeData, char* left, char* right, char* separator){
+    if(treeData->fMD.keyType != DT_STRING){
+        memcpy(separator,right,treeData->keySize);
+        return RC_OK;
+    }
+    int length = commonPrefix(left,right)+1;
+    memmove(separator,right,length);
+    separator[length] = '\0';
+    return RC_OK;
 }
 
-RC propagatesplitUp(BTreeHandle *treeHandler,int pgNumb,data keyData){
+int keyLength(tree_DS* treeData, char* key){
+    return treeData->fMD.keyType == DT_STRING ? (int)strlen(key) : (int)sizeof(int);
+}
 
-    BM_BufferPool *bufferManager = ((tree_DS*)treeHandler->mgmtData)->bufferManager;
-    BM_PageHandle *pageHandler = ((tree_DS*)treeHandler->mgmtData)->pageHandler;
-    SM_FileHandle fileHandler = ((tree_DS*)treeHandler->mgmtData)->fileHandler;
-    
-    int maxEntity = ((tree_DS*)treeHandler->mgmtData)->fMD.maxEntriesPerPage;
-    int curNumOfNodes = ((tree_DS*)treeHandler->mgmtData)->fMD.number_of_pageNodes;
-    
-    // if parent page number is -1, create new node
-    if(pgNumb != -1){
-        page_struct_data newPageToAdd; // page is full or not full, add data in existing page
-        readPageData(bufferManager,pageHandler,&newPageToAdd,pgNumb);
-        insertKeyPointer(&newPageToAdd,keyData);
-        
-        if(newPageToAdd.entry_number > maxEntity){ // if page have more than max entries
-            // if is true, divide and copy the data into new pages, the key of new node will be in right child and old node will be in left child. 
-            float *oldNodeChildren = (float *)malloc(10*sizeof(float));
-            int count = 0, *oldNodeKeys = (int *)malloc(10*sizeof(int));
-            size_t index = 0;
-            while(index < (int)ceil((newPageToAdd.entry_number)/2))
-            {
-                oldNodeKeys[count] = newPageToAdd.keys[index];
-                oldNodeChildren[count] = newPageToAdd.pointer_to_pages[index];
-                count++;
-                index++;
-            }
-            oldNodeChildren[count] = newPageToAdd.pointer_to_pages[count];
-            count++;
+//Binary search in a decoded node. String keys of a node all share the prefix of its first and last key,
+//the search key is checked against it once and the search itself only compares what follows.
+int searchNode(tree_DS* treeData, page_struct_data* node, char* key, int upper){
+    int low = 0, high = node->entry_number;
 
-            int count2 = 0,*keysForNewNode = (int *)malloc(10*sizeof(int));
-            float *childrenForNewNode = (float *)malloc(10*sizeof(float));
-            index=count;
-            while(index < newPageToAdd.entry_number + 2)
-            {
-                keysForNewNode[count2] = newPageToAdd.keys[index];
-                childrenForNewNode[count2] = newPageToAdd.pointer_to_pages[index];
-                count2++;
-                index++;
-            }
-            childrenForNewNode[count2] = newPageToAdd.pointer_to_pages[count];
+    if(treeData->fMD.keyType != DT_STRING){
+        int value;
+        memcpy(&value,key,sizeof(int));
+        pthread_once(&intSearchOnce,chooseIntSearch);
+        return searchInts((int*)node->keys,low,high,value,upper);
+    }
 
-            ensureCapacity (curNumOfNodes + 2, &fileHandler);
+    if(high == 0){
+        return 0;
+    }
+    int prefix = commonPrefix(node->keys,KEY_AT(treeData,node->keys,high-1));
+    int order = strncmp(key,node->keys,prefix);
+    if(order != 0){
+        return order < 0 ? 0 : high;
+    }
+    while(low < high){
+        int middle = (low+high)/2;
+        int result = strcmp(KEY_AT(treeData,node->keys,middle)+prefix,key+prefix);
+        if(result < 0 || (upper && result == 0)){
+            low = middle+1;
+        }
+        else{
+            high = middle;
+        }
+    }
+    return low;
+}
 
-            curNumOfNodes += 1;
+//Binary search right in a pinned page, starting at from. String keys are compared in their slots without
+//being put back together, the page's prefix is compared once.
+int searchPage(tree_DS* treeData, char* pageData, int from, char* key, int upper){
+    int low = from, high = ((node_Header*)pageData)->entry_number;
+
+    if(treeData->fMD.keyType != DT_STRING){
+        int value;
+        memcpy(&value,key,sizeof(int));
+        pthread_once(&intSearchOnce,chooseIntSearch);
+        int *keys = (int*)(pageData+NODE_KEY_OFFSET);
+        if(((node_Header*)pageData)->leaf || treeData->fMD.nodeLayout != BT_LAYOUT_BLOCKED || high == 0){
+            return searchInts(keys,low,high,value,upper);
+        }
+        // the lines whose first key comes before the key, the key's place is in the last of them
+        int *lines = (int*)(pageData+NODE_LINE_OFFSET(treeData->fMD.maxEntriesPerPage));
+        int line = searchInts(lines,0,NODE_LINES(high),value,upper);
+        if(line > 0){
+            int end = LINE_START(line) < high ? LINE_START(line) : high;
+            line = searchInts(keys,LINE_START(line-1),end,value,upper);
+        }
+        return line > low ? line : low;
+    }
 
-            ((tree_DS*)treeHandler->mgmtData)->fMD.number_of_pageNodes++;
+    string_Header *strings = (string_Header*)(pageData+sizeof(node_Header));
+    key_Slot *slots = (key_Slot*)(pageData+STRING_SLOT_OFFSET);
+    int prefix = strings->prefixLength;
+    int length = strlen(key);
+    int order = memcmp(key,pageData+PAGE_SIZE-prefix,length < prefix ? length : prefix);
+    if(order == 0 && length < prefix){
+        order = -1; // the key ends inside the prefix
+    }
+    if(order != 0){
+        return order < 0 ? low : high;
+    }
+    char *rest = key+prefix;
+    length -= prefix;
+    while(low < high){
+        int middle = (low+high)/2;
+        int slotLength = slots[middle].length;
+        int result = memcmp(pageData+slots[middle].offset,rest,slotLength < length ? slotLength : length);
+        if(result == 0){
+            result = slotLength-length;
+        }
+        if(result < 0 || (upper && result == 0)){
+            low = middle+1;
+        }
+        else{
+            high = middle;
+        }
+    }
+    return low;
+}
+
+//Window of int keys that is searched with vector compares once a binary search has narrowed it down
+#define SIMD_SEARCH_WINDOW 64
+
+//Position of the first key in [low, high) not smaller than value, or with upper larger than it
+int searchIntsLinear(int* keys, int low, int high, int value, int upper){
+    while(low < high && (keys[low] < value || (upper && keys[low] == value))){
+        low++;
+    }
+    return low;
+}
+
+int searchIntsBinary(int* keys, int low, int high, int value, int upper){
+    while(low < high){
+        int middle = (low+high)/2;
+        if(keys[middle] < value || (upper && keys[middle] == value)){
+            low = middle+1;
+        }
+        else{
+            high = middle;
+        }
+    }
+    return low;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+//The keys are sorted, so the position is low plus the number of keys in the window that come before value.
+//Every compare of a vector counts four or eight of them at once.
+__attribute__((target("sse4.2,popcnt")))
+int searchIntsSse(int* keys, int low, int high, int value, int upper){
+    while(high-low > SIMD_SEARCH_WINDOW){
+        int middle = (low+high)/2;
+        if(keys[middle] < value || (upper && keys[middle] == value)){
+            low = middle+1;
+        }
+        else{
+            high = middle;
+        }
+    }
+    // keys before value are those below it, or with upper those not above it
+    __m128i bound = _mm_set1_epi32(upper ? value : value-1);
+    int count = 0, i = low;
+    if(upper || value != INT_MIN){
+        for(; i+4 <= high; i += 4){
+            __m128i block = _mm_loadu_si128((__m128i*)&keys[i]);
+            count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(block,bound))) ^ 0xF);
+        }
+        for(; i < high; i++){
+            count += keys[i] <= (upper ? value : value-1);
+        }
+    }
+    return low+count;
+}
+
+__attribute__((target("avx2,popcnt")))
+int searchIntsAvx2(int* keys, int low, int high, int value, int upper){
+    while(high-low > SIMD_SEARCH_WINDOW){
+        int middle = (low+high)/2;
+        if(keys[middle] < value || (upper && keys[middle] == value)){
+            low = middle+1;
+        }
+        else{
+            high = middle;
+        }
+    }
+    __m256i bound = _mm256_set1_epi32(upper ? value : value-1);
+    int count = 0, i = low;
+    if(upper || value != INT_MIN){
+        for(; i+8 <= high; i += 8){
+            __m256i block = _mm256_loadu_si256((__m256i*)&keys[i]);
+            count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(block,bound))) ^ 0xFF);
+        }
+        for(; i < high; i++){
+            count += keys[i] <= (upper ? value : value-1);
+        }
+    }
+    return low+count;
+}
+#endif
+
+//Picks the widest search the processor supports, once per process
+void chooseIntSearch(void){
+    searchInts = searchIntsBinary;
+    intSearchName = "binary";
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if(!__builtin_cpu_supports("popcnt")){
+        return;
+    }
+    if(__builtin_cpu_supports("avx2")){
+        searchInts = searchIntsAvx2;
+        intSearchName = "avx2";
+    }
+    else if(__builtin_cpu_supports("sse4.2")){
+        searchInts = searchIntsSse;
+        intSearchName = "sse4.2";
+    }
+#endif
+}
+
+//Searches packed int keys with the given method, the benchmark compares them on the same keys
+int searchIntKeys(int *keys, int count, int key, int upper, int method){
+    pthread_once(&intSearchOnce,chooseIntSearch);
+    if(method == BT_SEARCH_LINEAR){
+        return searchIntsLinear(keys,0,count,key,upper);
+    }
+    if(method == BT_SEARCH_BINARY){
+        return searchIntsBinary(keys,0,count,key,upper);
+    }
+    return searchInts(keys,0,count,key,upper);
+}
+
+//Name of the search searchIntKeys runs for BT_SEARCH_SIMD
+const char *getIntSearchName(void){
+    pthread_once(&intSearchOnce,chooseIntSearch);
+    return intSearchName;
+}
+
+//Lays out an inner node of count int keys in the given layout, children are numbered 0 to count
+RC formatIntNode(char *pageData, int *keys, int count, int layout){
+    tree_DS treeData;
+    treeData.fMD.keyType = DT_INT;
+    treeData.fMD.maxEntriesPerPage = getMaxEntriesPerPage(DT_INT);
+    if(count < 0 || count > treeData.fMD.maxEntriesPerPage || setNodeLayout(&treeData.fMD,layout) != RC_OK){
+        return RC_ERROR;
+    }
+
+    PageNumber children[count+1];
+    for(int i = 0; i <= count; i++){
+        children[i] = i;
+    }
+    page_struct_data node;
+    node.leaf = 0;
+    node.entry_number = count;
+    node.page_Number = -1;
+    node.right_Sibling = node.left_Sibling = -1;
+    node.pointer_to_pages = children;
+    node.rids = NULL;
+    node.keys = (char*)keys;
+    return formatNodePage(&treeData,pageData,&node);
+}
+
+//Searches a page written by formatIntNode like a descent searches a pinned inner node
+int searchIntNode(char *pageData, int key, int upper, int layout){
+    tree_DS treeData;
+    treeData.fMD.keyType = DT_INT;
+    treeData.fMD.maxEntriesPerPage = getMaxEntriesPerPage(DT_INT);
+    treeData.fMD.nodeLayout = layout;
+    return searchPage(&treeData,pageData,0,(char*)&key,upper);
+}
+
+//Bytes count keys take up in a string page together with their RIDs or children. The prefix is the one of
+//the first and the last key, unless a shorter one is given to bound what the keys may still take.
+int stringPageSize(tree_DS* treeData, int leaf, char* keys, int count, int prefix){
+    int size = STRING_SLOT_OFFSET + count*sizeof(key_Slot);
+    size += leaf ? count*sizeof(RID) : (count+1)*sizeof(PageNumber);
+    if(count == 0){
+        return size;
+    }
+    if(prefix < 0){
+        prefix = commonPrefix(keys,KEY_AT(treeData,keys,count-1));
+    }
+    size += prefix;
+    for(int i = 0; i < count; i++){
+        size += strlen(KEY_AT(treeData,keys,i))-prefix;
+    }
+    return size;
+}
+
+//Whether count keys fit into a node, string keys may only fill limit bytes of its page
+int fitsInNode(tree_DS* treeData, int leaf, char* keys, int count, int limit){
+    if(count > treeData->fMD.maxEntriesPerPage){
+        return 0;
+    }
+    return treeData->fMD.keyType != DT_STRING || stringPageSize(treeData,leaf,keys,count,-1) <= limit;
+}
+
+//A node runs underfull below half of the keys it may hold, a node with string keys only once it also fills less than half of its page
+int isUnderfull(tree_DS* treeData, int leaf, char* keys, int count){
+    int maxEntries = treeData->fMD.maxEntriesPerPage;
+    // a leaf keeps at least half of its entries, an inner node at least half of its keys
+    int minEntries = leaf ? (maxEntries+1)/2 : maxEntries/2;
+    if(count >= minEntries){
+        return 0;
+    }
+    return treeData->fMD.keyType != DT_STRING || stringPageSize(treeData,leaf,keys,count,-1) < PAGE_SIZE/2;
+}
+
+//Whether a node still fits into its page once key is added in front of its keys or behind them
+int fitsWithKey(tree_DS* treeData, int leaf, char* keys, int count, char* key, int front){
+    if(count+1 > treeData->fMD.maxEntriesPerPage){
+        return 0;
+    }
+    if(treeData->fMD.keyType != DT_STRING){
+        return 1;
+    }
+    char *first = front || count == 0 ? key : keys;
+    char *last = !front || count == 0 ? key : KEY_AT(treeData,keys,count-1);
+    int prefix = commonPrefix(first,last);
+    int size = stringPageSize(treeData,leaf,keys,count,prefix) + sizeof(key_Slot) + (leaf ? sizeof(RID) : sizeof(PageNumber));
+    size += strlen(key)-prefix + (count == 0 ? prefix : 0);
+    return size <= PAGE_SIZE;
+}
+
+//The units are spread evenly, the first pieces take one more if they do not divide. A leaf's units are its
+//entries, an inner node's its children with keys[i] between child i and i+1. Pieces of string keys are
+//added until every piece fits into limit bytes.
+int planPieces(tree_DS* treeData, int leaf, char* keys, int units, int perPiece, int limit, int** takes){
+    int pieces = (units+perPiece-1)/perPiece;
+    // a leaf piece needs an entry, an inner piece two children
+    int maxPieces = leaf ? units : units/2;
+    *takes = (int*)malloc(units*sizeof(int));
+
+    for(;; pieces++){
+        int start = 0, fits = 1;
+        for(int i = 0; i < pieces; i++){
+            (*takes)[i] = units/pieces + (i < units%pieces ? 1 : 0);
+            int count = leaf ? (*takes)[i] : (*takes)[i]-1;
+            fits = fits && fitsInNode(treeData,leaf,KEY_AT(treeData,keys,start),count,limit);
+            start += (*takes)[i];
+        }
+        if(fits || pieces >= maxPieces){
+            return pieces;
+        }
+    }
+}
+
+//A leaf of string keys that splits in two is cut where neighbouring keys share the shortest prefix within
+//its middle half, so both pieces keep a long prefix of their own. The nearest cut to the middle wins a tie.
+void moveSplitPoint(tree_DS* treeData, page_struct_data* node, int* takes){
+    int units = node->entry_number;
+    int best = takes[0], bestPrefix = commonPrefix(KEY_AT(treeData,node->keys,best-1),KEY_AT(treeData,node->keys,best));
+    for(int i = units/4 > 1 ? units/4 : 1; i <= units-units/4 && i < units; i++){
+        int prefix = commonPrefix(KEY_AT(treeData,node->keys,i-1),KEY_AT(treeData,node->keys,i));
+        if(prefix < bestPrefix || (prefix == bestPrefix && abs(i-units/2) < abs(best-units/2))){
+            if(fitsInNode(treeData,1,node->keys,i,PAGE_SIZE) && fitsInNode(treeData,1,KEY_AT(treeData,node->keys,i),units-i,PAGE_SIZE)){
+                best = i;
+                bestPrefix = prefix;
+            }
+        }
+    }
+    takes[0] = best;
+    takes[1] = units-best;
+}
+
+RC freePageData(page_struct_data* pageData){
+    free(pageData->keys);
+    free(pageData->pointer_to_pages);
+    free(pageData->rids);
+    pageData->keys = NULL;
+    pageData->pointer_to_pages = NULL;
+    pageData->rids = NULL;
+    return RC_OK;
+}
+
+//Takes the next page of the index file for a new node
+int allocateNodePage(tree_DS* treeData){
+    pthread_mutex_lock(&treeData->metaLatch);
+    treeData->fMD.number_of_pageNodes++;
+
+    // pages freed by merges are reused before the file grows
+    if(treeData->freePageCount > 0){
+        int pageNumber = treeData->freePages[--treeData->freePageCount];
+        pthread_mutex_unlock(&treeData->metaLatch);
+        return pageNumber;
+    }
+
+    treeData->fMD.lastPage_Number++;
+    int pageNumber = treeData->fMD.lastPage_Number; // page 0 holds the metadata
+    // the latch exists before any parent can point at the page
+    addNodeLatches(treeData,pageNumber);
+    ensureCapacity(pageNumber+1,&treeData->fileHandler);
+    pthread_mutex_unlock(&treeData->metaLatch);
+    return pageNumber;
+}
+
+RC freeNodePage(tree_DS* treeData, int pageNumber){
+    // a scan that still knows the page from a stale sibling link sees that it is gone
+    BM_PageHandle handle;
+    char pageData[PAGE_SIZE];
+    dropCachedNode(treeData,pageNumber);
+    pinPage(treeData->bufferManager,&handle,pageNumber);
+    memcpy(pageData,handle.data,PAGE_SIZE);
+    ((node_Header*)pageData)->leaf = FREED_NODE;
+    logPageChange(treeData,pageNumber,handle.data,pageData);
+    memcpy(handle.data,pageData,PAGE_SIZE);
+    markDirty(treeData->bufferManager,&handle);
+    unpinPage(treeData->bufferManager,&handle);
+
+    pthread_mutex_lock(&treeData->metaLatch);
+    treeData->fMD.number_of_pageNodes--;
+    pthread_mutex_unlock(&treeData->metaLatch);
+
+    // the page joins the free list when the merge commits
+    currentOp.freedPages[currentOp.freedCount++] = pageNumber;
+    return RC_OK;
+}
+
+pthread_rwlock_t* nodeLatch(tree_DS* treeData, int pageNumber){
+    return &treeData->nodeLatches[pageNumber/BTREE_LATCH_CHUNK_SIZE][pageNumber%BTREE_LATCH_CHUNK_SIZE];
+}
+
+//Makes sure pages up to lastPage have a latch, chunks are never moved so readers need no lock to find one
+RC addNodeLatches(tree_DS* treeData, int lastPage){
+    int lastChunk = lastPage/BTREE_LATCH_CHUNK_SIZE;
+    if(lastChunk >= BTREE_LATCH_CHUNKS){
+        return RC_ERROR;
+    }
+    for(int chunk = 0; chunk <= lastChunk; chunk++){
+        if(treeData->nodeLatches[chunk] == NULL){
+            pthread_rwlock_t *latches = (pthread_rwlock_t*)malloc(BTREE_LATCH_CHUNK_SIZE*sizeof(pthread_rwlock_t));
+            for(int i = 0; i < BTREE_LATCH_CHUNK_SIZE; i++){
+                pthread_rwlock_init(&latches[i],NULL);
+            }
+            // the cache slots exist only while the cache is on, setInnerNodeCache adds them to older chunks
+            if(treeData->innerCache){
+                treeData->innerNodes[chunk] = (page_struct_data**)calloc(BTREE_LATCH_CHUNK_SIZE,sizeof(page_struct_data*));
+            }
+            treeData->nodeLatches[chunk] = latches;
+        }
+    }
+    return RC_OK;
+}
+
+RC latchNode(tree_DS* treeData, int pageNumber, int mode){
+    if(mode == LATCH_EXCLUSIVE){
+        pthread_rwlock_wrlock(nodeLatch(treeData,pageNumber));
+    }
+    else{
+        pthread_rwlock_rdlock(nodeLatch(treeData,pageNumber));
+    }
+    return RC_OK;
+}
+
+RC unlatchNode(tree_DS* treeData, int pageNumber){
+    pthread_rwlock_unlock(nodeLatch(treeData,pageNumber));
+    return RC_OK;
+}
+
+page_struct_data* cachedInnerNode(tree_DS* treeData, int pageNumber){
+    if(!treeData->innerCache){
+        return NULL;
+    }
+    return __atomic_load_n(&treeData->innerNodes[pageNumber/BTREE_LATCH_CHUNK_SIZE][pageNumber%BTREE_LATCH_CHUNK_SIZE],__ATOMIC_ACQUIRE);
+}
+
+//Decodes an inner node into the cache out of a copy of its page taken before the unpin, so no pin is held
+//meanwhile. Readers sharing the node's latch may add it at the same time, the first one wins and the others
+//take its copy.
+page_struct_data* cacheInnerNode(tree_DS* treeData, char* pageData, int pageNumber){
+    if(!treeData->innerCache || ((node_Header*)pageData)->leaf){
+        return NULL;
+    }
+    page_struct_data *node = (page_struct_data*)malloc(sizeof(page_struct_data));
+    decodeNodePage(treeData,pageData,node,pageNumber);
+
+    // the copy is never changed, so it keeps only the keys and children it has
+    int entries = node->entry_number;
+    node->keys = (char*)realloc(node->keys,(long)(entries > 0 ? entries : 1)*treeData->keySize);
+    node->pointer_to_pages = (PageNumber*)realloc(node->pointer_to_pages,(entries+1)*sizeof(PageNumber));
+    free(node->rids);
+    node->rids = NULL;
+
+    page_struct_data *expected = NULL;
+    page_struct_data **slot = &treeData->innerNodes[pageNumber/BTREE_LATCH_CHUNK_SIZE][pageNumber%BTREE_LATCH_CHUNK_SIZE];
+    if(!__atomic_compare_exchange_n(slot,&expected,node,0,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE)){
+        freePageData(node);
+        free(node);
+        return expected;
+    }
+    __atomic_add_fetch(&treeData->innerCacheNodes,1,__ATOMIC_RELAXED);
+    __atomic_add_fetch(&treeData->innerCacheBytes,CACHED_NODE_BYTES(treeData,entries),__ATOMIC_RELAXED);
+    return node;
+}
+
+//Called with the node's exclusive latch held, so no reader is using the copy
+RC dropCachedNode(tree_DS* treeData, int pageNumber){
+    if(!treeData->innerCache){
+        return RC_OK;
+    }
+    page_struct_data *node = __atomic_exchange_n(&treeData->innerNodes[pageNumber/BTREE_LATCH_CHUNK_SIZE][pageNumber%BTREE_LATCH_CHUNK_SIZE],NULL,__ATOMIC_ACQ_REL);
+    if(node != NULL){
+        int entries = node->entry_number;
+        __atomic_sub_fetch(&treeData->innerCacheNodes,1,__ATOMIC_RELAXED);
+        __atomic_sub_fetch(&treeData->innerCacheBytes,CACHED_NODE_BYTES(treeData,entries),__ATOMIC_RELAXED);
+        freePageData(node);
+        free(node);
+    }
+    return RC_OK;
+}
+
+//A node is safe when adding or removing count entries cannot split it or leave it underfull, so nothing above it changes
+int isSafeNode(tree_DS* treeData, page_struct_data* node, int op, int count, int isRoot){
+    int maxEntries = treeData->fMD.maxEntriesPerPage;
+    int entries = node->entry_number;
+    int isString = treeData->fMD.keyType == DT_STRING;
+    // an entry with a string key at its longest
+    int entrySize = sizeof(key_Slot) + BT_MAX_KEY_LENGTH + (node->leaf ? sizeof(RID) : sizeof(PageNumber));
+
+    if(op == BTREE_OP_INSERT){
+        if(entries+count > maxEntries){
+            return 0;
+        }
+        // the keys may lose the prefix they share, so they are counted in full
+        return !isString || stringPageSize(treeData,node->leaf,node->keys,entries,0)+count*entrySize <= PAGE_SIZE;
+    }
+    // a root leaf may run empty, an inner root goes away once it is down to a single child
+    if(isRoot){
+        return node->leaf || entries > count;
+    }
+    int minEntries = node->leaf ? (maxEntries+1)/2 : maxEntries/2;
+    if(entries-count >= minEntries || !isString){
+        return entries-count >= minEntries;
+    }
+    // whichever keys go, the rest share no longer a prefix than the keys count places in from both ends
+    if(2*count >= entries){
+        return 0;
+    }
+    int prefix = commonPrefix(KEY_AT(treeData,node->keys,count),KEY_AT(treeData,node->keys,entries-1-count));
+    return stringPageSize(treeData,node->leaf,node->keys,entries,prefix)-count*entrySize >= PAGE_SIZE/2;
+}
+
+//Lets go of the latched inner pages path[from..to-1] and of the root pointer if it is still held
+RC releaseAncestors(tree_DS* treeData, int *path, int from, int to, int *rootHeld){
+    if(*rootHeld){
+        pthread_rwlock_unlock(&treeData->rootLatch);
+        *rootHeld = 0;
+    }
+    for(int level = from; level < to; level++){
+        unlatchNode(treeData,path[level]);
+    }
+    return RC_OK;
+}
+
+//Lets go of the siblings latched for the levels from..to, a level without one holds -1
+RC releaseSiblings(tree_DS* treeData, int *siblings, int from, int to){
+    for(int level = from; level <= to; level++){
+        if(siblings[level] != -1){
+            unlatchNode(treeData,siblings[level]);
+            siblings[level] = -1;
+        }
+    }
+    return RC_OK;
+}
+
+//The root is replaced only while it is latched exclusively, so a root that is still the root once latched stays it
+int latchRoot(tree_DS* treeData, int mode){
+    while(1){
+        int rootPage = __atomic_load_n(&treeData->fMD.rootpage_Number,__ATOMIC_ACQUIRE);
+        latchNode(treeData,rootPage,mode);
+        if(__atomic_load_n(&treeData->fMD.rootpage_Number,__ATOMIC_ACQUIRE) == rootPage){
+            return rootPage;
+        }
+        unlatchNode(treeData,rootPage);
+    }
+}
+
+int descendToLeaf(tree_DS* treeData, char* key, int leafMode, int *depth, char *upperKey){
+    int level = 0, childPage;
+
+    int pageNumber = latchRoot(treeData,LATCH_SHARED);
+    int isLeaf = findChildPage(treeData,pageNumber,key,&childPage,upperKey);
+    if(isLeaf && leafMode == LATCH_EXCLUSIVE){
+        // the root leaf may split while it is let go, the descent then starts from the new root
+        unlatchNode(treeData,pageNumber);
+        pageNumber = latchRoot(treeData,LATCH_EXCLUSIVE);
+        isLeaf = findChildPage(treeData,pageNumber,key,&childPage,upperKey);
+    }
+
+    // inner nodes are searched in their frames or in the cache
+    while(!isLeaf){
+        int nextPage;
+
+        // the parent is let go only once the child is latched
+        latchNode(treeData,childPage,LATCH_SHARED);
+        isLeaf = findChildPage(treeData,childPage,key,&nextPage,upperKey);
+        if(isLeaf && leafMode == LATCH_EXCLUSIVE){
+            unlatchNode(treeData,childPage);
+            latchNode(treeData,childPage,LATCH_EXCLUSIVE);
+        }
+        unlatchNode(treeData,pageNumber);
+        pageNumber = childPage;
+        childPage = nextPage;
+        level++;
+    }
+
+    if(depth != NULL){
+        *depth = level;
+    }
+    return pageNumber;
+}
+
+page_struct_data findLeafPage(tree_DS* treeData, char* key, int leafMode, int *depth){
+    page_struct_data leaf;
+    readPageData(treeData,&leaf,descendToLeaf(treeData,key,leafMode,depth,NULL));
+    return leaf;
+}
+
+int findChildPage(tree_DS* treeData, int pageNumber, char* key, int* childPage, char* upperKey){
+    BM_PageHandle handle;
+
+    // a cached inner node is searched without pinning its page
+    page_struct_data *cached = cachedInnerNode(treeData,pageNumber);
+    if(cached != NULL){
+        int index = searchNode(treeData,cached,key,1);
+        if(upperKey != NULL && index < cached->entry_number){
+            memcpy(upperKey,KEY_AT(treeData,cached->keys,index),treeData->keySize);
+        }
+        *childPage = cached->pointer_to_pages[index];
+        return 0;
+    }
+
+    pinPage(treeData->bufferManager,&handle,pageNumber);
+    node_View view;
+    viewNodePage(treeData,handle.data,&view);
+    int isLeaf = view.header->leaf;
+    int cache = !isLeaf && treeData->innerCache;
+    char pageData[PAGE_SIZE];
+    if(!isLeaf){
+        // child i holds the keys in [keys[i-1], keys[i])
+        int index = searchPage(treeData,handle.data,0,key,1);
+        if(upperKey != NULL && index < view.header->entry_number){
+            copyPageKey(treeData,handle.data,index,upperKey);
+        }
+        *childPage = view.children[index];
+        if(cache){
+            memcpy(pageData,handle.data,PAGE_SIZE);
+        }
+    }
+    unpinPage(treeData->bufferManager,&handle);
+
+    // the node's shared latch keeps the copy current while it is decoded
+    if(cache){
+        cacheInnerNode(treeData,pageData,pageNumber);
+    }
+    return isLeaf;
+}
+
+RC viewNodePage(tree_DS* treeData, char* pageData, node_View* view){
+    view->header = (node_Header*)pageData;
+    char *pointers;
+    if(treeData->fMD.keyType == DT_STRING){
+        view->intKeys = NULL;
+        view->strings = (string_Header*)(pageData+sizeof(node_Header));
+        view->slots = (key_Slot*)(pageData+STRING_SLOT_OFFSET);
+        pointers = pageData+STRING_POINTER_OFFSET(view->header->entry_number);
+    }
+    else{
+        view->intKeys = (int*)(pageData+NODE_KEY_OFFSET);
+        view->strings = NULL;
+        view->slots = NULL;
+        pointers = pageData+NODE_POINTER_OFFSET(treeData->fMD.maxEntriesPerPage);
+    }
+    view->rids = (RID*)pointers;
+    view->children = (PageNumber*)pointers;
+    return RC_OK;
+}
+
+//Puts key index of a page back together, a string key from the page's prefix and its slot
+RC copyPageKey(tree_DS* treeData, char* pageData, int index, char* key){
+    node_View view;
+    viewNodePage(treeData,pageData,&view);
+    if(view.strings == NULL){
+        memcpy(key,&view.intKeys[index],sizeof(int));
+        return RC_OK;
+    }
+    int prefix = view.strings->prefixLength;
+    memcpy(key,pageData+PAGE_SIZE-prefix,prefix);
+    memcpy(key+prefix,pageData+view.slots[index].offset,view.slots[index].length);
+    key[prefix+view.slots[index].length] = '\0';
+    return RC_OK;
+}
+
+//Looks a key up in a latched leaf without copying anything out of the frame but its RID
+RC findInLeaf(tree_DS* treeData, int pageNumber, char* key, RID* result){
+    BM_PageHandle handle;
+    node_View view;
+    RC rc = RC_IM_KEY_NOT_FOUND;
+
+    pinPage(treeData->bufferManager,&handle,pageNumber);
+    viewNodePage(treeData,handle.data,&view);
+    int index = searchPage(treeData,handle.data,0,key,0);
+    if(index < view.header->entry_number && searchPage(treeData,handle.data,index,key,1) > index){
+        *result = view.rids[index];
+        rc = RC_OK;
+    }
+    unpinPage(treeData->bufferManager,&handle);
+
+    return rc;
+}
+
+//Inserts into an exclusively latched leaf in its frame. A string key only goes in while it starts with the
+//page's prefix and its rest, slot and RID fit between the RIDs and the key bytes, anything else is left to
+//the decoded path, which may also pick a new prefix.
+RC insertIntoLeaf(tree_DS* treeData, int pageNumber, char* key, RID rid, int* done){
+    BM_PageHandle handle;
+    node_View view;
+    char oldData[PAGE_SIZE];
+    RC rc = RC_OK;
+    *done = 0;
+
+    pinPage(treeData->bufferManager,&handle,pageNumber);
+    viewNodePage(treeData,handle.data,&view);
+    int entries = view.header->entry_number;
+    int index = searchPage(treeData,handle.data,0,key,0);
+    if(index < entries && searchPage(treeData,handle.data,index,key,1) > index){
+        rc = RC_IM_KEY_ALREADY_EXISTS;
+        *done = 1;
+    }
+    else if(entries < treeData->fMD.maxEntriesPerPage && view.strings == NULL){
+        memcpy(oldData,handle.data,PAGE_SIZE);
+        memmove(&view.intKeys[index+1],&view.intKeys[index],(entries-index)*sizeof(int));
+        memcpy(&view.intKeys[index],key,sizeof(int));
+        memmove(&view.rids[index+1],&view.rids[index],(entries-index)*sizeof(RID));
+        view.rids[index] = rid;
+        *done = 1;
+    }
+    else if(entries < treeData->fMD.maxEntriesPerPage){
+        int prefix = view.strings->prefixLength;
+        int rest = (int)strlen(key)-prefix;
+        int end = PAGE_SIZE-view.strings->keyBytes-rest;
+        int used = STRING_POINTER_OFFSET(entries+1)+(entries+1)*sizeof(RID);
+        if(rest >= 0 && memcmp(key,handle.data+PAGE_SIZE-prefix,prefix) == 0 && used <= end){
+            memcpy(oldData,handle.data,PAGE_SIZE);
+
+            // the RIDs move behind the new slot, the ones after the key one place further
+            RID *rids = (RID*)(handle.data+STRING_POINTER_OFFSET(entries+1));
+            memmove(&rids[index+1],&view.rids[index],(entries-index)*sizeof(RID));
+            memmove(rids,view.rids,index*sizeof(RID));
+            rids[index] = rid;
+            memmove(&view.slots[index+1],&view.slots[index],(entries-index)*sizeof(key_Slot));
+            memcpy(handle.data+end,key+prefix,rest);
+            view.slots[index].offset = end;
+            view.slots[index].length = rest;
+            view.strings->keyBytes += rest;
+            *done = 1;
+        }
+    }
+    if(*done && rc == RC_OK){
+        view.header->entry_number++;
+        logPageChange(treeData,pageNumber,oldData,handle.data);
+        markDirty(treeData->bufferManager,&handle);
+    }
+    unpinPage(treeData->bufferManager,&handle);
+
+    return rc;
+}
+
+//Deletes from an exclusively latched leaf in its frame while it keeps at least half of its entries,
+//a leaf that may run underfull is left to the decoded path and its rebalancing
+RC deleteFromLeaf(tree_DS* treeData, int pageNumber, char* key, RID* rid, int isRoot, int* done){
+    BM_PageHandle handle;
+    node_View view;
+    char oldData[PAGE_SIZE];
+    RC rc = RC_OK;
+    *done = 1;
+
+    pinPage(treeData->bufferManager,&handle,pageNumber);
+    viewNodePage(treeData,handle.data,&view);
+    int entries = view.header->entry_number;
+    int index = searchPage(treeData,handle.data,0,key,0);
+    if(index == entries || searchPage(treeData,handle.data,index,key,1) == index
+       || (rid != NULL && (view.rids[index].page != rid->page || view.rids[index].slot != rid->slot))){
+        rc = RC_IM_KEY_NOT_FOUND;
+    }
+    else if(!isRoot && entries-1 < (treeData->fMD.maxEntriesPerPage+1)/2){
+        *done = 0;
+    }
+    else if(view.strings == NULL){
+        memcpy(oldData,handle.data,PAGE_SIZE);
+        memmove(&view.intKeys[index],&view.intKeys[index+1],(entries-index-1)*sizeof(int));
+        view.intKeys[entries-1] = 0;
+        memmove(&view.rids[index],&view.rids[index+1],(entries-index-1)*sizeof(RID));
+        memset(&view.rids[entries-1],0,sizeof(RID));
+    }
+    else{
+        memcpy(oldData,handle.data,PAGE_SIZE);
+
+        // the key bytes below the deleted ones move up to close the gap
+        int offset = view.slots[index].offset, length = view.slots[index].length;
+        int start = PAGE_SIZE-view.strings->keyBytes;
+        memmove(handle.data+start+length,handle.data+start,offset-start);
+        memset(handle.data+start,0,length);
+        for(int i = 0; i < entries; i++){
+            if(view.slots[i].offset < offset){
+                view.slots[i].offset += length;
+            }
+        }
+        view.strings->keyBytes -= length;
+
+        // the slots close up first, then the RIDs follow them one slot further down
+        RID *rids = (RID*)(handle.data+STRING_POINTER_OFFSET(entries-1));
+        memmove(&view.slots[index],&view.slots[index+1],(entries-index-1)*sizeof(key_Slot));
+        memmove(rids,view.rids,index*sizeof(RID));
+        memmove(&rids[index],&view.rids[index+1],(entries-index-1)*sizeof(RID));
+        memset(&rids[entries-1],0,sizeof(RID)+sizeof(key_Slot));
+    }
+    if(*done && rc == RC_OK){
+        view.header->entry_number--;
+        logPageChange(treeData,pageNumber,oldData,handle.data);
+        markDirty(treeData->bufferManager,&handle);
+    }
+    unpinPage(treeData->bufferManager,&handle);
+
+    return rc;
+}
+
+//Descends from the root to the leaf that holds the key, remembering the inner pages on the way.
+//path[*latched..*depth-1] are still latched when it returns, together with the root pointer if *rootHeld.
+//upperKey, if given, receives the separator right of the leaf, it is left alone for the rightmost leaf.
+page_struct_data findLeafPageforInsertion(tree_DS* treeData, char* key, int op, int count, int *path, int *depth, int *latched, int *rootHeld, char *upperKey, int *siblings){
+    page_struct_data node;
+    int level = 0;
+    if(siblings != NULL){
+        siblings[0] = -1; // the root has none
+    }
+
+    pthread_rwlock_wrlock(&treeData->rootLatch);
+    *rootHeld = 1;
+    *latched = 0;
+    latchNode(treeData,treeData->fMD.rootpage_Number,LATCH_EXCLUSIVE);
+    readPageData(treeData,&node,treeData->fMD.rootpage_Number);
+    if(isSafeNode(treeData,&node,op,count,1)){
+        releaseAncestors(treeData,path,0,0,rootHeld);
+    }
+
+    while(!node.leaf){
+        // child i holds the keys in [keys[i-1], keys[i])
+        int index = searchNode(treeData,&node,key,1);
+        int childPage = node.pointer_to_pages[index];
+        // the left sibling is preferred, only the first child has to use the one on its right
+        int siblingPage = node.pointer_to_pages[index > 0 ? index-1 : index+1];
+        if(index < node.entry_number && upperKey != NULL){
+            memcpy(upperKey,KEY_AT(treeData,node.keys,index),treeData->keySize);
+        }
+        path[level] = node.page_Number;
+        level++;
+        freePageData(&node);
+
+        latchNode(treeData,childPage,LATCH_EXCLUSIVE);
+        readPageData(treeData,&node,childPage);
+        if(siblings != NULL){
+            siblings[level] = -1;
+        }
+        if(isSafeNode(treeData,&node,op,count,0)){
+            releaseAncestors(treeData,path,*latched,level,rootHeld);
+            if(siblings != NULL){
+                releaseSiblings(treeData,siblings,*latched,level);
+            }
+            *latched = level;
+        }
+        else if(siblings != NULL){
+            // taken on the way down, a rebalance that went for it on the way up would hold latches below the
+            // sibling's level while another writer may hold the sibling and come down into those pages.
+            // The parent stays latched, so no other writer can be restructuring the sibling meanwhile.
+            latchNode(treeData,siblingPage,LATCH_EXCLUSIVE);
+            siblings[level] = siblingPage;
+        }
+    }
+
+    // the leaf's key range cannot change while it is latched, even once its parent is let go
+    *depth = level;
+    return node;
+}
+
+RC newkeyAndPtrToLeaf(tree_DS* treeData, page_struct_data* pageData, char* key, RID rid)
+{
+    int keySize = treeData->keySize;
+    int index = searchNode(treeData,pageData,key,0);
+
+    if(index<pageData->entry_number && compareKeys(treeData->fMD.keyType,key,KEY_AT(treeData,pageData->keys,index)) == 0){
+        return RC_IM_KEY_ALREADY_EXISTS;
+    }
+
+    // shifting the larger keys one place to the right
+    int moved = pageData->entry_number-index;
+    memmove(KEY_AT(treeData,pageData->keys,index+1),KEY_AT(treeData,pageData->keys,index),moved*keySize);
+    memmove(&pageData->rids[index+1],&pageData->rids[index],moved*sizeof(RID));
+
+    memcpy(KEY_AT(treeData,pageData->keys,index),key,keySize);
+    pageData->rids[index] = rid;
+    pageData->entry_number++;
+    return RC_OK;
+}
+
+int mergeIntoLeaf(tree_DS* treeData, page_struct_data* leaf, batch_Entry* entries, int count, long* bytes){
+    int keySize = treeData->keySize;
+    char *keys = (char*)malloc((long)(leaf->entry_number+count)*keySize);
+    RID *rids = (RID*)malloc((leaf->entry_number+count)*sizeof(RID));
+    int i = 0, j = 0, merged = 0, skipped = 0;
+
+    while(i < leaf->entry_number || j < count){
+        int order = j == count ? -1 : i == leaf->entry_number ? 1 : compareKeys(treeData->fMD.keyType,KEY_AT(treeData,leaf->keys,i),entries[j].key);
+        if(order < 0){
+            memcpy(KEY_AT(treeData,keys,merged),KEY_AT(treeData,leaf->keys,i),keySize);
+            rids[merged++] = leaf->rids[i++];
+        }
+        else if(order == 0){
+            skipped++; // the key is already in the leaf, its RID stays
+            j++;
+        }
+        else{
+            memcpy(KEY_AT(treeData,keys,merged),entries[j].key,keySize);
+            *bytes += keyLength(treeData,entries[j].key);
+            rids[merged++] = entries[j++].rid;
+        }
+    }
+
+    // the leaf arrays were grown by the caller to hold every entry
+    memcpy(leaf->keys,keys,(long)merged*keySize);
+    memcpy(leaf->rids,rids,merged*sizeof(RID));
+    leaf->entry_number = merged;
+    free(keys);
+    free(rids);
+    return skipped;
+}
+
+RC propagatesplitUp(BTreeHandle *treeHandler,int *path,int level,data *separators,int count){
+
+    tree_DS *treeData = (tree_DS*)treeHandler->mgmtData;
+    page_struct_data parent;
+    int newRoot = 0;
+
+    // if there is no parent left on the path, the root was split and a new root is needed
+    if(level > 0){
+        // page is full or not full, add data in existing page
+        readPageData(treeData,&parent,path[level-1]);
+        growPageData(treeData,&parent,parent.entry_number+count);
+        for(int i = 0; i < count; i++){
+            insertKeyPointer(treeData,&parent,&separators[i]);
+        }
+    }
+    else{
+        // making new node as root, it starts out with the left piece and every separator
+        allocatePageData(treeData,&parent);
+        growPageData(treeData,&parent,count);
+        parent.page_Number = allocateNodePage(treeData);
+        parent.pointer_to_pages[0] = separators[0].left;
+        for(int i = 0; i < count; i++){
+            memcpy(KEY_AT(treeData,parent.keys,i),separators[i].key,treeData->keySize);
+            parent.pointer_to_pages[i+1] = separators[i].right;
+        }
+        parent.entry_number = count;
+        parent.right_Sibling = -1;
+        parent.left_Sibling = -1;
+        parent.leaf = 0;
+
+        newRoot = 1;
+        currentOp.newRoot = parent.page_Number; // the commit record carries the new root
+        pthread_mutex_lock(&treeData->metaLatch);
+        treeData->fMD.height++;
+        pthread_mutex_unlock(&treeData->metaLatch);
+        level = 1; // a new root that is still overfull splits like any other node one level up
+    }
+
+    if(!fitsInNode(treeData,0,parent.keys,parent.entry_number,PAGE_SIZE)){ // if the page cannot take the new separators
+        data *parentSeparators;
+        int parentCount;
+        splitNode(treeData,&parent,&parentSeparators,&parentCount);
+        freePageData(&parent);
+
+        //propagate up
+        RC rc = propagatesplitUp(treeHandler,path,level-1,parentSeparators,parentCount);
+        free(parentSeparators);
+        return rc;
+    }
+
+    writePageData(treeData,&parent);
+    if(newRoot){
+        // readers find the new root only once it is written, until then they wait on the old one's latch
+        __atomic_store_n(&treeData->fMD.rootpage_Number,parent.page_Number,__ATOMIC_RELEASE);
+    }
+    freePageData(&parent);
+    return RC_OK;
+}
+
+//Splits an overfull node into as few pieces as fit into a page, each at least half full.
+//The node keeps the first piece, the others go to new pages and every piece is written.
+RC splitNode(tree_DS* treeData, page_struct_data* node, data** separators, int* count){
+    int maxEntries = treeData->fMD.maxEntriesPerPage;
+    int keySize = treeData->keySize;
+
+    // a leaf hands out its entries, an inner node its children and moves the key between two pieces up
+    int units = node->leaf ? node->entry_number : node->entry_number+1;
+    int perPiece = node->leaf ? maxEntries : maxEntries+1;
+    int *takes;
+    int pieces = planPieces(treeData,node->leaf,node->keys,units,perPiece,PAGE_SIZE,&takes);
+    if(treeData->fMD.keyType == DT_STRING && node->leaf && pieces == 2){
+        moveSplitPoint(treeData,node,takes);
+    }
+
+    *count = pieces-1;
+    *separators = (data*)malloc((pieces-1)*sizeof(data));
+
+    // the pages are taken up front, so every leaf piece can point at the next one
+    int *pages = (int*)malloc(pieces*sizeof(int));
+    pages[0] = node->page_Number;
+    for(int i = 1; i < pieces; i++){
+        pages[i] = allocateNodePage(treeData);
+    }
+
+    page_struct_data piece;
+    allocatePageData(treeData,&piece);
+    piece.leaf = node->leaf;
+    piece.left_Sibling = -1;
+    piece.right_Sibling = -1;
+
+    int start = takes[0];
+    for(int i = 1; i < pieces; i++){
+        int take = takes[i];
+        piece.page_Number = pages[i];
+        if(node->leaf){
+            piece.entry_number = take;
+            memcpy(piece.keys,KEY_AT(treeData,node->keys,start),(long)take*keySize);
+            memcpy(piece.rids,&node->rids[start],take*sizeof(RID));
+            piece.left_Sibling = pages[i-1];
+            piece.right_Sibling = i < pieces-1 ? pages[i+1] : node->right_Sibling; // the last piece takes over the old right neighbour
+            shortestSeparator(treeData,KEY_AT(treeData,node->keys,start-1),KEY_AT(treeData,node->keys,start),(*separators)[i-1].key);
+        }
+        else{
+            piece.entry_number = take-1;
+            memcpy(piece.keys,KEY_AT(treeData,node->keys,start),(long)(take-1)*keySize);
+            memcpy(piece.pointer_to_pages,&node->pointer_to_pages[start],take*sizeof(PageNumber));
+            memcpy((*separators)[i-1].key,KEY_AT(treeData,node->keys,start-1),keySize);
+        }
+        (*separators)[i-1].left = pages[i-1];
+        (*separators)[i-1].right = pages[i];
+        writePageData(treeData,&piece);
+        start += take;
+    }
+    freePageData(&piece);
+
+    int oldRight = node->right_Sibling;
+    node->entry_number = node->leaf ? takes[0] : takes[0]-1;
+    if(node->leaf){
+        node->right_Sibling = pages[1];
+    }
+    writePageData(treeData,node);
+
+    // the new pieces are only reachable once the node points at them
+    if(node->leaf && oldRight != -1){
+        setLeftSibling(treeData,oldRight,pages[pieces-1]);
+    }
+
+    free(takes);
+    free(pages);
+    return RC_OK;
+}
+
+RC insertKeyPointer(tree_DS* treeData, page_struct_data* page_struct_data, data* keyData){
+    int keySize = treeData->keySize;
+    int currentPosition = searchNode(treeData,page_struct_data,keyData->key,0);
+
+    if(currentPosition < page_struct_data->entry_number && compareKeys(treeData->fMD.keyType,keyData->key,KEY_AT(treeData,page_struct_data->keys,currentPosition)) == 0){
+        return RC_IM_KEY_ALREADY_EXISTS;
+    }
+
+    // the left pointer is already in place, the key and right pointer go after it
+    int moved = page_struct_data->entry_number-currentPosition;
+    memmove(KEY_AT(treeData,page_struct_data->keys,currentPosition+1),KEY_AT(treeData,page_struct_data->keys,currentPosition),moved*keySize);
+    memmove(&page_struct_data->pointer_to_pages[currentPosition+2],&page_struct_data->pointer_to_pages[currentPosition+1],moved*sizeof(PageNumber));
+
+    memcpy(KEY_AT(treeData,page_struct_data->keys,currentPosition),keyData->key,keySize);
+    page_struct_data->pointer_to_pages[currentPosition] = keyData->left;
+    page_struct_data->pointer_to_pages[currentPosition+1] = keyData->right;
+    page_struct_data->entry_number++;
+
+    return RC_OK;
+}
+
+//Remembers a written node and the smallest key below it for the level above
+RC addToBulkLevel(tree_DS* treeData, bulk_Level* level, char* key, PageNumber page){
+    if(level->count == level->capacity){
+        level->capacity = level->capacity == 0 ? 64 : level->capacity*2;
+        level->keys = (char*)realloc(level->keys,(long)level->capacity*treeData->keySize);
+        level->pages = (PageNumber*)realloc(level->pages,level->capacity*sizeof(PageNumber));
+    }
+    memcpy(KEY_AT(treeData,level->keys,level->count),key,treeData->keySize);
+    level->pages[level->count] = page;
+    level->count++;
+    return RC_OK;
+}
+
+//Writes a node straight to its page in the index file, bypassing the buffer pool
+RC writeBulkNode(tree_DS* treeData, page_struct_data* node, char* pageBuffer, bulk_Level* level){
+    formatNodePage(treeData,pageBuffer,node);
+    if(level->count > 0 && node->entry_number > 0){
+        char separator[BTREE_KEY_SIZE];
+        shortestSeparator(treeData,level->lastKey,node->keys,separator);
+        addToBulkLevel(treeData,level,separator,node->page_Number);
+    }
+    else{
+        addToBulkLevel(treeData,level,node->keys,node->page_Number);
+    }
+    if(node->entry_number > 0){
+        memcpy(level->lastKey,KEY_AT(treeData,node->keys,node->entry_number-1),treeData->keySize);
+    }
+    return writeBlock(node->page_Number,&treeData->fileHandler,pageBuffer);
+}
+
+//Fills leaves left to right with up to fill entries each. One full leaf is held back
+//so the last leaf can borrow from it instead of being left nearly empty.
+RC bulkLoadLeaves(tree_DS* treeData, BT_BulkIterator* iterator, int fill, int fillSize, bulk_Level* level, char* pageBuffer, int* nextPage){
+    page_struct_data pending, current, swap;
+    int keySize = treeData->keySize;
+    allocatePageData(treeData,&pending);
+    allocatePageData(treeData,&current);
+    current.leaf = 1;
+    current.entry_number = 0;
+    current.right_Sibling = -1;
+    current.left_Sibling = -1;
+    current.page_Number = (*nextPage)++;
+    pending.leaf = 1;
+    pending.entry_number = 0;
+
+    int hasPending = 0;
+    char lastKey[BTREE_KEY_SIZE];
+    Value key[BT_MAX_KEY_ATTRS];
+    RID rid;
+    RC result;
+
+    while((result = iterator->next(iterator,key,&rid)) == RC_OK){
+        // the key goes behind the current leaf's entries first, to see whether the leaf can still take it
+        char *slot = KEY_AT(treeData,current.keys,current.entry_number);
+        result = valueToKey(treeData,key,slot);
+        if(result != RC_OK){
+            break;
+        }
+        if(treeData->fMD.nonUnique){
+            appendRid(slot,rid);
+        }
+        if(treeData->fMD.entry_Number > 0 && compareKeys(treeData->fMD.keyType,slot,lastKey) <= 0){
+            result = RC_IM_KEYS_NOT_SORTED;
+            break;
+        }
+        memcpy(lastKey,slot,keySize);
+
+        if(current.entry_number == fill || (current.entry_number > 0 && !fitsInNode(treeData,1,current.keys,current.entry_number+1,fillSize))){
+            // the held back leaf is complete now, it links to the current one
+            if(hasPending){
+                pending.right_Sibling = current.page_Number;
+                writeBulkNode(treeData,&pending,pageBuffer,level);
+            }
+            swap = pending;
+            pending = current;
+            current = swap;
+            hasPending = 1;
+            current.leaf = 1;
+            current.entry_number = 0;
+            current.page_Number = (*nextPage)++;
+            current.left_Sibling = pending.page_Number;
+        }
+
+        memcpy(KEY_AT(treeData,current.keys,current.entry_number),lastKey,keySize);
+        current.rids[current.entry_number] = rid;
+        current.entry_number++;
+        treeData->fMD.entry_Number++;
+        treeData->fMD.keyBytes += keyLength(treeData,lastKey);
+    }
+
+    if(result == RC_IM_NO_MORE_ENTRIES){
+        result = RC_OK;
+        if(hasPending){
+            // evening out the last two leaves if the last one ended up less than half full
+            int underfull = current.entry_number < treeData->fMD.maxEntriesPerPage/2;
+            if(underfull && treeData->fMD.keyType == DT_STRING){
+                underfull = stringPageSize(treeData,1,current.keys,current.entry_number,-1) < fillSize/2;
+            }
+            if(underfull && treeData->fMD.keyType == DT_STRING){
+                // string leaves are evened out by bytes, a held back leaf of a few long keys can have fewer
+                // entries than a last leaf of many short ones. Keys move one at a time while the last leaf
+                // stays under half of fillSize and the held back one keeps at least half of it.
+                while(pending.entry_number > 1 && current.entry_number < treeData->fMD.maxEntriesPerPage
+                      && stringPageSize(treeData,1,current.keys,current.entry_number,-1) < fillSize/2
+                      && stringPageSize(treeData,1,pending.keys,pending.entry_number-1,-1) >= fillSize/2){
+                    memmove(KEY_AT(treeData,current.keys,1),current.keys,(long)current.entry_number*keySize);
+                    memmove(&current.rids[1],current.rids,current.entry_number*sizeof(RID));
+                    memcpy(current.keys,KEY_AT(treeData,pending.keys,pending.entry_number-1),keySize);
+                    current.rids[0] = pending.rids[pending.entry_number-1];
+                    pending.entry_number--;
+                    current.entry_number++;
+
+                    // the moved key may not share as long a prefix with the others, then it goes back
+                    if(!fitsInNode(treeData,1,current.keys,current.entry_number,PAGE_SIZE)){
+                        pending.entry_number++;
+                        current.entry_number--;
+                        memmove(current.keys,KEY_AT(treeData,current.keys,1),(long)current.entry_number*keySize);
+                        memmove(current.rids,&current.rids[1],current.entry_number*sizeof(RID));
+                        break;
+                    }
+                }
+            }
+            else if(underfull){
+                // leaves without string keys are cut at fill entries, so the held back one never has fewer than the last
+                int moved = (pending.entry_number-current.entry_number)/2;
+                if(moved > 0){
+                    memmove(KEY_AT(treeData,current.keys,moved),current.keys,(long)current.entry_number*keySize);
+                    memmove(&current.rids[moved],current.rids,current.entry_number*sizeof(RID));
+                    memcpy(current.keys,KEY_AT(treeData,pending.keys,pending.entry_number-moved),(long)moved*keySize);
+                    memcpy(current.rids,&pending.rids[pending.entry_number-moved],moved*sizeof(RID));
+                    pending.entry_number -= moved;
+                    current.entry_number += moved;
+                }
+            }
+            pending.right_Sibling = current.page_Number;
+            writeBulkNode(treeData,&pending,pageBuffer,level);
+        }
+        current.right_Sibling = -1;
+        writeBulkNode(treeData,&current,pageBuffer,level);
+    }
+
+    freePageData(&pending);
+    freePageData(&current);
+    return result;
+}
+
+//Builds the inner levels on top of the written leaves and returns the root page
+PageNumber bulkLoadInnerLevels(tree_DS* treeData, int fill, int fillSize, bulk_Level* children, char* pageBuffer, int* nextPage){
+    page_struct_data node;
+    int keySize = treeData->keySize;
+    allocatePageData(treeData,&node);
+    node.leaf = 0;
+    node.right_Sibling = -1;
+    node.left_Sibling = -1;
+
+    while(children->count > 1){
+        bulk_Level parents;
+        parents.keys = NULL;
+        parents.pages = NULL;
+        parents.count = 0;
+        parents.capacity = 0;
+
+        // the children are spread evenly, so the last node of a level is never left underfull.
+        // The key between child i and i+1 is the smallest one below child i+1.
+        int *takes;
+        int nodes = planPieces(treeData,0,KEY_AT(treeData,children->keys,1),children->count,fill+1,fillSize,&takes);
+        int index = 0;
+        for(int i = 0; i < nodes; i++){
+            int take = takes[i];
+            node.page_Number = (*nextPage)++;
+            node.entry_number = take-1;
+            memcpy(node.pointer_to_pages,&children->pages[index],take*sizeof(PageNumber));
+            memcpy(node.keys,KEY_AT(treeData,children->keys,index+1),(long)(take-1)*keySize);
+
+            // the smallest key below this node is the one of its first child
+            formatNodePage(treeData,pageBuffer,&node);
+            writeBlock(node.page_Number,&treeData->fileHandler,pageBuffer);
+            addToBulkLevel(treeData,&parents,KEY_AT(treeData,children->keys,index),node.page_Number);
+            index += take;
+        }
+        free(takes);
+
+        free(children->keys);
+        free(children->pages);
+        *children = parents;
+        treeData->fMD.height++;
+    }
+
+    freePageData(&node);
+    return children->pages[0];
+}
+
+RC deletekeyInLeaf(tree_DS* treeData, page_struct_data* pageData, char* key, RID* rid){
+    int index = searchNode(treeData,pageData,key,0);
+    if(index == pageData->entry_number || compareKeys(treeData->fMD.keyType,key,KEY_AT(treeData,pageData->keys,index)) != 0){
+        return RC_IM_KEY_NOT_FOUND;
+    }
+    if(rid != NULL && (pageData->rids[index].page != rid->page || pageData->rids[index].slot != rid->slot)){
+        return RC_IM_KEY_NOT_FOUND;
+    }
+
+    // closing the gap left by the deleted entry
+    int moved = pageData->entry_number-index-1;
+    memmove(KEY_AT(treeData,pageData->keys,index),KEY_AT(treeData,pageData->keys,index+1),moved*treeData->keySize);
+    memmove(&pageData->rids[index],&pageData->rids[index+1],moved*sizeof(RID));
+    pageData->entry_number -= 1;
+    return RC_OK;
+}
+
+RC setLeftSibling(tree_DS* treeData, int pageNumber, int leftPage){
+    BM_BufferPool *bufferManager = treeData->bufferManager;
+    BM_PageHandle handle;
+    BM_PageHandle *pageHandler = &handle;
+    char pageData[PAGE_SIZE];
+
+    // the caller holds the leaf to the left, so latching its neighbour keeps to the left to right order
+    latchNode(treeData,pageNumber,LATCH_EXCLUSIVE);
+    pinPage(bufferManager,pageHandler,pageNumber);
+    memcpy(pageData,pageHandler->data,PAGE_SIZE);
+    ((node_Header*)pageData)->left_Sibling = leftPage;
+    logPageChange(treeData,pageNumber,pageHandler->data,pageData);
+    memcpy(pageHandler->data,pageData,PAGE_SIZE);
+    markDirty(bufferManager,pageHandler);
+    unpinPage(bufferManager,pageHandler);
+    unlatchNode(treeData,pageNumber);
+
+    return RC_OK;
+}
+
+RC rebalanceNode(tree_DS* treeData, int *path, int *siblings, int level, page_struct_data* node){
+    int maxEntries = treeData->fMD.maxEntriesPerPage;
+    int keySize = treeData->keySize;
+    DataType keyType = treeData->fMD.keyType;
+
+    // the root may run low, it only goes away once an inner root is left with a single child
+    if(level == 0){
+        if(!node->leaf && node->entry_number == 0){
+            __atomic_store_n(&treeData->fMD.rootpage_Number,node->pointer_to_pages[0],__ATOMIC_RELEASE);
+            currentOp.newRoot = node->pointer_to_pages[0];
+            freeNodePage(treeData,node->page_Number);
+            pthread_mutex_lock(&treeData->metaLatch);
+            treeData->fMD.height--;
+            pthread_mutex_unlock(&treeData->metaLatch);
+        }
+        else{
+            writePageData(treeData,node);
+        }
+        return RC_OK;
+    }
+    // a node the descent found safe has no sibling latched, it cannot run underfull by a single entry
+    if(!isUnderfull(treeData,node->leaf,node->keys,node->entry_number) || siblings[level] == -1){
+        writePageData(treeData,node);
+        return RC_OK;
+    }
+
+    page_struct_data parent;
+    readPageData(treeData,&parent,path[level-1]);
+    int index = 0;
+    while(parent.pointer_to_pages[index] != node->page_Number){
+        index++;
+    }
+
+    // the left sibling is preferred, only the first child has to use the one on its right.
+    // The descent latched it already and it stays latched until the delete is committed.
+    int hasLeft = index > 0;
+    int siblingPage = siblings[level];
+    page_struct_data sibling;
+    readPageData(treeData,&sibling,siblingPage);
+
+    // the sibling can spare the entry next to the node if it is not left underfull without it
+    int canSpare = !isUnderfull(treeData,sibling.leaf,hasLeft ? sibling.keys : KEY_AT(treeData,sibling.keys,1),sibling.entry_number-1);
+    if(canSpare && keyType == DT_STRING){
+        // a string key that comes in may shorten the prefix of the node or of the parent, both have to fit afterwards
+        int separator = hasLeft ? index-1 : index;
+        char *incoming = node->leaf ? KEY_AT(treeData,sibling.keys,hasLeft ? sibling.entry_number-1 : 0) : KEY_AT(treeData,parent.keys,separator);
+        char *raised = hasLeft ? KEY_AT(treeData,sibling.keys,sibling.entry_number-1) : KEY_AT(treeData,sibling.keys,node->leaf ? 1 : 0);
+        char oldSeparator[BTREE_KEY_SIZE];
+        canSpare = fitsWithKey(treeData,node->leaf,node->keys,node->entry_number,incoming,hasLeft);
+        memcpy(oldSeparator,KEY_AT(treeData,parent.keys,separator),keySize);
+        memcpy(KEY_AT(treeData,parent.keys,separator),raised,keySize);
+        canSpare = canSpare && fitsInNode(treeData,0,parent.keys,parent.entry_number,PAGE_SIZE);
+        memcpy(KEY_AT(treeData,parent.keys,separator),oldSeparator,keySize);
+    }
+
+    if(canSpare){
+        if(node->leaf){
+            if(hasLeft){
+                memmove(KEY_AT(treeData,node->keys,1),node->keys,(long)node->entry_number*keySize);
+                memmove(&node->rids[1],&node->rids[0],node->entry_number*sizeof(RID));
+                memcpy(node->keys,KEY_AT(treeData,sibling.keys,sibling.entry_number-1),keySize);
+                node->rids[0] = sibling.rids[sibling.entry_number-1];
+                memcpy(KEY_AT(treeData,parent.keys,index-1),node->keys,keySize);
+            }
+            else{
+                memcpy(KEY_AT(treeData,node->keys,node->entry_number),sibling.keys,keySize);
+                node->rids[node->entry_number] = sibling.rids[0];
+                memmove(sibling.keys,KEY_AT(treeData,sibling.keys,1),(long)(sibling.entry_number-1)*keySize);
+                memmove(&sibling.rids[0],&sibling.rids[1],(sibling.entry_number-1)*sizeof(RID));
+                memcpy(KEY_AT(treeData,parent.keys,index),sibling.keys,keySize);
+            }
+        }
+        else{
+            // the separator comes down into the node and the sibling's outer key replaces it
+            if(hasLeft){
+                memmove(KEY_AT(treeData,node->keys,1),node->keys,(long)node->entry_number*keySize);
+                memmove(&node->pointer_to_pages[1],&node->pointer_to_pages[0],(node->entry_number+1)*sizeof(PageNumber));
+                memcpy(node->keys,KEY_AT(treeData,parent.keys,index-1),keySize);
+                node->pointer_to_pages[0] = sibling.pointer_to_pages[sibling.entry_number];
+                memcpy(KEY_AT(treeData,parent.keys,index-1),KEY_AT(treeData,sibling.keys,sibling.entry_number-1),keySize);
+            }
+            else{
+                memcpy(KEY_AT(treeData,node->keys,node->entry_number),KEY_AT(treeData,parent.keys,index),keySize);
+                node->pointer_to_pages[node->entry_number+1] = sibling.pointer_to_pages[0];
+                memcpy(KEY_AT(treeData,parent.keys,index),sibling.keys,keySize);
+                memmove(sibling.keys,KEY_AT(treeData,sibling.keys,1),(long)(sibling.entry_number-1)*keySize);
+                memmove(&sibling.pointer_to_pages[0],&sibling.pointer_to_pages[1],sibling.entry_number*sizeof(PageNumber));
+            }
+        }
+        node->entry_number++;
+        sibling.entry_number--;
+
+        writePageData(treeData,node);
+        writePageData(treeData,&sibling);
+        writePageData(treeData,&parent);
+        freePageData(&sibling);
+        freePageData(&parent);
+        return RC_OK;
+    }
+
+    // neither side can spare an entry, so the right node of the pair is folded into the left one
+    page_struct_data *left = hasLeft ? &sibling : node;
+    page_struct_data *right = hasLeft ? node : &sibling;
+    int separator = hasLeft ? index-1 : index;
+    int merged = left->leaf ? left->entry_number+right->entry_number : left->entry_number+right->entry_number+1;
+
+    // nodes with string keys that do not fit together stay as they are
+    int fits = merged <= maxEntries;
+    if(fits && keyType == DT_STRING){
+        if(left->leaf){
+            memcpy(KEY_AT(treeData,left->keys,left->entry_number),right->keys,(long)right->entry_number*keySize);
+        }
+        else{
+            memcpy(KEY_AT(treeData,left->keys,left->entry_number),KEY_AT(treeData,parent.keys,separator),keySize);
+            memcpy(KEY_AT(treeData,left->keys,left->entry_number+1),right->keys,(long)right->entry_number*keySize);
+        }
+        fits = fitsInNode(treeData,left->leaf,left->keys,merged,PAGE_SIZE);
+    }
+    if(!fits){
+        writePageData(treeData,node);
+        freePageData(&sibling);
+        freePageData(&parent);
+        return RC_OK;
+    }
+
+    if(left->leaf){
+        memcpy(KEY_AT(treeData,left->keys,left->entry_number),right->keys,(long)right->entry_number*keySize);
+        memcpy(&left->rids[left->entry_number],right->rids,right->entry_number*sizeof(RID));
+        left->entry_number += right->entry_number;
+        left->right_Sibling = right->right_Sibling;
+        if(left->right_Sibling != -1){
+            setLeftSibling(treeData,left->right_Sibling,left->page_Number);
+        }
+    }
+    else{
+        memcpy(KEY_AT(treeData,left->keys,left->entry_number),KEY_AT(treeData,parent.keys,separator),keySize);
+        memcpy(KEY_AT(treeData,left->keys,left->entry_number+1),right->keys,(long)right->entry_number*keySize);
+        memcpy(&left->pointer_to_pages[left->entry_number+1],right->pointer_to_pages,(right->entry_number+1)*sizeof(PageNumber));
+        left->entry_number += right->entry_number+1;
+    }
+    writePageData(treeData,left);
+    freeNodePage(treeData,right->page_Number);
+
+    // the separator and the pointer to the folded node leave the parent
+    int moved = parent.entry_number-separator-1;
+    memmove(KEY_AT(treeData,parent.keys,separator),KEY_AT(treeData,parent.keys,separator+1),(long)moved*keySize);
+    memmove(&parent.pointer_to_pages[separator+1],&parent.pointer_to_pages[separator+2],moved*sizeof(PageNumber));
+    parent.entry_number--;
+    freePageData(&sibling);
+
+    RC rc = rebalanceNode(treeData,path,siblings,level-1,&parent);
+    freePageData(&parent);
+    return rc;
+}
+
+//*******************************************Write-ahead log*******************************************
+
+//Opens the log next to the index file, it still holds the records of a crash until they are recovered
+RC openLog(tree_DS* treeData, char *idxId){
+    wal_Log *log = &treeData->log;
+
+    log->fileName = (char*)malloc(strlen(idxId)+5);
+    sprintf(log->fileName,"%s.wal",idxId);
+    log->fd = open(log->fileName,O_RDWR|O_CREAT|O_APPEND,0644);
+    if(log->fd < 0){
+        free(log->fileName);
+        return RC_FILE_NOT_FOUND;
+    }
+
+    log->durability = BT_DURABILITY_OP;
+    log->buffer = NULL;
+    log->spare = NULL;
+    log->bufferSize = 0;
+    log->bufferCapacity = 0;
+    log->spareCapacity = 0;
+    log->appendedLsn = 0;
+    log->writtenLsn = 0;
+    log->durableLsn = 0;
+    log->checkpointLsn = 0;
+    log->pageLsn = NULL;
+    log->pageLsnCapacity = 0;
+    log->lastOp = 0;
+    log->writing = 0;
+    pthread_mutex_init(&log->latch,NULL);
+    pthread_cond_init(&log->written,NULL);
+    pthread_rwlock_init(&log->checkpointLatch,NULL);
+    return RC_OK;
+}
+
+//Removes the log of the given index, if there is one
+RC removeLog(char *idxId){
+    char *logName = (char*)malloc(strlen(idxId)+5);
+    sprintf(logName,"%s.wal",idxId);
+    remove(logName);
+    free(logName);
+    return RC_OK;
+}
+
+//Closes a log that a checkpoint has just emptied, a clean close leaves no log file behind
+RC closeLog(tree_DS* treeData){
+    wal_Log *log = &treeData->log;
+
+    close(log->fd);
+    remove(log->fileName);
+    free(log->fileName);
+    free(log->buffer);
+    free(log->spare);
+    free(log->pageLsn);
+    pthread_mutex_destroy(&log->latch);
+    pthread_cond_destroy(&log->written);
+    pthread_rwlock_destroy(&log->checkpointLatch);
+    return RC_OK;
+}
+
+//Appends a record of the current operation to the log buffer and returns the log sequence number right after it
+long long appendLog(wal_Log* log, int type, int pageNumber, int offset, char* data, int length){
+    long size = sizeof(wal_Record)+length;
+    wal_Record record;
 
-            //Right child data
-            page_struct_data pRChild;
-            pRChild.leaf = 0;
-            pRChild.page_Number = curNumOfNodes;
-            pRChild.entry_number = (int)floor((maxEntity+1)/2);
-            pRChild.keys = keysForNewNode;
-            pRChild.pointer_to_pages = childrenForNewNode;
-            pRChild.parent_Node = newPageToAdd.parent_Node;
+    pthread_mutex_lock(&log->latch);
+    if(currentOp.op == 0){
+        currentOp.op = ++log->lastOp;
+    }
+    record.type = type;
+    record.op = currentOp.op;
+    record.pageNumber = pageNumber;
+    record.offset = offset;
+    record.length = length;
+
+    if(log->bufferSize+size > log->bufferCapacity){
+        log->bufferCapacity = 2*(log->bufferSize+size);
+        log->buffer = (char*)realloc(log->buffer,log->bufferCapacity);
+    }
+    memcpy(log->buffer+log->bufferSize,&record,sizeof(wal_Record));
+    memcpy(log->buffer+log->bufferSize+sizeof(wal_Record),data,length);
+    log->bufferSize += size;
+    log->appendedLsn += size;
+    long long lsn = log->appendedLsn;
+    if(type != WAL_COMMIT){
+        if(pageNumber >= log->pageLsnCapacity){
+            int capacity = 2*(pageNumber+1);
+            log->pageLsn = (long long*)realloc(log->pageLsn,capacity*sizeof(long long));
+            memset(log->pageLsn+log->pageLsnCapacity,0,(capacity-log->pageLsnCapacity)*sizeof(long long));
+            log->pageLsnCapacity = capacity;
+        }
+        log->pageLsn[pageNumber] = lsn;
+    }
+    pthread_mutex_unlock(&log->latch);
 
-            //data update on right child
-            char *dataStr;
-            allocate_Memory(&dataStr);
-            prepareContentWrite(&pRChild,dataStr);
-            writetoBuffer(bufferManager,pageHandler,dataStr,pRChild.page_Number);
-            free_Memory(&dataStr);
+    return lsn;
+}
 
-            //Left child Data
-            page_struct_data pLChild;
-            pLChild.leaf = 0;
-            pLChild.page_Number = newPageToAdd.page_Number;
-            pLChild.entry_number = (int)floor((maxEntity+1)/2);
-            pLChild.keys = oldNodeKeys;
-            pLChild.pointer_to_pages = oldNodeChildren;
-            pLChild.parent_Node = newPageToAdd.parent_Node;
+//Logs a change of a pinned page before it is made. The first change since the last checkpoint logs the
+//whole old page, so an unfinished change can be taken back, every change logs the byte ranges it rewrites.
+RC logPageChange(tree_DS* treeData, int pageNumber, char* oldData, char* newData){
+    wal_Log *log = &treeData->log;
+    if(log->fd < 0){
+        return RC_OK;
+    }
 
-            //Update data on left child
-            allocate_Memory(&dataStr);
-            prepareContentWrite(&pLChild,dataStr);
-            writetoBuffer(bufferManager,pageHandler,dataStr,pLChild.page_Number);
-            free_Memory(&dataStr);
+    // appendLog keeps the page's log sequence number, other pages change at the same time
+    pthread_mutex_lock(&log->latch);
+    int imaged = pageNumber < log->pageLsnCapacity && log->pageLsn[pageNumber] > log->checkpointLsn;
+    pthread_mutex_unlock(&log->latch);
+    if(!imaged){
+        appendLog(log,WAL_BEFORE_IMAGE,pageNumber,0,oldData,PAGE_SIZE);
+    }
 
-            int pgNum = newPageToAdd.parent_Node;
-            float left = pLChild.page_Number;
-            float right = pRChild.page_Number;
+    int offset = 0;
+    while(offset < PAGE_SIZE){
+        while(offset < PAGE_SIZE && memcmp(oldData+offset,newData+offset,WAL_CHANGE_BLOCK) == 0){
+            offset += WAL_CHANGE_BLOCK;
+        }
+        if(offset == PAGE_SIZE){
+            break;
+        }
 
-            data kdata;
-            kdata.key = newPageToAdd.keys[(int)ceil((maxEntity+1)/2)];
-            kdata.left = left;
-            kdata.right = right;
+        // a range ends at the next block in which the pages agree
+        int end = offset+WAL_CHANGE_BLOCK;
+        while(end < PAGE_SIZE && memcmp(oldData+end,newData+end,WAL_CHANGE_BLOCK) != 0){
+            end += WAL_CHANGE_BLOCK;
+        }
+        appendLog(log,WAL_PAGE_CHANGE,pageNumber,offset,newData+offset,end-offset);
+        offset = end;
+    }
+    return RC_OK;
+}
 
-            //update childe of each parent
-            updateParentPointer(treeHandler,pRChild);
+//Hands the log up to lsn to the operating system and, with sync, waits until it is on disk. One thread
+//writes everything buffered so far while the others wait, so commits that arrive together share a write.
+RC forceLog(wal_Log* log, long long lsn, int sync){
+    RC rc = RC_OK;
 
-            //propagate up
-            propagatesplitUp(treeHandler,pgNum,kdata);
+    pthread_mutex_lock(&log->latch);
+    while((sync ? log->durableLsn : log->writtenLsn) < lsn && rc == RC_OK){
+        if(log->writing){
+            pthread_cond_wait(&log->written,&log->latch);
+            continue;
+        }
 
+        // new records go to the spare buffer while this one is written
+        char *data = log->buffer;
+        long size = log->bufferSize, capacity = log->bufferCapacity;
+        long long target = log->appendedLsn;
+        log->buffer = log->spare;
+        log->bufferCapacity = log->spareCapacity;
+        log->bufferSize = 0;
+        log->spare = data;
+        log->spareCapacity = capacity;
+        log->writing = 1;
+        pthread_mutex_unlock(&log->latch);
+
+        long done = 0;
+        while(done < size){
+            ssize_t written = write(log->fd,data+done,size-done);
+            if(written <= 0){
+                break;
+            }
+            done += written;
         }
-        else{
-            char *dataString;
-            allocate_Memory(&dataString);
-            prepareContentWrite(&newPageToAdd,dataString);
-            writetoBuffer(bufferManager,pageHandler,dataString,newPageToAdd.page_Number);
-            free_Memory(&dataString);
-            return RC_OK;   
+        if(done < size || (sync && fdatasync(log->fd) != 0)){
+            rc = RC_WRITE_FAILED;
         }
 
+        pthread_mutex_lock(&log->latch);
+        if(rc == RC_OK){
+            log->writtenLsn = target;
+            if(sync){
+                log->durableLsn = target;
+            }
+        }
+        log->writing = 0;
+        pthread_cond_broadcast(&log->written);
     }
-    else{
-        int curNumOfNodes = ((tree_DS*)treeHandler->mgmtData)->fMD.number_of_pageNodes;
-        ensureCapacity(curNumOfNodes+2,&fileHandler);
+    pthread_mutex_unlock(&log->latch);
 
-        page_struct_data newRoot; // making new node as root
-        newRoot.page_Number = curNumOfNodes+1;
+    return rc;
+}
 
-        int *keysofNewRoot = (int *)malloc(10*sizeof(int));
-        keysofNewRoot[0] = keyData.key;
+//Asked by the buffer pool under its pool latch whether a dirty page may be written back, it only compares
+//the page's last record with the synced end of the log and never syncs itself
+RC logWriteBack(PageNumber pageNumber, void *hookData){
+    wal_Log *log = &((tree_DS*)hookData)->log;
 
-        float *childrenofNewRoot = (float *)malloc(10*sizeof(float));
-        childrenofNewRoot[0] = keyData.left;
-        childrenofNewRoot[1] = keyData.right;
+    pthread_mutex_lock(&log->latch);
+    long long lsn = pageNumber < log->pageLsnCapacity ? log->pageLsn[pageNumber] : 0; // 0 if never logged since the tree was opened
+    int durable = lsn <= log->durableLsn;
+    pthread_mutex_unlock(&log->latch);
+    return durable ? RC_OK : RC_LOG_NOT_FLUSHED;
+}
 
-        newRoot.keys = keysofNewRoot;
-        newRoot.pointer_to_pages= childrenofNewRoot;
-        newRoot.entry_number = 1;
-        newRoot.parent_Node = -1;
-        newRoot.leaf = 0;
+//Called by the buffer pool outside its pool latch when it has to write back a page logWriteBack turned down,
+//the pool only picks such a page when every other frame is in use
+RC logFlushPage(PageNumber pageNumber, void *hookData){
+    wal_Log *log = &((tree_DS*)hookData)->log;
 
-        ((tree_DS*)treeHandler->mgmtData)->fMD.number_of_pageNodes++;
-        ((tree_DS*)treeHandler->mgmtData)->fMD.rootpage_Number = newRoot.page_Number;
+    pthread_mutex_lock(&log->latch);
+    long long lsn = pageNumber < log->pageLsnCapacity ? log->pageLsn[pageNumber] : 0;
+    pthread_mutex_unlock(&log->latch);
+    return forceLog(log,lsn,1);
+}
 
-        char *dataString;
-        allocate_Memory(&dataString);
-        prepareContentWrite(&newRoot,dataString);
-        writetoBuffer(bufferManager,pageHandler,dataString,newRoot.page_Number);
-        free_Memory(&dataString);
+RC beginOp(tree_DS* treeData){
+    pthread_rwlock_rdlock(&treeData->log.checkpointLatch);
+    currentOp.op = 0;
+    currentOp.newRoot = -1;
+    currentOp.freedCount = 0;
+    return RC_OK;
+}
 
-        //updating child nodes of each parent
-        updateParentPointer(treeHandler,newRoot);
+//Appends the commit record of the current operation, it must be in the log before
+//the operation lets go of the pages it changed. Returns 0 if nothing was changed.
+long long commitOp(tree_DS* treeData){
+    long long lsn = 0;
+    if(currentOp.op != 0){
+        lsn = appendLog(&treeData->log,WAL_COMMIT,currentOp.newRoot,0,NULL,0);
     }
-}
 
-RC updateParentPointer(BTreeHandle* tree,page_struct_data dataNode){
+    // merged away pages are handed out again only now, a crash before the commit brings their content back
+    if(currentOp.freedCount > 0){
+        pthread_mutex_lock(&treeData->metaLatch);
+        for(int i = 0; i < currentOp.freedCount; i++){
+            pushFreePage(treeData,currentOp.freedPages[i]);
+        }
+        pthread_mutex_unlock(&treeData->metaLatch);
+    }
 
-    BM_BufferPool *bufferManager = ((tree_DS*)tree->mgmtData)->bufferManager;
-    BM_PageHandle *pageHandler = ((tree_DS*)tree->mgmtData)->pageHandler;
-    
-    // int numChildren = node.entry_number+1;
-    size_t index = 0;
+    // a batch goes on with the next operation
+    currentOp.op = 0;
+    currentOp.newRoot = -1;
+    currentOp.freedCount = 0;
+    return lsn;
+}
 
-    while(index < dataNode.entry_number+1) {
-        page_struct_data child;
-        readPageData(bufferManager,pageHandler,&child,dataNode.pointer_to_pages[index]);
+//Waits for the commit as long as the durability level asks for it, after the latches have been let go
+RC endOp(tree_DS* treeData, long long commitLsn, int isBatch){
+    wal_Log *log = &treeData->log;
+    RC rc = RC_OK;
 
-        //Update the parent
-        child.parent_Node = dataNode.page_Number;
+    pthread_mutex_lock(&log->latch);
+    int durability = log->durability;
+    long buffered = log->bufferSize;
+    long long appended = log->appendedLsn;
+    int checkpoint = log->appendedLsn-log->checkpointLsn > WAL_CHECKPOINT_SIZE;
+    pthread_mutex_unlock(&log->latch);
 
-        char *data;
-        allocate_Memory(&data);
-        prepareContentWrite(&child,data);
-        writetoBuffer(bufferManager,pageHandler,data,child.page_Number);
-        free_Memory(&data);
-        index++;
+    if(commitLsn > 0 && (durability == BT_DURABILITY_OP || (isBatch && durability == BT_DURABILITY_BATCH))){
+        rc = forceLog(log,commitLsn,1);
     }
+    else if(buffered > WAL_BUFFER_LIMIT){
+        rc = forceLog(log,appended,0);
+    }
+    pthread_rwlock_unlock(&log->checkpointLatch);
 
-    return RC_OK;
+    if(checkpoint){
+        checkpointTree(treeData);
+    }
+    return rc;
+}
 
-};
+//Writes every page and the metadata into the index file and empties the log
+RC checkpointTree(tree_DS* treeData){
+    wal_Log *log = &treeData->log;
+    file_Metadata fmd;
+
+    // with no changing operation running, everything in the pool is committed
+    pthread_rwlock_wrlock(&log->checkpointLatch);
+    pthread_mutex_lock(&log->latch);
+    long long appended = log->appendedLsn;
+    pthread_mutex_unlock(&log->latch);
+    RC rc = forceLog(log,appended,1);
+
+    // the free pages go along, a merge only adds to them once it has committed
+    pthread_mutex_lock(&treeData->metaLatch);
+    fmd = treeData->fMD;
+    writeMetaData(treeData->bufferManager,treeData->pageHandler,&fmd,treeData->freePages,treeData->freePageCount,0);
+    pthread_mutex_unlock(&treeData->metaLatch);
+
+    forceFlushPool(treeData->bufferManager);
+    if(rc == RC_OK){
+        rc = syncPageFile(&treeData->fileHandler);
+    }
 
+    // the index file holds all the log did, the next change of a page logs its content again
+    if(rc == RC_OK){
+        pthread_mutex_lock(&log->latch);
+        if(ftruncate(log->fd,0) == 0){
+            log->checkpointLsn = log->appendedLsn;
+        }
+        else{
+            rc = RC_WRITE_FAILED;
+        }
+        pthread_mutex_unlock(&log->latch);
+    }
+    pthread_rwlock_unlock(&log->checkpointLatch);
 
+    return rc;
+}
 
-RC insertKeyPointer(page_struct_data* page_struct_data,data keyData){
-    int *updatedKeys = (int*)malloc(sizeof(int)*10); // Array for new keys
-    float *updatedpointer_to_pages = (float*)malloc(sizeof(int)*10); // Array for new pointer_to_pages
-    int currentPosition = 0;
-    while(keyData.key > page_struct_data->keys[currentPosition] && currentPosition < page_struct_data->entry_number){
-        updatedKeys[currentPosition] = page_struct_data->keys[currentPosition];
-        updatedpointer_to_pages[currentPosition] = page_struct_data->pointer_to_pages[currentPosition];
-        currentPosition++;
+//Applies the log left behind by a crash to the index file before the buffer pool is set up. Every page
+//starts from its content before the first change since the last checkpoint and gets the changes of the
+//committed operations in log order. An operation commits before another writer can reach the pages it
+//changed, so no committed change builds on one that is left out. Returns 1 if the log held records,
+//*newRoot is set if a committed operation moved the root.
+int recoverFromLog(tree_DS* treeData, int *newRoot){
+    wal_Log *log = &treeData->log;
+    *newRoot = -1;
+
+    off_t size = lseek(log->fd,0,SEEK_END);
+    if(size <= 0){
+        return 0;
+    }
+    char *records = (char*)malloc(size);
+    if(pread(log->fd,records,size,0) != size){
+        free(records);
+        return 0;
     }
 
-    if(keyData.key == page_struct_data->keys[currentPosition] && currentPosition < page_struct_data->entry_number){
-        return RC_IM_KEY_ALREADY_EXISTS;
+    // the records end at the first one that is incomplete, a crash may have cut the last write short
+    long end = 0;
+    int maxOp = 0, maxPage = 0;
+    while(end+(long)sizeof(wal_Record) <= size){
+        wal_Record *record = (wal_Record*)(records+end);
+        long length = sizeof(wal_Record)+record->length;
+        if(record->type < WAL_BEFORE_IMAGE || record->type > WAL_COMMIT || record->op <= 0 || record->length < 0
+           || record->offset < 0 || record->offset+record->length > PAGE_SIZE || end+length > size){
+            break;
+        }
+        if(record->op > maxOp){
+            maxOp = record->op;
+        }
+        if(record->type != WAL_COMMIT && record->pageNumber > maxPage){
+            maxPage = record->pageNumber;
+        }
+        end += length;
     }
-    else{
-        updatedKeys[currentPosition] = keyData.key;
-        updatedpointer_to_pages[currentPosition] = keyData.left;
-        updatedpointer_to_pages[currentPosition+1] = keyData.right;
-        currentPosition++;
-        updatedKeys[currentPosition] = page_struct_data->keys[currentPosition-1];
-        currentPosition++;
-        
-    }
-
-    // for (int j = currentPosition; j < page->entry_number + 2; j++) {
-    // updatedKeys[j] = page->keys[j - 1];
-    // updatedpointer_to_pages[j] = page->pointer_to_pages[j - 1];
-    // }
-    while(currentPosition<page_struct_data->entry_number+2){
-        updatedKeys[currentPosition]=page_struct_data->keys[currentPosition-1];
-        updatedpointer_to_pages[currentPosition]=page_struct_data->pointer_to_pages[currentPosition-1];
-        currentPosition++;
-    }
-
-    updatedpointer_to_pages[currentPosition] = -1;
-    free(page_struct_data->keys);
-    free(page_struct_data->pointer_to_pages);
-    page_struct_data->entry_number++;
-    page_struct_data->pointer_to_pages = updatedpointer_to_pages;
-    page_struct_data->keys = updatedKeys;
-   
-    return RC_OK;
-}
 
-RC deletekeyInLeaf(page_struct_data* pageData, int key){
-    int keys[5] = {0},count = 0;
-    float children[5] = {0};
-    bool found = false;
-    for(int i = 0;i < pageData->entry_number;i++){
-        if(key == pageData->keys[i] && i < pageData->entry_number){
-            //i++;
-            found = true;
-            continue;
+    char *committed = (char*)calloc(maxOp+1,1);
+    int committedOps = 0;
+    for(long pos = 0; pos < end; pos += sizeof(wal_Record)+((wal_Record*)(records+pos))->length){
+        wal_Record *record = (wal_Record*)(records+pos);
+        if(record->type == WAL_COMMIT){
+            committed[record->op] = 1;
+            committedOps++;
+            if(record->pageNumber != -1){
+                *newRoot = record->pageNumber;
+            }
         }
-        keys[count] = pageData->keys[i];
-        children[count] = pageData->pointer_to_pages[i];
-        //i++;
-        count++;
     }
-    if(!found){
-        return RC_IM_KEY_NOT_FOUND;
+
+    // a later before image of a page comes from a session that had already recovered it, only the first one counts
+    char **pages = (char**)calloc(maxPage+1,sizeof(char*));
+    ensureCapacity(maxPage+1,&treeData->fileHandler);
+    for(long pos = 0; pos < end; pos += sizeof(wal_Record)+((wal_Record*)(records+pos))->length){
+        wal_Record *record = (wal_Record*)(records+pos);
+        if(record->type == WAL_COMMIT || (record->type == WAL_PAGE_CHANGE && !committed[record->op])){
+            continue;
+        }
+        if(pages[record->pageNumber] == NULL){
+            pages[record->pageNumber] = (char*)malloc(PAGE_SIZE);
+            if(record->type == WAL_PAGE_CHANGE){
+                readBlock(record->pageNumber,&treeData->fileHandler,pages[record->pageNumber]);
+            }
+        }
+        else if(record->type == WAL_BEFORE_IMAGE){
+            continue;
+        }
+        memcpy(pages[record->pageNumber]+record->offset,records+pos+sizeof(wal_Record),record->length);
     }
-    //free(page->keys);
-    //free(page->children);
-    pageData->entry_number -= 1;
-    children[count] = -1;
-    size_t index = 0;
-    while(index < count)
-    {
-        pageData->keys[index] = keys[index];
-        pageData->pointer_to_pages[index] = children[index];
-        index++;
+    for(int page = 0; page <= maxPage; page++){
+        if(pages[page] != NULL){
+            writeBlock(page,&treeData->fileHandler,pages[page]);
+            free(pages[page]);
+        }
     }
-    pageData->pointer_to_pages[count] = children[count];
-    return RC_OK;
+    syncPageFile(&treeData->fileHandler);
+    printf("Recovered %d committed operations from the log.\n", committedOps);
+
+    // the log goes on after the last complete record, until the recovered tree is checkpointed
+    ftruncate(log->fd,end);
+    log->appendedLsn = end;
+    log->writtenLsn = end;
+    log->durableLsn = end;
+    log->lastOp = maxOp;
+
+    free(pages);
+    free(committed);
+    free(records);
+    return end > 0;
 }
 
-RC findLeafPage(page_struct_data page,BM_BufferPool* bufferManager,BM_PageHandle* pageHandler,int* lPages){   
-    
-    if(!page.leaf){
-        size_t childIndex = 0;
-        while(childIndex<page.entry_number+1)
-        {
-            page_struct_data child;
-            readPageData(bufferManager,pageHandler,&child,(int)page.pointer_to_pages[childIndex]);
-            if(findLeafPage(child,bufferManager,pageHandler,lPages) == RC_OK){
-                childIndex++;
-                continue;
+//The counters and the free page list are not logged, they follow from the recovered tree. The leaves are
+//relinked in key order, a neighbour of a split that was taken back may still point at the page it added.
+RC repairTree(tree_DS* treeData){
+    int lastPage = treeData->fileHandler.totalNumPages-1;
+    if(lastPage < treeData->fMD.lastPage_Number){
+        lastPage = treeData->fMD.lastPage_Number;
+    }
+    treeData->fMD.lastPage_Number = lastPage;
+    addNodeLatches(treeData,lastPage);
+
+    char *reachable = (char*)calloc(lastPage+1,1);
+    int *leaves = (int*)malloc((lastPage+1)*sizeof(int));
+    int stackCapacity = 64, top = 0, leafCount = 0, nodes = 0, entries = 0, height = 1;
+    long keyBytes = 0;
+    int *stack = (int*)malloc(stackCapacity*sizeof(int));
+    int *levels = (int*)malloc(stackCapacity*sizeof(int));
+    page_struct_data node;
+
+    // depth first from the root, children are pushed right to left so the leaves come out in key order
+    stack[top] = treeData->fMD.rootpage_Number;
+    levels[top++] = 1;
+    while(top > 0){
+        int pageNumber = stack[--top];
+        int level = levels[top];
+        if(pageNumber < 1 || pageNumber > lastPage || reachable[pageNumber]){
+            continue;
+        }
+        reachable[pageNumber] = 1;
+        nodes++;
+        readPageData(treeData,&node,pageNumber);
+        if(node.leaf){
+            leaves[leafCount++] = pageNumber;
+            entries += node.entry_number;
+            for(int i = 0; i < node.entry_number; i++){
+                keyBytes += keyLength(treeData,KEY_AT(treeData,node.keys,i));
+            }
+            height = level;
+        }
+        else{
+            if(top+node.entry_number+1 > stackCapacity){
+                stackCapacity = 2*(top+node.entry_number+1);
+                stack = (int*)realloc(stack,stackCapacity*sizeof(int));
+                levels = (int*)realloc(levels,stackCapacity*sizeof(int));
+            }
+            for(int i = node.entry_number; i >= 0; i--){
+                stack[top] = node.pointer_to_pages[i];
+                levels[top++] = level+1;
             }
-            childIndex++;
         }
+        freePageData(&node);
     }
-    else{
-        lPages[counter] = page.page_Number;
-        counter += 1;
-        return RC_OK;
+
+    for(int i = 0; i < leafCount; i++){
+        int left = i > 0 ? leaves[i-1] : -1;
+        int right = i < leafCount-1 ? leaves[i+1] : -1;
+        readPageData(treeData,&node,leaves[i]);
+        if(node.left_Sibling != left || node.right_Sibling != right){
+            node.left_Sibling = left;
+            node.right_Sibling = right;
+            writePageData(treeData,&node);
+        }
+        freePageData(&node);
+    }
+
+    // pages of merges and of splits that were taken back are free
+    treeData->freePageCount = 0;
+    for(int pageNumber = 1; pageNumber <= lastPage; pageNumber++){
+        if(!reachable[pageNumber]){
+            pushFreePage(treeData,pageNumber);
+        }
     }
+    treeData->fMD.number_of_pageNodes = nodes;
+    treeData->fMD.entry_Number = entries;
+    treeData->fMD.height = height;
+    treeData->fMD.keyBytes = keyBytes;
+
+    free(stack);
+    free(levels);
+    free(leaves);
+    free(reachable);
     return RC_OK;
 }
 
@@ -855,234 +3480,645 @@ RC findLeafPage(page_struct_data page,BM_BufferPool* bufferManager,BM_PageHandle
 // to find the given key
 RC findKey(BTreeHandle *tree, Value *key, RID *result){
     
-    // loading the main into the buffer
-    SM_FileHandle fileHandler= ((tree_DS*)tree->mgmtData)->fileHandler;
-    BM_PageHandle *pageHander = ((tree_DS*)tree->mgmtData)->pageHandler;
-    BM_BufferPool *buffermanager= ((tree_DS*)tree->mgmtData)->bufferManager;
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    char searchKey[BTREE_KEY_SIZE];
+    if(valueToKey(treeData,key,searchKey) != RC_OK){
+        return RC_IM_KEY_NOT_FOUND; // a key too long to be stored cannot be in the tree
+    }
+    if(treeData->fMD.nonUnique){
+        return findFirstEntry(tree,searchKey,result,NULL);
+    }
+
+    // descending from the root to the leaf that may hold the key, readers only take shared latches,
+    // and searching the leaf in its frame, the leaf stores the RID exactly
+    int leafPage = descendToLeaf(treeData,searchKey,LATCH_SHARED,NULL,NULL);
+    RC rc = findInLeaf(treeData,leafPage,searchKey,result);
+    unlatchNode(treeData,leafPage);
+    return rc;
+}
+
+//The entries of a key may run on into the next leaf, so the first one is found like a prefix scan finds it
+RC findFirstEntry(BTreeHandle *tree, char* key, RID* result, char* storedKey){
+
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    char ceiling[BTREE_KEY_SIZE];
+    keyCeiling(key,ceiling);
+
+    // the entries of the key start in the leaf the key leads to, or in the next one if it ends before them
+    int pageNumber = descendToLeaf(treeData,key,LATCH_SHARED,NULL,NULL);
+    while(1){
+        BM_PageHandle handle;
+        node_View view;
+        RC rc = RC_IM_KEY_NOT_FOUND;
+
+        pinPage(treeData->bufferManager,&handle,pageNumber);
+        viewNodePage(treeData,handle.data,&view);
+        int index = searchPage(treeData,handle.data,0,key,0);
+        int nextPage = index < view.header->entry_number ? -1 : view.header->right_Sibling;
+        if(nextPage == -1 && index < view.header->entry_number && searchPage(treeData,handle.data,index,ceiling,0) > index){
+            *result = view.rids[index];
+            if(storedKey != NULL){
+                copyPageKey(treeData,handle.data,index,storedKey);
+            }
+            rc = RC_OK;
+        }
+        unpinPage(treeData->bufferManager,&handle);
+        unlatchNode(treeData,pageNumber);
+        if(nextPage == -1){
+            return rc;
+        }
+
+        // like a scan, the next leaf is only trusted while it still follows this one
+        latchNode(treeData,nextPage,LATCH_SHARED);
+        pinPage(treeData->bufferManager,&handle,nextPage);
+        int follows = ((node_Header*)handle.data)->leaf == 1 && ((node_Header*)handle.data)->left_Sibling == pageNumber;
+        unpinPage(treeData->bufferManager,&handle);
+        if(!follows){
+            unlatchNode(treeData,nextPage);
+            nextPage = descendToLeaf(treeData,key,LATCH_SHARED,NULL,NULL);
+        }
+        pageNumber = nextPage;
+    }
+}
 
-    page_struct_data rootpage_struct_data;// root page data
+RC insertKey (BTreeHandle *tree, Value *key, RID rid){
+    
+    // getting the tree data
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+
+    char newKey[BTREE_KEY_SIZE];
+    long long commitLsn;
+    RC rc = valueToKey(treeData,key,newKey);
+    if(rc != RC_OK){
+        return rc;
+    }
+    if(treeData->fMD.nonUnique){
+        appendRid(newKey,rid); // only the same key with the same RID is a duplicate
+    }
 
-    // getting the root page number
-    int rootpage_Number=((tree_DS*)tree->mgmtData)->fMD.rootpage_Number;
-    readPageData(buffermanager,pageHander,&rootpage_struct_data,rootpage_Number);
+    beginOp(treeData);
+
+    // most inserts fit into their leaf, so only the leaf is latched exclusively on the first try
+    // and the key goes right into its frame
+    int done;
+    int leafPage = descendToLeaf(treeData,newKey,LATCH_EXCLUSIVE,NULL,NULL);
+    rc = insertIntoLeaf(treeData,leafPage,newKey,rid,&done);
+    if(done){
+        commitLsn = commitOp(treeData);
+        unlatchNode(treeData,leafPage);
+        if(rc != RC_OK){
+            endOp(treeData,commitLsn,0);
+            return rc;
+        }
+    }
+    else{
+        // the leaf may have to split, descend again and keep every node that the split can reach
+        unlatchNode(treeData,leafPage);
+
+        int path[BTREE_MAX_HEIGHT], depth, latched, rootHeld;
+        page_struct_data insertionPage = findLeafPageforInsertion(treeData,newKey,BTREE_OP_INSERT,1,path,&depth,&latched,&rootHeld,NULL,NULL);
+
+        if(newkeyAndPtrToLeaf(treeData,&insertionPage,newKey,rid) == RC_IM_KEY_ALREADY_EXISTS){
+            releaseAncestors(treeData,path,latched,depth,&rootHeld);
+            unlatchNode(treeData,insertionPage.page_Number);
+            freePageData(&insertionPage);
+            endOp(treeData,commitOp(treeData),0);
+            return RC_IM_KEY_ALREADY_EXISTS;
+        }
 
-    page_struct_data leafPageData= findLeafPageforInsertion(buffermanager,pageHander,rootpage_struct_data,key->v.intV);
+        if(!fitsInNode(treeData,1,insertionPage.keys,insertionPage.entry_number,PAGE_SIZE)){ // check if there is no space in the leaf node
+            // the lower half stays in the old leaf, the upper half moves to a new right leaf
+            data *separators;
+            int count;
+            splitNode(treeData,&insertionPage,&separators,&count);
+            propagatesplitUp(tree,path,depth,separators,count); // propagate up
+            free(separators);
+        }
+        else{
+            writePageData(treeData,&insertionPage);
+        }
+        // the split is committed as a whole before any of its pages can be seen by another writer
+        commitLsn = commitOp(treeData);
+        releaseAncestors(treeData,path,latched,depth,&rootHeld);
+        unlatchNode(treeData,insertionPage.page_Number);
+        freePageData(&insertionPage);
+    }
 
-    size_t index=0;
+    pthread_mutex_lock(&treeData->metaLatch);
+    treeData->fMD.entry_Number++; // change the number of entries
+    treeData->fMD.keyBytes += keyLength(treeData,newKey);
+    pthread_mutex_unlock(&treeData->metaLatch);
 
-    while(index<leafPageData.entry_number){
-        if(leafPageData.keys[index] == key->v.intV){ // checking for the key
-            
-            float c=leafPageData.pointer_to_pages[index];
-            int cValue =round(c*10);
-            int page_Number= cValue /10;
-            int slot=cValue%10;
+    // the pages are written back lazily, only the log has to reach the disk
+    return endOp(treeData,commitLsn,0);
+    
+}
 
-            // updating slot and page number if key is found
-            result->slot=slot;
-            result->page=page_Number;
+// insert a batch of keys, keys that land in the same leaf are added in one visit
+RC insertKeys (BTreeHandle *tree, Value *keys, RID *rids, int n){
+
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    long long commitLsn = 0;
+
+    // sorting the batch, a key given twice is only inserted the first time
+    char *batchKeys = (char*)malloc((long)n*treeData->keySize);
+    batch_Entry *entries = (batch_Entry*)malloc(n*sizeof(batch_Entry));
+    for(int i = 0; i < n; i++){
+        entries[i].key = KEY_AT(treeData,batchKeys,i);
+        entries[i].rid = rids[i];
+        RC rc = valueToKey(treeData,&keys[(long)i*treeData->keyAttrs],entries[i].key);
+        if(rc != RC_OK){
+            // nothing of a batch with a key that cannot be stored is inserted
+            free(batchKeys);
+            free(entries);
+            return rc;
+        }
+        if(treeData->fMD.nonUnique){
+            appendRid(entries[i].key,rids[i]);
+        }
+    }
+    sortKeyType = treeData->fMD.keyType;
+    qsort(entries,n,sizeof(batch_Entry),compareBatchEntries);
+    int unique = 0, rejected = 0;
+    for(int i = 0; i < n; i++){
+        if(unique > 0 && compareKeys(treeData->fMD.keyType,entries[unique-1].key,entries[i].key) == 0){
+            rejected++;
+        }
+        else{
+            entries[unique++] = entries[i];
+        }
+    }
 
-            return RC_OK;
+    int inserted = 0, next = 0;
+    long insertedBytes = 0;
+    beginOp(treeData);
+    while(next < unique){
+        char upperKey[BTREE_KEY_SIZE];
+        page_struct_data leaf;
+        long leafBytes = 0;
+
+        // first with the leaf alone latched, every key below the separator right of it belongs to it,
+        // the rightmost leaf takes the rest
+        int leafPage = descendToLeaf(treeData,entries[next].key,LATCH_EXCLUSIVE,NULL,upperKey);
+        readPageData(treeData,&leaf,leafPage);
+        int last = next;
+        while(last < unique && (leaf.right_Sibling == -1 || compareKeys(treeData->fMD.keyType,entries[last].key,upperKey) < 0)){
+            last++;
         }
-        index++;
+        growPageData(treeData,&leaf,leaf.entry_number+last-next);
+        int skipped = mergeIntoLeaf(treeData,&leaf,&entries[next],last-next,&leafBytes);
+        if(fitsInNode(treeData,1,leaf.keys,leaf.entry_number,PAGE_SIZE)){
+            if(skipped < last-next){
+                writePageData(treeData,&leaf);
+            }
+            long long lsn = commitOp(treeData);
+            if(lsn > 0){
+                commitLsn = lsn;
+            }
+            unlatchNode(treeData,leafPage);
+            freePageData(&leaf);
+            rejected += skipped;
+            inserted += last-next-skipped;
+            insertedBytes += leafBytes;
+            next = last;
+            continue;
+        }
+        unlatchNode(treeData,leafPage);
+        freePageData(&leaf);
+
+        // the leaf splits, descend again keeping every node that cannot take the leaf's keys without splitting;
+        // the leaf's range may have changed meanwhile, no more keys than the nodes were checked for are merged
+        int path[BTREE_MAX_HEIGHT], depth, latched, rootHeld;
+        int count = last-next;
+        leaf = findLeafPageforInsertion(treeData,entries[next].key,BTREE_OP_INSERT,count,path,&depth,&latched,&rootHeld,upperKey,NULL);
+        last = next;
+        while(last < unique && last-next < count && (leaf.right_Sibling == -1 || compareKeys(treeData->fMD.keyType,entries[last].key,upperKey) < 0)){
+            last++;
+        }
+        growPageData(treeData,&leaf,leaf.entry_number+last-next);
+        skipped = mergeIntoLeaf(treeData,&leaf,&entries[next],last-next,&insertedBytes);
+        rejected += skipped;
+        inserted += last-next-skipped;
+
+        if(!fitsInNode(treeData,1,leaf.keys,leaf.entry_number,PAGE_SIZE)){
+            // one split of the leaf into as many pieces as it needs, its separators go into the parent together;
+            // a later leaf of the batch under the same parent may split that parent again
+            data *separators;
+            int count;
+            splitNode(treeData,&leaf,&separators,&count);
+            propagatesplitUp(tree,path,depth,separators,count);
+            free(separators);
+        }
+        else if(skipped < last-next){
+            writePageData(treeData,&leaf);
+        }
+        // every leaf of the batch is committed on its own, the log is forced once at the end
+        long long lsn = commitOp(treeData);
+        if(lsn > 0){
+            commitLsn = lsn;
+        }
+        releaseAncestors(treeData,path,latched,depth,&rootHeld);
+        unlatchNode(treeData,leaf.page_Number);
+        freePageData(&leaf);
+        next = last;
     }
+    free(entries);
+    free(batchKeys);
 
-    return RC_IM_KEY_NOT_FOUND;
+    pthread_mutex_lock(&treeData->metaLatch);
+    treeData->fMD.entry_Number += inserted;
+    treeData->fMD.keyBytes += insertedBytes;
+    pthread_mutex_unlock(&treeData->metaLatch);
+
+    RC rc = endOp(treeData,commitLsn,1);
+    if(rc != RC_OK){
+        return rc;
+    }
+    return rejected > 0 ? RC_IM_KEY_ALREADY_EXISTS : RC_OK;
 }
 
-RC insertKey (BTreeHandle *tree, Value *key, RID rid){
-    
-    //printf("\nstart insert key\n");
+//Orders batch entries by key for qsort
+int compareBatchEntries(const void *left, const void *right){
+    return compareKeys(sortKeyType,((const batch_Entry*)left)->key,((const batch_Entry*)right)->key);
+}
 
-    // getting the page handler, buffer manager and file handler
-    BM_PageHandle *pageHandler = ((tree_DS*)tree->mgmtData)->pageHandler;
-    BM_BufferPool *bufferManager = ((tree_DS*)tree->mgmtData)->bufferManager;
-    SM_FileHandle fileHandler = ((tree_DS*)tree->mgmtData)->fileHandler;
+// find a batch of keys, probes share the descent through the inner nodes
+RC findKeys (BTreeHandle *tree, Value *keys, RID *results, RC *rcs, int n){
 
-    int maxEntry = ((tree_DS*)tree->mgmtData)->fMD.maxEntriesPerPage;
-    int curNumOfNode = ((tree_DS*)tree->mgmtData)->fMD.number_of_pageNodes;
-    int rootPgNum = ((tree_DS*)tree->mgmtData)->fMD.rootpage_Number;
-    
-    page_struct_data rootPage; // getting the root page
-    readPageData(bufferManager,pageHandler,&rootPage,rootPgNum);
-    //printf("read pg data");
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    if(n <= 0){
+        return RC_OK;
+    }
+
+    // sorting the probes, neighbouring probes then go down the same path
+    char *probeKeys = (char*)malloc((long)n*treeData->keySize);
+    probe_Entry *probes = (probe_Entry*)malloc(n*sizeof(probe_Entry));
+    int count = 0;
+    for(int i = 0; i < n; i++){
+        probes[count].key = KEY_AT(treeData,probeKeys,i);
+        probes[count].index = i;
+        if(valueToKey(treeData,&keys[(long)i*treeData->keyAttrs],probes[count].key) == RC_OK){
+            count++;
+        }
+        else{
+            rcs[i] = RC_IM_KEY_NOT_FOUND; // too long or of the wrong types to be in the tree
+        }
+    }
+    sortKeyType = treeData->fMD.keyType;
+    qsort(probes,count,sizeof(probe_Entry),compareProbes);
 
-    page_struct_data insertionPage; // getting the page where data can be inserted
-    insertionPage = findLeafPageforInsertion(bufferManager,pageHandler,rootPage,key->v.intV);
+    int rootPage = latchRoot(treeData,LATCH_SHARED);
 
-    //printf("\nlocated page!------------\n");
-    
-    if(newkeyAndPtrToLeaf(&insertionPage,key->v.intV,rid) == RC_IM_KEY_ALREADY_EXISTS){
-        return RC_IM_KEY_ALREADY_EXISTS;
+    int isLeaf;
+    probeSubtree(treeData,rootPage,probes,count,results,rcs,&isLeaf);
+    unlatchNode(treeData,rootPage);
+
+    // the entries of a key that start in the next leaf are looked up on their own
+    for(int i = 0; i < count; i++){
+        if(rcs[probes[i].index] == RC_IM_NO_MORE_ENTRIES){
+            rcs[probes[i].index] = findFirstEntry(tree,probes[i].key,&results[probes[i].index],NULL);
+        }
     }
-    
-    //printf("\nnew key and ptr to leaf!------------\n");
-
-    if(insertionPage.entry_number > maxEntry){ // check if there is no space in the leaf node
-        
-        // creating new nodes
-        int counter = 0;
-        float *newNodechildren = (float *)malloc(10*sizeof(float));
-        int *newNodeKeys = (int *)malloc(10*sizeof(int));
-        
-        for (size_t i = (int)ceil((insertionPage.entry_number)/2)+1; i < insertionPage.entry_number; i++)
-        {
-            newNodechildren[counter] = insertionPage.pointer_to_pages[i];
-            newNodeKeys[counter] = insertionPage.keys[i];
-            counter++;
-        }
-        newNodechildren[counter] = -1;
-
-        
-        counter = 0;
-        int *oldNodeKeys = (int *)malloc(10*sizeof(int));
-        float *oldNodeChildren = (float *)malloc(10*sizeof(float));
-
-        for (size_t i = 0; i <= (int)ceil((insertionPage.entry_number)/2); i++)
-        {
-            oldNodeKeys[counter] = insertionPage.keys[i];
-            oldNodeChildren[counter] = insertionPage.pointer_to_pages[i];
-            counter++;
-        }
-        oldNodeChildren[counter] = -1;
-
-        ensureCapacity (curNumOfNode + 2, &fileHandler);
-
-        curNumOfNode += 1;
-
-        ((tree_DS*)tree->mgmtData)->fMD.number_of_pageNodes++;
-
-        // setting data for right child
-        page_struct_data rightChild;
-        rightChild.page_Number = curNumOfNode;
-        rightChild.leaf = 1;
-        rightChild.pointer_to_pages = newNodechildren;
-        rightChild.entry_number = (int)floor((maxEntry+1)/2);
-        rightChild.keys = newNodeKeys;
-
-        if(insertionPage.parent_Node == -1)rightChild.parent_Node = 3;
-        else rightChild.parent_Node = insertionPage.parent_Node;
-
-        //printf("start update right child");
-        
-        // updating data of right child
-        char *dataHolder;
-        allocate_Memory(&dataHolder);
-        prepareContentWrite(&rightChild,dataHolder);
-        writetoBuffer(bufferManager,pageHandler,dataHolder,rightChild.page_Number);
-        free_Memory(&dataHolder);
-        //printf("updated right child");
-
-
-        // left child data
-        page_struct_data leftChild;
-        leftChild.leaf = 1;
-        leftChild.page_Number = insertionPage.page_Number;
-        leftChild.entry_number = (int)ceil((maxEntry+1)/2)+1;
-        leftChild.keys = oldNodeKeys;
-        leftChild.pointer_to_pages = oldNodeChildren;
-    
-        if(insertionPage.parent_Node == -1) leftChild.parent_Node = 3;
-        else leftChild.parent_Node = insertionPage.parent_Node;
-        
-        //printf("start update left child");
-        
-        // updating left child data
-        allocate_Memory(&dataHolder);
-        prepareContentWrite(&leftChild,dataHolder);
-        writetoBuffer(bufferManager,pageHandler,dataHolder,leftChild.page_Number);
-        free_Memory(&dataHolder);
-        //printf("updated left child");
-
-        int page_Number = insertionPage.parent_Node;
-        float left = leftChild.page_Number, right = rightChild.page_Number;
-
-        data keyData;
-        keyData.left = left;
-        keyData.key = rightChild.keys[0];
-        keyData.right = right;
-
-        //printf("progate start");
-        propagatesplitUp(tree,page_Number,keyData); // propagate up
-        //printf("progate end");
+    free(probes);
+    free(probeKeys);
+
+    // the outcome of each key is in rcs
+    return RC_OK;
+}
+
+RC probeSubtree(tree_DS* treeData, int pageNumber, probe_Entry* probes, int count, RID* results, RC* rcs, int *isLeaf){
+    BM_BufferPool *bufferManager = treeData->bufferManager;
+    BM_PageHandle handle;
+    PageNumber *childPages = (PageNumber*)malloc(count*sizeof(PageNumber));
+    int *groupStart = (int*)malloc((count+1)*sizeof(int));
+    int groups = 0, low = 0;
+
+    // a cached inner node is searched without pinning its page, any other node right in its frame
+    page_struct_data *cached = cachedInnerNode(treeData,pageNumber);
+    if(cached != NULL){
+        *isLeaf = 0;
+        for(int i = 0; i < count; i++){
+            low = searchNode(treeData,cached,probes[i].key,1);
+            if(groups == 0 || childPages[groups-1] != cached->pointer_to_pages[low]){
+                childPages[groups] = cached->pointer_to_pages[low];
+                groupStart[groups++] = i;
+            }
+        }
+        groupStart[groups] = count;
+        return probeChildren(treeData,probes,results,rcs,childPages,groupStart,groups);
     }
-    else{
-        char *dataHolder = malloc(500);
-        //printf("at root--------");
-        allocate_Memory(&dataHolder);
-        prepareContentWrite(&insertionPage,dataHolder);
-        writetoBuffer(bufferManager,pageHandler,dataHolder,insertionPage.page_Number);
-        free_Memory(&dataHolder);
-        //printf("done root");
+
+    pinPage(bufferManager,&handle,pageNumber);
+    node_View view;
+    viewNodePage(treeData,handle.data,&view);
+    node_Header *header = view.header;
+    *isLeaf = header->leaf;
+
+    if(header->leaf){
+        probeLeaf(treeData,handle.data,probes,count,results,rcs);
+        unpinPage(bufferManager,&handle);
+        free(childPages);
+        free(groupStart);
+        return RC_OK;
+    }
+
+    // grouping the probes by the child they go to, child i holds the keys in [keys[i-1], keys[i])
+    PageNumber *pointers = view.children;
+    for(int i = 0; i < count; i++){
+        low = searchPage(treeData,handle.data,low,probes[i].key,1);
+        if(groups == 0 || childPages[groups-1] != pointers[low]){
+            childPages[groups] = pointers[low];
+            groupStart[groups++] = i;
+        }
+    }
+    groupStart[groups] = count;
+    int cache = treeData->innerCache;
+    char pageData[PAGE_SIZE];
+    if(cache){
+        memcpy(pageData,handle.data,PAGE_SIZE);
+    }
+    unpinPage(bufferManager,&handle);
+    if(cache){
+        cacheInnerNode(treeData,pageData,pageNumber);
+    }
+    return probeChildren(treeData,probes,results,rcs,childPages,groupStart,groups);
+}
+
+// Searches the probes of one leaf right in its frame, the probes are sorted
+RC probeLeaf(tree_DS* treeData, char* pageData, probe_Entry* probes, int count, RID* results, RC* rcs){
+    node_View view;
+    viewNodePage(treeData,pageData,&view);
+    node_Header *header = view.header;
+    int entries = header->entry_number;
+    RID *rids = view.rids;
+
+    // the search for each probe starts where the one before stopped
+    int low = 0;
+    for(int i = 0; i < count; i++){
+        low = searchPage(treeData,pageData,low,probes[i].key,0);
+        int found;
+        if(treeData->fMD.nonUnique){
+            // the entry in front of the key's ceiling starts with the key
+            char ceiling[BTREE_KEY_SIZE];
+            keyCeiling(probes[i].key,ceiling);
+            found = low < entries && searchPage(treeData,pageData,low,ceiling,0) > low;
+        }
+        else{
+            found = low < entries && searchPage(treeData,pageData,low,probes[i].key,1) > low;
+        }
+        if(found){
+            results[probes[i].index] = rids[low];
+            rcs[probes[i].index] = RC_OK;
+        }
+        else if(low == entries && header->right_Sibling != -1 && treeData->fMD.nonUnique){
+            rcs[probes[i].index] = RC_IM_NO_MORE_ENTRIES; // findKeys looks further
+        }
+        else{
+            rcs[probes[i].index] = RC_IM_KEY_NOT_FOUND;
+        }
     }
+    return RC_OK;
+}
+
+RC probeChildren(tree_DS* treeData, probe_Entry* probes, RID* results, RC* rcs, PageNumber* childPages, int* groupStart, int groups){
+    BM_BufferPool *bufferManager = treeData->bufferManager;
+
+    // once the first child turns out to be a leaf, the other leaves are latched left to right and pinned
+    // a batch at a time, the buffer manager reads each run of neighbouring leaves that are not in the pool at once.
+    // A batch leaves two frames to the other threads' descents.
+    int childIsLeaf = 0;
+    int batch = bufferManager->numPages - 2 < PIN_BATCH_PAGES ? bufferManager->numPages - 2 : PIN_BATCH_PAGES;
+    int g = 0;
+    while(g < groups){
+        if(g == 0 || !childIsLeaf || batch < 2){
+            latchNode(treeData,childPages[g],LATCH_SHARED);
+            probeSubtree(treeData,childPages[g],&probes[groupStart[g]],groupStart[g+1]-groupStart[g],results,rcs,&childIsLeaf);
+            unlatchNode(treeData,childPages[g]);
+            g++;
+            continue;
+        }
 
-    ((tree_DS*)tree->mgmtData)->fMD.entry_Number++; // change the number of entries
+        int count = groups - g < batch ? groups - g : batch, pinned;
+        BM_PageHandle handles[PIN_BATCH_PAGES];
+        for(int i = 0; i < count; i++){
+            latchNode(treeData,childPages[g+i],LATCH_SHARED);
+        }
+        RC rc = pinPages(bufferManager,handles,&childPages[g],count,&pinned);
+        for(int i = 0; i < pinned && rc == RC_OK; i++){
+            probeLeaf(treeData,handles[i].data,&probes[groupStart[g+i]],groupStart[g+i+1]-groupStart[g+i],results,rcs);
+            unpinPage(bufferManager,&handles[i]);
+        }
+        if(rc != RC_OK){
+            pinned = count; // the probes of leaves that could not be read are not found
+            for(int i = groupStart[g]; i < groupStart[g+count]; i++){
+                rcs[probes[i].index] = RC_IM_KEY_NOT_FOUND;
+            }
+        }
+        for(int i = 0; i < count; i++){
+            unlatchNode(treeData,childPages[g+i]);
+        }
+        g += pinned;
+    }
 
-    forceFlushPool(bufferManager); // flush the buffer
-    //printf("done key insert");
+    free(childPages);
+    free(groupStart);
     return RC_OK;
-    
+}
+
+//Orders probes by key for qsort
+int compareProbes(const void *left, const void *right){
+    return compareKeys(sortKeyType,((const probe_Entry*)left)->key,((const probe_Entry*)right)->key);
 }
 
 // delete key
 RC deleteKey (BTreeHandle *tree, Value *key){
     
-    // getting buffer manager and page handler
-    BM_BufferPool *bufferManager = ((tree_DS*)tree->mgmtData)->bufferManager;
-    BM_PageHandle *pageHandler = ((tree_DS*)tree->mgmtData)->pageHandler;
-    
-    page_struct_data rootPg; // getting the root page
-    int rootPgIndex = ((tree_DS*)tree->mgmtData)->fMD.rootpage_Number;
-    readPageData(bufferManager,pageHandler,&rootPg,rootPgIndex);
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    char oldKey[BTREE_KEY_SIZE];
+    if(valueToKey(treeData,key,oldKey) != RC_OK){
+        return RC_IM_KEY_NOT_FOUND;
+    }
+    if(!treeData->fMD.nonUnique){
+        return deleteStoredKey(treeData,oldKey,NULL);
+    }
 
-    page_struct_data pageData  = findLeafPageforInsertion(bufferManager,pageHandler,rootPg,key->v.intV);
+    // every record of the key goes, one entry per operation
+    char storedKey[BTREE_KEY_SIZE];
+    RID rid;
+    int deleted = 0;
+    while(findFirstEntry(tree,oldKey,&rid,storedKey) == RC_OK){
+        RC rc = deleteStoredKey(treeData,storedKey,NULL);
+        if(rc == RC_OK){
+            deleted++;
+        }
+        else if(rc != RC_IM_KEY_NOT_FOUND){
+            return rc;
+        }
+    }
+    return deleted > 0 ? RC_OK : RC_IM_KEY_NOT_FOUND;
+}
 
-    if(deletekeyInLeaf(&pageData,key->v.intV) == RC_IM_KEY_NOT_FOUND) // deleting the key
-        return RC_IM_KEY_NOT_FOUND; // if key not found
+// delete the entry of one record
+RC deleteEntry (BTreeHandle *tree, Value *key, RID rid){
 
-    char *updatedData;
-    
-    // updating the data
-    allocate_Memory(&updatedData);
-    prepareContentWrite(&pageData,updatedData);
-    writetoBuffer(bufferManager,pageHandler,updatedData,pageData.page_Number);
-    free_Memory(&updatedData);
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    char oldKey[BTREE_KEY_SIZE];
+    if(valueToKey(treeData,key,oldKey) != RC_OK){
+        return RC_IM_KEY_NOT_FOUND;
+    }
+    if(treeData->fMD.nonUnique){
+        appendRid(oldKey,rid);
+        return deleteStoredKey(treeData,oldKey,NULL);
+    }
+    // the key of a unique tree is only deleted while it belongs to the record
+    return deleteStoredKey(treeData,oldKey,&rid);
+}
 
-    return RC_OK;
+RC deleteStoredKey(tree_DS* treeData, char* oldKey, RID* rid){
+
+    long long commitLsn;
+    RC rc;
+
+    beginOp(treeData);
+
+    // a leaf that stays at least half full is changed in its frame under its own latch only
+    int depth, done;
+    int leafPage = descendToLeaf(treeData,oldKey,LATCH_EXCLUSIVE,&depth,NULL);
+    rc = deleteFromLeaf(treeData,leafPage,oldKey,rid,depth == 0,&done); // deleting the key
+    if(done){
+        commitLsn = commitOp(treeData);
+        unlatchNode(treeData,leafPage);
+        if(rc != RC_OK){
+            endOp(treeData,commitLsn,0);
+            return rc; // if key not found
+        }
+    }
+    else{
+        unlatchNode(treeData,leafPage);
+
+        int path[BTREE_MAX_HEIGHT], siblings[BTREE_MAX_HEIGHT+1], latched, rootHeld;
+        page_struct_data pageData = findLeafPageforInsertion(treeData,oldKey,BTREE_OP_DELETE,1,path,&depth,&latched,&rootHeld,NULL,siblings);
+
+        rc = deletekeyInLeaf(treeData,&pageData,oldKey,rid);
+        if(rc == RC_OK){
+            // updating the data, an underfull leaf borrows from or merges with a sibling
+            rebalanceNode(treeData,path,siblings,depth,&pageData);
+        }
+        commitLsn = commitOp(treeData);
+        releaseAncestors(treeData,path,latched,depth,&rootHeld);
+        releaseSiblings(treeData,siblings,latched,depth);
+        unlatchNode(treeData,pageData.page_Number);
+        freePageData(&pageData);
+        if(rc != RC_OK){
+            endOp(treeData,commitLsn,0);
+            return rc; // if key not found
+        }
+    }
+
+    pthread_mutex_lock(&treeData->metaLatch);
+    treeData->fMD.entry_Number--;
+    treeData->fMD.keyBytes -= keyLength(treeData,oldKey);
+    pthread_mutex_unlock(&treeData->metaLatch);
+
+    return endOp(treeData,commitLsn,0);
 }
 
 // open tree scan
 RC openTreeScan (BTreeHandle *tree, BT_ScanHandle **handle){
     
-    BM_PageHandle *pageHandler = ((tree_DS*)tree->mgmtData)->pageHandler;
+    // a full scan is a range scan without bounds, it starts at the leftmost leaf
+    return openTreeRangeScan(tree,NULL,NULL,0,handle);
+}
 
-    BM_BufferPool *bufferManager = ((tree_DS*)tree->mgmtData)->bufferManager;
-    
-    // allocating space for scan handler and scan manager
-    scanMetadata = (scan_tree_data*)malloc(sizeof(scan_tree_data));
-    scanHandle = (BT_ScanHandle*)malloc(sizeof(BT_ScanHandle));
-    
-    int rootPageNum = ((tree_DS*)tree->mgmtData)->fMD.rootpage_Number;
+// open a scan over the keys between lo and hi, a NULL bound leaves that side open.
+// With BT_DESCENDING the scan starts at hi and runs down to lo.
+RC openTreeRangeScan (BTreeHandle *tree, Value *lo, Value *hi, int inclusiveFlags, BT_ScanHandle **handle){
 
-    page_struct_data rootPg;
-    readPageData(bufferManager,pageHandler,&rootPg,rootPageNum);
-    
-   // Allocate memory for storing leaf page numbers
-    int *leafPages = (int *)malloc(100*sizeof(int));
-    counter = 0;
-    findLeafPage(rootPg,bufferManager,pageHandler,leafPages);
-    //printf("\nInside tree scan!\n");
-    scanMetadata->leafPage = leafPages;
-    scanMetadata->cuurent_page = leafPages[0];    
-    page_struct_data leafPage;
-    readPageData(bufferManager,pageHandler,&leafPage,scanMetadata->cuurent_page);
-    scanMetadata->cuurent_pageData = leafPage;
-    scanMetadata->nextPagePosInLeafPages = 1;
-    scanMetadata->curr_page_position = 0;
-    scanMetadata->number_of_leaf_pages = counter;
-    scanMetadata->current_page_is_loaded = 1;
-
-    scanHandle->mgmtData = scanMetadata;
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+
+    scan_tree_data *rangeScan = (scan_tree_data*)malloc(sizeof(scan_tree_data));
+    int descending = (inclusiveFlags & BT_DESCENDING) != 0;
+    Value *start = descending ? hi : lo;
+    Value *end = descending ? lo : hi;
+
+    // the scan starts as if the key just outside its first bound had been handed out, the smallest int or
+    // the empty string lead to the leftmost leaf, the largest int or a longest string of 0xFF to the rightmost
+    int outermost = descending ? INT_MAX : INT_MIN;
+    memset(rangeScan->last_Key,0,BTREE_KEY_SIZE);
+    if(treeData->fMD.keyType != DT_STRING){
+        memcpy(rangeScan->last_Key,&outermost,sizeof(int));
+    }
+    else if(descending){
+        memset(rangeScan->last_Key,0xFF,BT_MAX_KEY_LENGTH);
+    }
+    rangeScan->has_End_Bound = end != NULL;
+    RC rc = start != NULL ? valueToKey(treeData,start,rangeScan->last_Key) : RC_OK;
+    if(rc == RC_OK && end != NULL){
+        rc = valueToKey(treeData,end,rangeScan->end_Key);
+    }
+    if(rc != RC_OK){
+        free(rangeScan);
+        return rc;
+    }
+    rangeScan->skip_Equal = start != NULL && !(inclusiveFlags & (descending ? BT_UPPER_INCLUSIVE : BT_LOWER_INCLUSIVE));
+    rangeScan->end_Inclusive = (inclusiveFlags & (descending ? BT_LOWER_INCLUSIVE : BT_UPPER_INCLUSIVE)) != 0;
+    rangeScan->end_Prefix = 0;
+    rangeScan->descending = descending;
+
+    // entries of a non-unique tree lie above their key and below its ceiling. Going up, an exclusive lower bound
+    // starts at the ceiling and an inclusive upper bound ends in front of it, going down an inclusive upper bound
+    // starts below the ceiling and an exclusive lower bound ends at it
+    if(treeData->fMD.nonUnique){
+        if(start != NULL && rangeScan->skip_Equal != descending){
+            keyCeiling(rangeScan->last_Key,rangeScan->last_Key);
+            rangeScan->skip_Equal = descending;
+        }
+        if(end != NULL && rangeScan->end_Inclusive != descending){
+            keyCeiling(rangeScan->end_Key,rangeScan->end_Key);
+            rangeScan->end_Inclusive = descending;
+        }
+    }
+
+    return beginTreeScan(tree,rangeScan,handle);
+}
+
+// open a scan over the keys that start with the given attributes
+RC openTreePrefixScan (BTreeHandle *tree, Value *prefix, int prefixAttrs, BT_ScanHandle **handle){
+
+    tree_DS *treeData = (tree_DS*)tree->mgmtData;
+    if(prefixAttrs < 1 || prefixAttrs > treeData->keyAttrs){
+        return RC_ERROR;
+    }
+    // a key of a single int or string is its only attribute
+    if(!treeData->normalizedKeys){
+        return openTreeRangeScan(tree,prefix,prefix,BT_LOWER_INCLUSIVE | BT_UPPER_INCLUSIVE,handle);
+    }
+
+    // the encoded attributes are the smallest key that starts with them, the scan ends at the first key that does not
+    scan_tree_data *prefixScan = (scan_tree_data*)malloc(sizeof(scan_tree_data));
+    RC rc = encodeKey(treeData,prefix,prefixAttrs,prefixScan->last_Key);
+    if(rc != RC_OK){
+        free(prefixScan);
+        return rc;
+    }
+    strcpy(prefixScan->end_Key,prefixScan->last_Key);
+    prefixScan->has_End_Bound = 1;
+    prefixScan->end_Inclusive = 1;
+    prefixScan->end_Prefix = 1;
+    prefixScan->skip_Equal = 0;
+    prefixScan->descending = 0;
+
+    return beginTreeScan(tree,prefixScan,handle);
+}
+
+//Hands out a scan once its bounds are set
+RC beginTreeScan(BTreeHandle *tree, scan_tree_data* scan, BT_ScanHandle **handle){
+
+    // one descent to the leaf that holds the lower bound
+    loadScanLeaf((tree_DS*)tree->mgmtData,scan,-1);
+
+    BT_ScanHandle *scanHandle = (BT_ScanHandle*)malloc(sizeof(BT_ScanHandle));
+    scanHandle->mgmtData = scan;
     scanHandle->tree = tree;
     *handle = scanHandle;
 
@@ -1091,50 +4127,97 @@ RC openTreeScan (BTreeHandle *tree, BT_ScanHandle **handle){
 
 //next entry
 RC nextEntry (BT_ScanHandle *handle, RID *result){
-    
-    BM_BufferPool *bufferManager = ((tree_DS*)handle->tree->mgmtData)->bufferManager;
-    BM_PageHandle *pageHandler = ((tree_DS*)handle->tree->mgmtData)->pageHandler; 
+    return nextEntryWithKey(handle,NULL,result);
+}
+
+//next entry together with its key, which comes from the scan's copy of the leaf. With a NULL key only the RID is handed out.
+RC nextEntryWithKey (BT_ScanHandle *handle, Value *key, RID *result){
+
+    tree_DS *treeData = (tree_DS*)handle->tree->mgmtData;
     scan_tree_data* scan_tree_data = handle->mgmtData;
 
-    if(scan_tree_data->curr_page_position >= scan_tree_data->cuurent_pageData.entry_number){ // Check if the current position is beyond the number of entries on the current page
+    int descending = scan_tree_data->descending;
+
+    // moving on once the current leaf is used up, leaves emptied by deletes are skipped
+    while(descending ? scan_tree_data->curr_page_position <= 0
+                     : scan_tree_data->curr_page_position >= scan_tree_data->cuurent_pageData.entry_number){
+        int nextPage = descending ? scan_tree_data->cuurent_pageData.left_Sibling : scan_tree_data->cuurent_pageData.right_Sibling;
+
         // Check if there are no leaf pages to scan
-        if(scan_tree_data->nextPagePosInLeafPages == -1 ){
+        if(nextPage == -1){
             return RC_IM_NO_MORE_ENTRIES;
         }
-        // Move to the next leaf page
-        scan_tree_data->cuurent_page = scan_tree_data->leafPage[scan_tree_data->nextPagePosInLeafPages];
-        scan_tree_data->current_page_is_loaded = 0;
-        scan_tree_data->nextPagePosInLeafPages += 1;
 
-        if(scan_tree_data->nextPagePosInLeafPages >= scan_tree_data->number_of_leaf_pages){
-            scan_tree_data->nextPagePosInLeafPages = -1;
-        }
+        // Move to the next leaf page
+        freePageData(&scan_tree_data->cuurent_pageData);
+        loadScanLeaf(treeData,scan_tree_data,nextPage);
     }
 
-    if(!scan_tree_data->current_page_is_loaded){
-        page_struct_data leafPg;
-        readPageData(bufferManager,pageHandler,&leafPg,scan_tree_data->cuurent_page);
-        scan_tree_data->cuurent_pageData = leafPg;
-        scan_tree_data->curr_page_position = 0;
-        scan_tree_data->current_page_is_loaded = 1;   
+    // a range scan stops at the first key past its end bound
+    int position = descending ? scan_tree_data->curr_page_position-1 : scan_tree_data->curr_page_position;
+    char *entryKey = KEY_AT(treeData,scan_tree_data->cuurent_pageData.keys,position);
+    if(scan_tree_data->has_End_Bound){
+        int order = scan_tree_data->end_Prefix ? strncmp(entryKey,scan_tree_data->end_Key,strlen(scan_tree_data->end_Key))
+                                               : compareKeys(treeData->fMD.keyType,entryKey,scan_tree_data->end_Key);
+        if(descending){
+            order = -order;
+        }
+        if(order > 0 || (order == 0 && !scan_tree_data->end_Inclusive)){
+            return RC_IM_NO_MORE_ENTRIES;
+        }
     }
 
     // updating slot and page
-    float c = scan_tree_data->cuurent_pageData.pointer_to_pages[scan_tree_data->curr_page_position];
-    int cValue = round(c*10);
-    result->slot =  cValue % 10;
-    result->page =  cValue / 10; 
-    scan_tree_data->curr_page_position += 1;
+    *result = scan_tree_data->cuurent_pageData.rids[position];
+    if(key != NULL){
+        keyToValues(treeData,entryKey,key,scan_tree_data->key_Strings);
+    }
+    memcpy(scan_tree_data->last_Key,entryKey,treeData->keySize);
+    scan_tree_data->skip_Equal = 1;
+    scan_tree_data->curr_page_position += descending ? -1 : 1;
     
     return RC_OK;
 }
 
+//Copies the leaf after the current one in the scan's direction, or descends to the leaf of the last key when
+//pageNumber is -1. The scan holds no latch between calls, so a sibling link may be stale by the time it is followed.
+RC loadScanLeaf(tree_DS* treeData, scan_tree_data* scan, int pageNumber){
+    page_struct_data *leaf = &scan->cuurent_pageData;
+
+    if(pageNumber != -1){
+        latchNode(treeData,pageNumber,LATCH_SHARED);
+        readPageData(treeData,leaf,pageNumber);
+        unlatchNode(treeData,pageNumber);
+
+        // the page was merged away or reused, or a split put a new leaf in between
+        int backLink = scan->descending ? leaf->right_Sibling : leaf->left_Sibling;
+        if(leaf->leaf != 1 || backLink != scan->cuurent_page){
+            freePageData(leaf);
+            pageNumber = -1;
+        }
+    }
+    if(pageNumber == -1){
+        *leaf = findLeafPage(treeData,scan->last_Key,LATCH_SHARED,NULL);
+        unlatchNode(treeData,leaf->page_Number);
+    }
+    scan->cuurent_page = leaf->page_Number;
+
+    // skipping the keys in front of the starting bound or already handed out, going down those from the
+    // position on, so the entries in front of it are the ones left
+    int upper = scan->descending ? !scan->skip_Equal : scan->skip_Equal;
+    scan->curr_page_position = searchNode(treeData,leaf,scan->last_Key,upper);
+
+    return RC_OK;
+}
+
 // close tree scan
 RC closeTreeScan (BT_ScanHandle *handle){
+    scan_tree_data* scan_tree_data = handle->mgmtData;
+    freePageData(&scan_tree_data->cuurent_pageData);
     free(handle->mgmtData);
     free(handle);
     handle = NULL;
     return RC_OK;
 }
 
-//**************************************************************************************************
\ No newline at end of file
+//**************************************************************************************************
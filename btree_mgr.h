@@ -16,30 +16,151 @@ typedef struct BT_ScanHandle {
   void *mgmtData;
 } BT_ScanHandle;
 
+// source of (key, RID) pairs in ascending key order for bulk loading,
+// next returns RC_IM_NO_MORE_ENTRIES once all pairs have been delivered
+typedef struct BT_BulkIterator {
+  RC (*next) (struct BT_BulkIterator *iterator, Value *key, RID *rid);
+  void *mgmtData;
+} BT_BulkIterator;
+
+// most levels that getTreeStats reports on
+#define BT_MAX_LEVELS 32
+
+// statistics of a tree, level 0 is the root. getTreeCounters fills the first group only.
+typedef struct BT_Stats {
+  int height;                   // levels, 1 for a tree that is a single leaf
+  int nodes;
+  int entries;
+  int freePages;                // pages merged away that new nodes are taken from first
+  long keyBytes;                // length of all keys in the leaves, as if each was stored whole
+  int cachedNodes;              // the inner node cache, see getInnerNodeCacheSize
+  long cacheBytes;
+
+  int pages[BT_MAX_LEVELS];     // pages of each level
+  float avgFill[BT_MAX_LEVELS]; // share of a page in use, by entries or, for string keys, by bytes
+  float minFill[BT_MAX_LEVELS];
+  float maxFill[BT_MAX_LEVELS];
+  long storedKeyBytes;          // bytes the keys of every node take in their pages, a shared prefix counted once
+  int separators;               // keys of the inner nodes
+  float avgSeparatorLength;
+} BT_Stats;
+
+// inclusiveFlags of a range scan
+#define BT_LOWER_INCLUSIVE 1
+#define BT_UPPER_INCLUSIVE 2
+#define BT_DESCENDING 4 // the scan starts at the upper bound, or the largest key, and runs down
+
+// longest DT_STRING key, longer keys are rejected with RC_IM_KEY_TOO_LONG
+#define BT_MAX_KEY_LENGTH 255
+
+// layout of the keys in the inner nodes of a tree of int keys
+#define BT_LAYOUT_SORTED 0  // one sorted array, the default
+#define BT_LAYOUT_BLOCKED 1 // the sorted array plus the first key of each of its cache lines, a search reads two or three lines
+
+// frames of the buffer pool openBtree gives a tree
+#define BT_DEFAULT_POOL_PAGES 10
+
+// most attributes of a composite key, its encoded form is limited to BT_MAX_KEY_LENGTH bytes as well
+#define BT_MAX_KEY_ATTRS 8
+
+// how soon a change is on disk, every change goes to the write-ahead log first
+#define BT_DURABILITY_OP 0    // before the call that made it returns, the default
+#define BT_DURABILITY_BATCH 1 // at the end of insertKeys and on flushBtree
+#define BT_DURABILITY_ASYNC 2 // once the log buffer fills, on flushBtree and on closeBtree
+
 // init and shutdown index manager
 extern RC initIndexManager (void *mgmtData);
 extern RC shutdownIndexManager ();
 
 // create, destroy, open, and close an btree index
+// n is the maximum number of keys per node, n <= 0 fits as many keys as a page can hold.
+// DT_INT and DT_STRING keys are supported, string keys are also limited by the bytes of a page.
+// DT_FLOAT and DT_BOOL keys are stored like composite keys of one attribute.
 extern RC createBtree (char *idxId, DataType keyType, int n);
+// keys made of keyAttrs attributes of the given types, compared attribute by attribute. Such a tree takes
+// every key as keyAttrs consecutive Values, and an array of keys as keyAttrs Values per key.
+extern RC createCompositeBtree (char *idxId, int keyAttrs, DataType *keyTypes, int n);
+// like createCompositeBtree, but a key may belong to several records. Every (key, RID) pair is an entry of
+// its own, the entries of a key are kept in the order of their RIDs' pages and its encoded form is limited
+// to BT_MAX_KEY_LENGTH-10 bytes.
+extern RC createNonUniqueBtree (char *idxId, int keyAttrs, DataType *keyTypes, int n);
+// like createBtree with one of the BT_LAYOUT values, BT_LAYOUT_BLOCKED is only for DT_INT keys
+extern RC createBtreeWithLayout (char *idxId, DataType keyType, int n, int layout);
+// fillFactor is the fraction of each node filled, nodes get as many keys as fit into a page
+extern RC bulkLoadBtree (char *idxId, DataType keyType, BT_BulkIterator *iterator, float fillFactor);
+// the iterator fills keyAttrs Values per key
+extern RC bulkLoadCompositeBtree (char *idxId, int keyAttrs, DataType *keyTypes, BT_BulkIterator *iterator, float fillFactor);
+// the iterator delivers the records of a key in RID order
+extern RC bulkLoadNonUniqueBtree (char *idxId, int keyAttrs, DataType *keyTypes, BT_BulkIterator *iterator, float fillFactor);
+extern RC bulkLoadBtreeWithLayout (char *idxId, DataType keyType, BT_BulkIterator *iterator, float fillFactor, int layout);
 extern RC openBtree (BTreeHandle **tree, char *idxId);
+// like openBtree with a buffer pool of poolPages frames, poolPages <= 0 gives BT_DEFAULT_POOL_PAGES
+extern RC openBtreeWithPoolSize (BTreeHandle **tree, char *idxId, int poolPages);
 extern RC closeBtree (BTreeHandle *tree);
 extern RC deleteBtree (char *idxId);
+// pick one of the BT_DURABILITY levels for the changes that follow
+extern RC setDurability (BTreeHandle *tree, int level);
+// make every change made so far durable
+extern RC flushBtree (BTreeHandle *tree);
+// keep the inner nodes decoded in memory, so a lookup pins only its leaf, off by default.
+// Turn it on or off while no other thread uses the tree.
+extern RC setInnerNodeCache (BTreeHandle *tree, int enabled);
+// number of cached inner nodes and the bytes of memory the cache takes
+extern RC getInnerNodeCacheSize (BTreeHandle *tree, int *nodes, long *bytes);
 
 // access information about a b-tree
 extern RC getNumNodes (BTreeHandle *tree, int *result);
+// pages of the index file that new nodes are taken from before it grows, kept across closeBtree
+extern RC getNumFreePages (BTreeHandle *tree, int *result);
 extern RC getNumEntries (BTreeHandle *tree, int *result);
+// statistics of the whole tree from one pass over its pages, call it while no other thread changes the tree
+extern RC getTreeStats (BTreeHandle *tree, BT_Stats *stats);
+// only the statistics that every change keeps up to date, no page is read
+extern RC getTreeCounters (BTreeHandle *tree, BT_Stats *stats);
+// the type of the first attribute for a composite key
 extern RC getKeyType (BTreeHandle *tree, DataType *result);
+// keyTypes needs room for BT_MAX_KEY_ATTRS types
+extern RC getKeyAttrs (BTreeHandle *tree, int *keyAttrs, DataType *keyTypes);
 
-// index access
+// index access, on a non-unique tree findKey returns the first RID of the key and a scan
+// from the key to itself returns all of them
 extern RC findKey (BTreeHandle *tree, Value *key, RID *result);
+// look up n keys at once, rcs[i] tells whether keys[i] was found and results[i] then holds its RID
+extern RC findKeys (BTreeHandle *tree, Value *keys, RID *results, RC *rcs, int n);
 extern RC insertKey (BTreeHandle *tree, Value *key, RID rid);
+// insert n keys at once, each leaf is visited once per batch and the log is forced once,
+// keys already in the tree or repeated in the batch, on a non-unique tree the same key with the same RID,
+// are skipped with RC_IM_KEY_ALREADY_EXISTS
+extern RC insertKeys (BTreeHandle *tree, Value *keys, RID *rids, int n);
+// deletes the key with every record it belongs to
 extern RC deleteKey (BTreeHandle *tree, Value *key);
+// deletes the key of one record only
+extern RC deleteEntry (BTreeHandle *tree, Value *key, RID rid);
 extern RC openTreeScan (BTreeHandle *tree, BT_ScanHandle **handle);
+// scan the keys between lo and hi in order, a NULL bound leaves that side open,
+// with BT_DESCENDING among the flags from hi down to lo
+extern RC openTreeRangeScan (BTreeHandle *tree, Value *lo, Value *hi, int inclusiveFlags, BT_ScanHandle **handle);
+// scan the keys whose first prefixAttrs attributes equal the given ones, in order
+extern RC openTreePrefixScan (BTreeHandle *tree, Value *prefix, int prefixAttrs, BT_ScanHandle **handle);
 extern RC nextEntry (BT_ScanHandle *handle, RID *result);
+// the next entry with its key, key has room for every attribute of it. A string of the key
+// is kept by the scan and stays valid until the next call or closeTreeScan
+extern RC nextEntryWithKey (BT_ScanHandle *handle, Value *key, RID *result);
 extern RC closeTreeScan (BT_ScanHandle *handle);
 
 // debug and test functions
 extern char *printTree (BTreeHandle *tree);
+// the in-node search of int keys: the position of the first of count sorted keys not smaller than key,
+// or with upper larger than it. BT_SEARCH_SIMD is the vector search picked for the processor at runtime,
+// getIntSearchName tells which one.
+#define BT_SEARCH_LINEAR 0
+#define BT_SEARCH_BINARY 1
+#define BT_SEARCH_SIMD 2
+extern int searchIntKeys (int *keys, int count, int key, int upper, int method);
+extern const char *getIntSearchName (void);
+// an inner node of count sorted int keys laid out in one of the BT_LAYOUT values, in a page buffer that starts
+// on a cache line like a frame does, and the search a descent runs on such a node in its frame
+extern RC formatIntNode (char *pageData, int *keys, int count, int layout);
+extern int searchIntNode (char *pageData, int key, int upper, int layout);
 
 #endif // BTREE_MGR_H
@@ -1,27 +1,49 @@
 #include<stdio.h>
 #include<stdlib.h>
+#include<pthread.h>
 #include "buffer_mgr.h"
 #include "storage_mgr.h"
 
+// page data starts on a cache line, so the lines of a page are the processor's
+#define FRAME_ALIGNMENT 64
+
 typedef struct PgFrame // Data of a frame
 {
     PageNumber pgNumber; // page number
     SM_PageHandle pageData; // page Handler
     bool isDirty; // flag for dirty
-    int pageCounter; // page in use, count of fixed pages in buffer
+    int pageCounter; // page in use, count of fixed pages in buffer, changed with atomics
     int leastrecentlyUsedPage; // least recently used page number for LRU
     int leastFrequentlyUsedPage; // least frequently used page number fir LFU
+    bool ioBusy; // the old page is being written back or the new one read in
+    PageNumber writingPage; // the page being written back out of the frame, NO_PAGE if none
+    bool ioFailed; // the frame's last I/O failed, the pins that waited on it give up their pin and fail too
+    pthread_mutex_t ioLatch; // held by the pin that does the frame's I/O, the others wait on it
+    int nextInBucket; // next frame of the same page table bucket, -1 at the end
 
 } PgFrame;
 
-int bufferSize=0; // global buffer size
-int diskWritten=0; // number times the disk is written
-int diskRead=0; // number of pages read from disk
-int lastPageInClock=0; // last page used in clock
-int lastPageInLFU=0; // last page used in LFU
-int cache=0; // to track cache hits
-
-SM_FileHandle fh; // global file handler
+typedef struct PoolData // bookkeeping of a buffer pool
+{
+    PgFrame *frames;
+    // guards the frames' pages, their I/O flags and the counters, it is never held across a read or a write,
+    // a pin or unpin of a page that is in the pool does not take it
+    pthread_mutex_t poolLatch;
+    pthread_cond_t frameFreed; // a pin count dropped to 0, for pins that found every frame in use
+    int frameWaiters; // pins waiting on frameFreed, an unpin takes the pool latch to wake them only if there are any
+    int diskWritten; // number times the disk is written
+    int diskRead; // number of pages read from disk
+    int lastPageInClock; // last page used in clock
+    int lastPageInLFU; // last page used in LFU
+    int cache; // to track cache hits
+    bool writableOnly; // the strategies skip frames that would wait for a log
+    int *buckets; // page table: first frame of each bucket by page number, -1 for none
+    int bucketMask; // buckets - 1, the number of buckets is a power of two
+    // one latch per bucket, guards the bucket's chain and the pins and dirty flags of the frames on it,
+    // a frame changes its page only under the pool latch and the latches of both buckets
+    pthread_mutex_t *bucketLatches;
+
+} PoolData;
 
 /*=================================================================buffer pool functions=======================================================================*/
 
@@ -35,72 +57,191 @@ extern RC initBufferPool(BM_BufferPool *const bm,
     bm->pageFile=(char *) pageFileName;
     bm->strategy=strategy;
 
+    PoolData *pool=malloc(sizeof(PoolData));
     PgFrame *pageFrames=malloc(sizeof(PgFrame)*numPages); // creating the memory frames
-    bufferSize=numPages; // initalizing the buffer size
 
     int index=0;
 
-    while(index < bufferSize ){ // for each frame setting the default value
+    while(index < numPages ){ // for each frame setting the default value
         pageFrames[index].pageCounter=0;
         pageFrames[index].isDirty=FALSE;
         pageFrames[index].leastrecentlyUsedPage=0;
         pageFrames[index].leastFrequentlyUsedPage=0;
-        pageFrames[index].pageData=NULL;
-        pageFrames[index].pgNumber=-1;
+        pageFrames[index].pageData=(SM_PageHandle) aligned_alloc(FRAME_ALIGNMENT, PAGE_SIZE); // a frame keeps its memory for the life of the pool
+        pageFrames[index].pgNumber=NO_PAGE;
+        pageFrames[index].ioBusy=FALSE;
+        pageFrames[index].writingPage=NO_PAGE;
+        pageFrames[index].ioFailed=FALSE;
+        pthread_mutex_init(&pageFrames[index].ioLatch,NULL);
+        pageFrames[index].nextInBucket=-1;
         index++;
     }
 
-    bm->mgmtData= pageFrames; // setting the frames to management data
+    // at least one bucket per frame, so a lookup of a page walks a chain of one or two frames
+    int bucketCount=1;
+    while(bucketCount < numPages) bucketCount*=2;
+    pool->buckets=(int*) malloc(sizeof(int)*bucketCount);
+    pool->bucketLatches=(pthread_mutex_t*) malloc(sizeof(pthread_mutex_t)*bucketCount);
+    for(index=0; index<bucketCount; index++){
+        pool->buckets[index]=-1;
+        pthread_mutex_init(&pool->bucketLatches[index],NULL);
+    }
+    pool->bucketMask=bucketCount-1;
+
+    pool->frames=pageFrames;
+    pthread_mutex_init(&pool->poolLatch,NULL);
+    pthread_cond_init(&pool->frameFreed,NULL);
+    pool->frameWaiters = 0;
 
     // counters for replacement algorithms
-    diskWritten = 0;
-    lastPageInClock = 0;
-    lastPageInLFU = 0;
+    pool->diskWritten = 0;
+    pool->diskRead = 0;
+    pool->lastPageInClock = 0;
+    pool->lastPageInLFU = 0;
+    pool->cache = 0;
+    pool->writableOnly = FALSE;
+
+    bm->mgmtData= pool; // setting the pool to management data
+    bm->writeBackHook=NULL; // no one to ask before write-backs yet
+    bm->logFlushHook=NULL;
+    bm->hookData=NULL;
     
     return RC_OK;
 
 }
 
+// writes a page out of a frame the caller keeps pinned, outside the pool latch
+static RC writeFrame(BM_BufferPool *const bm, SM_FileHandle *fh, PageNumber pageNum, SM_PageHandle data){
+    RC rc=RC_OK;
+    // a page whose log is not on disk yet waits here for it, no other pin waits along
+    if(bm->writeBackHook!=NULL && bm->writeBackHook(pageNum,bm->hookData)!=RC_OK && bm->logFlushHook!=NULL)
+        rc=bm->logFlushHook(pageNum,bm->hookData);
+    if(rc==RC_OK) rc=writeBlock(pageNum,fh,data);
+    return rc;
+}
+
+// the latch of the bucket a page is in
+static pthread_mutex_t *bucketLatch(PoolData *pool, PageNumber pageNum){
+    return &pool->bucketLatches[pageNum & pool->bucketMask];
+}
+
+// latches the buckets of two pages, the lower bucket first, NO_PAGE is in none
+static void lockBuckets(PoolData *pool, PageNumber first, PageNumber second){
+    int a = first == NO_PAGE ? -1 : (first & pool->bucketMask);
+    int b = second == NO_PAGE ? -1 : (second & pool->bucketMask);
+    if(a >= 0 && b >= 0 && a != b) pthread_mutex_lock(&pool->bucketLatches[a < b ? a : b]);
+    if(a >= 0 || b >= 0) pthread_mutex_lock(&pool->bucketLatches[a > b ? a : b]);
+}
+
+static void unlockBuckets(PoolData *pool, PageNumber first, PageNumber second){
+    int a = first == NO_PAGE ? -1 : (first & pool->bucketMask);
+    int b = second == NO_PAGE ? -1 : (second & pool->bucketMask);
+    if(a >= 0 || b >= 0) pthread_mutex_unlock(&pool->bucketLatches[a > b ? a : b]);
+    if(a >= 0 && b >= 0 && a != b) pthread_mutex_unlock(&pool->bucketLatches[a < b ? a : b]);
+}
+
+// whether a frame can be written back without waiting for a log, asked with the pool latch held
+static bool frameWritable(BM_BufferPool *const bm, PoolData *pool, PgFrame *frame){
+    if(frame->pgNumber==NO_PAGE || bm->writeBackHook==NULL) return TRUE;
+    pthread_mutex_lock(bucketLatch(pool,frame->pgNumber));
+    bool dirty = frame->isDirty==TRUE;
+    pthread_mutex_unlock(bucketLatch(pool,frame->pgNumber));
+    return !dirty || bm->writeBackHook(frame->pgNumber,bm->hookData)==RC_OK;
+}
+
+// drops a pin with the pool latch held
+static void dropPin(PoolData *pool, int i){
+    if(__atomic_sub_fetch(&pool->frames[i].pageCounter,1,__ATOMIC_SEQ_CST) == 0) pthread_cond_broadcast(&pool->frameFreed);
+}
+
+// drops a pin without the pool latch, it is taken only when a pin waits for a frame
+static void releasePin(PoolData *pool, int i){
+    if(__atomic_sub_fetch(&pool->frames[i].pageCounter,1,__ATOMIC_SEQ_CST) == 0
+        && __atomic_load_n(&pool->frameWaiters,__ATOMIC_SEQ_CST) > 0){
+        pthread_mutex_lock(&pool->poolLatch);
+        pthread_cond_broadcast(&pool->frameFreed);
+        pthread_mutex_unlock(&pool->poolLatch);
+    }
+}
+
 // to flush out all the pages from the buffer pool
 extern RC forceFlushPool(BM_BufferPool *const bm){
     
-    PgFrame *pageFrames=(PgFrame*) bm->mgmtData; // gettting pageframes from buffer pool
-
-    int index=0;
-    
-    while(index<bufferSize){
-        if(pageFrames[index].isDirty==TRUE && pageFrames[index].pageCounter==0){ // checking whether the page is dirty and not in use
-            // if page is dirty, it must be written in the disk
-            //SM_FileHandle fh;
-            openPageFile(bm->pageFile,&fh); // opening the page file
-            writeBlock(pageFrames[index].pgNumber,&fh,pageFrames[index].pageData); // writing the content into the disk
-            pageFrames[index].isDirty=FALSE; // setting the frame as not dirty
-            diskWritten++; // incrementing disk written count
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    PgFrame *pageFrames=pool->frames; // gettting pageframes from buffer pool
+    RC rc=RC_OK;
+
+    pthread_mutex_lock(&pool->poolLatch);
+    for(int index=0; index<bm->numPages; index++){
+        PageNumber pageNum=pageFrames[index].pgNumber;
+        if(pageNum==NO_PAGE || pageFrames[index].ioBusy) continue;
+
+        pthread_mutex_lock(bucketLatch(pool,pageNum));
+        bool flush=pageFrames[index].isDirty==TRUE && __atomic_load_n(&pageFrames[index].pageCounter,__ATOMIC_SEQ_CST)==0; // checking whether the page is dirty and not in use
+        if(flush){
+            // the frame is pinned for the write, so no pin can replace it meanwhile
+            __atomic_add_fetch(&pageFrames[index].pageCounter,1,__ATOMIC_SEQ_CST);
+            pageFrames[index].isDirty=FALSE; // setting the frame as not dirty, a change made during the write dirties it again
+        }
+        pthread_mutex_unlock(bucketLatch(pool,pageNum));
+
+        if(flush){
+            pool->diskWritten++; // incrementing disk written count
+            pthread_mutex_unlock(&pool->poolLatch);
+
+            SM_FileHandle fh;
+            RC written=openPageFile(bm->pageFile,&fh);
+            if(written==RC_OK) written=writeFrame(bm,&fh,pageNum,pageFrames[index].pageData); // writing the content into the disk
+
+            pthread_mutex_lock(&pool->poolLatch);
+            if(written!=RC_OK){
+                pthread_mutex_lock(bucketLatch(pool,pageNum));
+                pageFrames[index].isDirty=TRUE;
+                pthread_mutex_unlock(bucketLatch(pool,pageNum));
+                rc=written;
+            }
+            dropPin(pool,index);
         }
-        index++;
     }
+    pthread_mutex_unlock(&pool->poolLatch);
+    return rc;
+}
+
+// to register the functions that are called before a dirty page is written back
+extern RC setWriteBackHook(BM_BufferPool *const bm, RC (*hook)(PageNumber pageNum, void *hookData),
+                        RC (*flush)(PageNumber pageNum, void *hookData), void *hookData){
+    bm->writeBackHook=hook;
+    bm->logFlushHook=flush;
+    bm->hookData=hookData;
     return RC_OK;
 }
 
 // to shutdown buffer pool
 RC shutdownBufferPool(BM_BufferPool *const bm){
     
-    PgFrame *pageFrames=(PgFrame *) bm->mgmtData; // getting the page frames from the buffer pool
-    //printf("start force flush");
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    PgFrame *pageFrames=pool->frames; // getting the page frames from the buffer pool
     forceFlushPool(bm); // flushing the buffer before shutting it down.
-    //printf("done force flush");
     int index=0;
 
-    while(index < bufferSize){
-        //printf("%d\n",pageFrames[index].pageCounter);
+    while(index < bm->numPages){
         if(pageFrames[index].pageCounter!=0){ // checking whether page is in use or not
             return RC_ERROR;
         }
         index++;
     }
-    //printf("done shutdown");
 
+    for(index = 0; index < bm->numPages; index++){
+        free(pageFrames[index].pageData); // freeing the page data of every frame
+        pthread_mutex_destroy(&pageFrames[index].ioLatch);
+    }
     free(pageFrames); // freeing the memory
+    free(pool->buckets);
+    for(index = 0; index <= pool->bucketMask; index++) pthread_mutex_destroy(&pool->bucketLatches[index]);
+    free(pool->bucketLatches);
+    pthread_mutex_destroy(&pool->poolLatch);
+    pthread_cond_destroy(&pool->frameFreed);
+    free(pool);
 
     bm->mgmtData = NULL; // removing the data from mgmtData
 
@@ -110,204 +251,182 @@ RC shutdownBufferPool(BM_BufferPool *const bm){
 
 /*====================================================================Page Replacement Strategy=================================================================*/
 
+// the strategies pick the frame a missing page goes into, with the pool latch held
+// a frame can be replaced only when no one has it pinned and no I/O runs on it,
+// while pool->writableOnly is set also only when its page can be written back without waiting for a log
+// a hit may pin a frame the strategy chose, takeFrame looks at the count again under the bucket's latch
+#define REPLACEABLE(frame) (__atomic_load_n(&(frame).pageCounter,__ATOMIC_SEQ_CST)==0 && !(frame).ioBusy && (!pool->writableOnly || frameWritable(bm,pool,&(frame))))
+
 // First In First Out replacement algorithm 
-void FIFO(BM_BufferPool *const bm, PgFrame * page){
-    PgFrame *pageFrames=(PgFrame*)bm->mgmtData; // getting the page frames from buffer pool
+static int FIFO(BM_BufferPool *const bm, PoolData *pool){
+    PgFrame *pageFrames=pool->frames; // getting the page frames from buffer pool
 
     int index=0, startIndex;
 
-    startIndex= diskRead % bufferSize; // finding the initial index
+    startIndex= pool->diskRead % bm->numPages; // finding the initial index
 
-    while(index < bufferSize){
-        if(pageFrames[startIndex].pageCounter==0){
-            if(pageFrames[startIndex].isDirty==TRUE){ // if the page is dirty, writting it in the disk
-                //SM_FileHandle fh;
-                openPageFile(bm->pageFile,&fh);
-                writeBlock(pageFrames[startIndex].pgNumber,&fh,pageFrames[startIndex].pageData);
-                diskWritten++;
-            }
-            // changing frame with new frame in the buffer
-            pageFrames[startIndex].pageData=page->pageData;
-            pageFrames[startIndex].isDirty=page->isDirty;
-            pageFrames[startIndex].pgNumber=page->pgNumber;
-            pageFrames[startIndex].pageCounter=page->pageCounter;
-            break;
-        }
-        else{
-            startIndex++;
-            if(startIndex % bufferSize==0) startIndex=0; // restarting the loop if we are at end of the buffer
-        }
-        //free(pageFrames);
+    while(index < bm->numPages){
+        if(REPLACEABLE(pageFrames[startIndex])) return startIndex;
+        startIndex++;
+        if(startIndex % bm->numPages==0) startIndex=0; // restarting the loop if we are at end of the buffer
         index++;
     }
+    return -1; // every frame is in use
 }
 
 // LFU (Least Frequently Used) page replacement srategy
-extern void LFU(BM_BufferPool *const bm, PgFrame *poolFrame) {
+static int LFU(BM_BufferPool *const bm, PoolData *pool) {
    
     int index1=0, index2=0; // for loops
-    int leastFreqIndex = lastPageInLFU, minFreqCount; // storing the value of LFU index
-    PgFrame *f = (PgFrame*) bm -> mgmtData; // Retrieve the array of frames from the buffer pool management data.
-
-    while(index1 < bufferSize) {
-        // Check if the page in the current frame is not fixed
-        if(f[leastFreqIndex].pageCounter == 0) {
-            // Find the frame with least frequent usage (LFU)
-            leastFreqIndex = (leastFreqIndex + index1) % bufferSize;
-            minFreqCount = f[leastFreqIndex].leastFrequentlyUsedPage;
-            break;
-        }
-        index1++;
-    }
-    // Pointer traversal across the buffer frame
-    index1 = (leastFreqIndex + 1) % bufferSize;
+    int leastFreqIndex = -1, minFreqCount = 0; // storing the value of LFU index
+    PgFrame *f = pool->frames; // Retrieve the array of frames from the buffer pool management data.
+
+    // Pointer traversal across the buffer frame, starting after the last replaced one
+    index1 = pool->lastPageInLFU % bm->numPages;
     
-    while(index2 < bufferSize) {
-        if(f[index1].leastFrequentlyUsedPage < minFreqCount) {
-            // Update the LFU index if a frame with lower LFU count is found
+    while(index2 < bm->numPages) {
+        // Find the frame with least frequent usage (LFU) among the frames that are not fixed
+        if(REPLACEABLE(f[index1]) && (leastFreqIndex < 0 || f[index1].leastFrequentlyUsedPage < minFreqCount)) {
             leastFreqIndex = index1;
             minFreqCount = f[index1].leastFrequentlyUsedPage;
         }
-        index1 = (index1 + 1) % bufferSize;
+        index1 = (index1 + 1) % bm->numPages;
         index2++;
     }
     
-    if(f[leastFreqIndex].isDirty == 1) {
-        // If it's dirty, write the page to the disk before replacing it
-        openPageFile(bm->pageFile, &fh);
-        writeBlock(f[leastFreqIndex].pgNumber, &fh, f[leastFreqIndex].pageData);
-        diskWritten++;
-    }
-    
-    // Update the page information with the new page frame
-    f[leastFreqIndex].isDirty = poolFrame -> isDirty;
-    f[leastFreqIndex].pageCounter = poolFrame -> pageCounter;
-    f[leastFreqIndex].pageData = poolFrame -> pageData;
-    f[leastFreqIndex].pgNumber = poolFrame -> pgNumber;
-    
     // Update the LFU pointer to the next frame
-    lastPageInLFU = leastFreqIndex + 1;
+    if(leastFreqIndex >= 0) pool->lastPageInLFU = leastFreqIndex + 1;
+    return leastFreqIndex;
 }
 
 // LRU (Least Recently Used) page replacement strategy
-extern void LRU(BM_BufferPool *const bm, PgFrame *poolFrame) {
+static int LRU(BM_BufferPool *const bm, PoolData *pool) {
     // Retrieve the array of frames from the buffer pool management data.
-    PgFrame *f = (PgFrame*) bm -> mgmtData;
-    int lastHitIndex, minCacheCount;
-    int index=0;
-
-    // Get the first frame with the least recently used (LRU) count
-    while(index < bufferSize) {
-        // Check if the page in the current frame is not fixed
-        if(f[index].pageCounter == 0) {
-            lastHitIndex = index;
-            minCacheCount = f[index].leastrecentlyUsedPage;
-            break;
-        }
-        index++;
-    }    
+    PgFrame *f = pool->frames;
+    int lastHitIndex = -1, minCacheCount = 0;
 
-    index= lastHitIndex+1;
-
-    // Go through the frames to find the frame with the lowest LRU count
-    while(index < bufferSize) {
-        if(f[index].leastrecentlyUsedPage < minCacheCount) 
+    // Go through the frames to find the frame with the lowest LRU count that is not fixed
+    for(int index = 0; index < bm->numPages; index++) {
+        if(REPLACEABLE(f[index]) && (lastHitIndex < 0 || f[index].leastrecentlyUsedPage < minCacheCount)) 
         {
             lastHitIndex = index;
             minCacheCount = f[index].leastrecentlyUsedPage;
         }
-        index++;
     }
-
-    if(f[lastHitIndex].isDirty == TRUE) {
-        // If it's dirty, write the page to the disk before replacing it
-        SM_FileHandle fh;
-        openPageFile(bm -> pageFile, &fh);
-        writeBlock(f[lastHitIndex].pgNumber, &fh, f[lastHitIndex].pageData);
-        diskWritten++;
-    }
-    
-    // Update the page information with the new page frame
-    f[lastHitIndex].pgNumber = poolFrame -> pgNumber;
-    f[lastHitIndex].isDirty = poolFrame -> isDirty;
-    f[lastHitIndex].pageCounter = poolFrame -> pageCounter;
-    f[lastHitIndex].pageData = poolFrame -> pageData;
-    f[lastHitIndex].leastrecentlyUsedPage = poolFrame -> leastrecentlyUsedPage;
+    return lastHitIndex;
 }
 
 // CLOCK page replacement strategy
-extern void CLOCK(BM_BufferPool *const bm, PgFrame *poolFrame) {
+static int CLOCK(BM_BufferPool *const bm, PoolData *pool) {
     
     // Retrieve the array of frames from the buffer pool management data.
-    PgFrame *f = (PgFrame*) bm -> mgmtData;
+    PgFrame *f = pool->frames;
 
-    // Infinite loop for CLOCK replacement.
-    while(1) {
+    // two turns of the hand clear every reference bit, a third finds nothing only when every frame is in use
+    for(int step = 0; step < 2 * bm->numPages; step++) {
         // Ensure circular traversal of frames for CLOCK algorithm.
         // If clkIndex reaches the end of the array, wrap it around to 0.
-        if(lastPageInClock % bufferSize == 0) lastPageInClock=0;    
+        if(pool->lastPageInClock % bm->numPages == 0) pool->lastPageInClock=0;    
+        int index = pool->lastPageInClock++;
    
-        if(f[lastPageInClock].leastrecentlyUsedPage == 0) {
-            if(f[lastPageInClock].isDirty == TRUE) {
-                // If it's dirty write the page to the disk before replacing it.
-                openPageFile(bm -> pageFile, &fh);
-                writeBlock(f[lastPageInClock].pgNumber, &fh, f[lastPageInClock].pageData);
-                diskWritten++;
-            }
-            
-            // Update the page infomation with the new page frame.
-            f[lastPageInClock].pageData = poolFrame -> pageData;
-            f[lastPageInClock].isDirty = poolFrame -> isDirty;
-            f[lastPageInClock].pageCounter = poolFrame -> pageCounter;
-            f[lastPageInClock].pgNumber = poolFrame -> pgNumber;
-            f[lastPageInClock].leastrecentlyUsedPage = poolFrame -> leastrecentlyUsedPage;
-            
-            lastPageInClock++;
-            break;    
+        if(REPLACEABLE(f[index])) {
+            if(f[index].leastrecentlyUsedPage == 0) return index;
+            f[index].leastrecentlyUsedPage = 0;     // Reset the reference bit for the current frame.
         }
-        else 
-            poolFrame[lastPageInClock++].leastrecentlyUsedPage = 0;     // Reset the LRU count for the current frame.
+    }
+    return -1;
+}
+
+// runs the pool's strategy
+static int strategyVictim(BM_BufferPool *const bm, PoolData *pool){
+    // selecting the strategy
+    switch(bm->strategy){
+        case RS_FIFO:
+            return FIFO(bm,pool);
+        case RS_CLOCK:
+            return CLOCK(bm,pool);
+        case RS_LRU:
+            return LRU(bm,pool);
+        case RS_LFU:
+            return LFU(bm,pool);
+        default:
+            printf("Strategy not found");
+            return -1;
     }
 }
 
+// picks the frame for a missing page: an empty one if there is any, else the strategy's victim among the
+// frames that are clean or whose log is on disk, and only when there is none of those one that needs a log flush
+static int chooseFrame(BM_BufferPool *const bm, PoolData *pool){
+    for(int i = 0; i < bm->numPages; i++)
+    {
+        if(pool->frames[i].pgNumber == NO_PAGE && REPLACEABLE(pool->frames[i])) return i;
+    }
+
+    pool->writableOnly = TRUE;
+    int victim = strategyVictim(bm,pool);
+    pool->writableOnly = FALSE;
+    return victim >= 0 ? victim : strategyVictim(bm,pool);
+}
+
 
 /*====================================================================Page Management Functions====================================================================*/ 
 
+// looks up the frame that holds a page, with the pool latch or the latch of the page's bucket held
+static int findFrame(PoolData *pool, PageNumber pageNum){
+    //look through the page table to find pageNum because page numbers and page frames may not be the same
+    for(int i = pool->buckets[pageNum & pool->bucketMask]; i >= 0; i = pool->frames[i].nextInBucket)
+    {
+        if(pool->frames[i].pgNumber == pageNum) return i;
+    }
+    return -1;
+}
+
+// puts a frame under a new page in the page table, NO_PAGE leaves it out,
+// with the pool latch and the latches of the old and the new page's buckets held
+static void setFramePage(PoolData *pool, int frameIndex, PageNumber pageNum){
+    PgFrame *frame = &pool->frames[frameIndex];
+    if(frame->pgNumber != NO_PAGE){
+        int *link = &pool->buckets[frame->pgNumber & pool->bucketMask];
+        while(*link != frameIndex) link = &pool->frames[*link].nextInBucket;
+        *link = frame->nextInBucket;
+    }
+    frame->pgNumber = pageNum;
+    frame->nextInBucket = -1;
+    if(pageNum != NO_PAGE){
+        frame->nextInBucket = pool->buckets[pageNum & pool->bucketMask];
+        pool->buckets[pageNum & pool->bucketMask] = frameIndex;
+    }
+}
+
 // to make a page as dirty
 extern RC markDirty(BM_BufferPool *const bm, BM_PageHandle *const page)
 {
     //the page handler has modified the contents of frame
 
-    PgFrame* ptr =(PgFrame*) bm -> mgmtData;
-    for(int i = 0; i < bufferSize; i++)
-    {
-        if(ptr[i].pgNumber == page -> pageNum) // check for the page
-        {
-            ptr[i].isDirty = TRUE; // if page is found marking it as dirty
-            return RC_OK;
-        }
-    }
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    pthread_mutex_t *latch = bucketLatch(pool,page->pageNum);
+    pthread_mutex_lock(latch);
+    int i = findFrame(pool,page->pageNum); // check for the page
+    if(i >= 0) pool->frames[i].isDirty = TRUE; // if page is found marking it as dirty
+    pthread_mutex_unlock(latch);
+
     //unable to find page in buffer pool!!
-    return RC_ERROR;
+    return i >= 0 ? RC_OK : RC_ERROR;
 }
 
 // to unpin the page
 extern RC unpinPage(BM_BufferPool *const bm, BM_PageHandle *const page)
 {
-    PgFrame* ptr = (PgFrame*)bm -> mgmtData;
-    for(int i = 0; i < bufferSize; i++)
-    {
-        //look through the page table to find pageNum because page numbers and page frames may not be the same
-        if(ptr[i].pgNumber == page -> pageNum)
-        {
-            //printf("Page in use value %d\n",ptr[i].pageCounter);
-            ptr[i].pageCounter--;
-            return RC_OK;
-        }
-    }
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    pthread_mutex_t *latch = bucketLatch(pool,page->pageNum);
+    pthread_mutex_lock(latch);
+    int i = findFrame(pool,page->pageNum);
+    pthread_mutex_unlock(latch);
+    if(i >= 0) releasePin(pool,i); // the frame keeps its page until this pin is gone, a pin waiting for a frame may take it then
+
     //unable to find the page!!!
-    //printf("page not found");
-    return RC_ERROR;
+    return i >= 0 ? RC_OK : RC_ERROR;
 }
 
 //  forcing a page to write in the disk
@@ -315,156 +434,340 @@ extern RC forcePage(BM_BufferPool *const bm, BM_PageHandle *const page)
 {
    
     //find the row in the pagetable
-    PgFrame *ptr = (PgFrame*)bm -> mgmtData;
-    for(int i = 0; i < bufferSize; i++)
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    pthread_mutex_t *latch = bucketLatch(pool,page->pageNum);
+    pthread_mutex_lock(&pool->poolLatch);
+    int i = findFrame(pool,page->pageNum);
+    if(i < 0){
+        //page number not found in buffer pool!!!
+        pthread_mutex_unlock(&pool->poolLatch);
+        return RC_OK;
+    }
+    PgFrame *frame = &pool->frames[i];
+    pthread_mutex_lock(latch);
+    __atomic_add_fetch(&frame->pageCounter,1,__ATOMIC_SEQ_CST); // pinned for the write
+    frame->isDirty = FALSE; //mark page as clean
+    pthread_mutex_unlock(latch);
+    pool->diskWritten++;
+    pthread_mutex_unlock(&pool->poolLatch);
+
+    //write data to fhandler
+    SM_FileHandle fh;
+    RC rc = openPageFile(bm->pageFile,&fh);
+    if(rc == RC_OK) rc = writeFrame(bm,&fh,page->pageNum,frame->pageData);
+
+    if(rc != RC_OK){
+        pthread_mutex_lock(latch);
+        frame->isDirty = TRUE;
+        pthread_mutex_unlock(latch);
+    }
+    releasePin(pool,i);
+    return rc;
+}
+
+// counts a pin of a page that is in the pool, with the latch of its bucket or the pool latch held
+static void pinFound(BM_BufferPool *const bm, PoolData *pool, int i){
+    PgFrame *ptr = pool->frames;
+    __atomic_add_fetch(&ptr[i].pageCounter,1,__ATOMIC_SEQ_CST); // increasing the page counter
+    int hits = __atomic_add_fetch(&pool->cache,1,__ATOMIC_RELAXED); // increasing cache hits
+
+    // updating flags of page replacement algorithms, hits in other buckets update them alongside
+    if(bm->strategy==RS_LRU) __atomic_store_n(&ptr[i].leastrecentlyUsedPage,hits,__ATOMIC_RELAXED);
+    else if(bm->strategy==RS_CLOCK) __atomic_store_n(&ptr[i].leastrecentlyUsedPage,1,__ATOMIC_RELAXED);
+    else if(bm->strategy==RS_LFU) __atomic_add_fetch(&ptr[i].leastFrequentlyUsedPage,1,__ATOMIC_RELAXED);
+}
+
+// the frame a page is still being written back out of, -1 if none, with the pool latch held
+static int writingFrame(BM_BufferPool *const bm, PoolData *pool, PageNumber pageNum){
+    int writing = -1;
+    for(int j = 0; j < bm->numPages; j++)
     {
-        if(ptr[i].pgNumber == page -> pageNum)
-        {
-            //SM_FileHandle fh;
-            openPageFile(bm -> pageFile, &fh);
-
-            //write data to fhandler
-            writeBlock(ptr[i].pgNumber, &fh, ptr[i].pageData);
-            
-            //mark page as clean
-            ptr[i].isDirty = FALSE;
-            
-            diskWritten++;
-        }
+        if(pool->frames[j].ioBusy && pool->frames[j].writingPage == pageNum) writing = j;
     }
-    //page number not found in buffer pool!!!
-    return RC_OK;
+    return writing;
+}
+
+// takes a frame over for a missing page under the pool latch, its I/O runs after the latch is let go,
+// fails when a hit pinned the frame after the strategy chose it,
+// *writeBack tells whether the old page has to be written back first
+static bool takeFrame(BM_BufferPool *const bm, PoolData *pool, int i, PageNumber pageNum, bool *writeBack){
+    PgFrame *frame = &pool->frames[i];
+    PageNumber oldPage = frame->pgNumber;
+
+    // no one holds the ioLatch of a frame without pins, it is in place before a pin can find the new page
+    pthread_mutex_lock(&frame->ioLatch);
+    lockBuckets(pool,oldPage,pageNum);
+    if(__atomic_load_n(&frame->pageCounter,__ATOMIC_SEQ_CST) != 0){
+        unlockBuckets(pool,oldPage,pageNum);
+        pthread_mutex_unlock(&frame->ioLatch);
+        return FALSE;
+    }
+    *writeBack = oldPage != NO_PAGE && frame->isDirty == TRUE;
+
+    frame->writingPage = *writeBack ? oldPage : NO_PAGE;
+    setFramePage(pool,i,pageNum); // updating the page number
+    __atomic_store_n(&frame->pageCounter,1,__ATOMIC_SEQ_CST); // setting the page counter
+    frame->isDirty = FALSE; // marking page as not dirty
+    frame->ioBusy = TRUE;
+    frame->ioFailed = FALSE;
+    frame->leastFrequentlyUsedPage = 0; // for LFU
+    pool->diskRead++; // increasing the disk read count
+    int hits = __atomic_add_fetch(&pool->cache,1,__ATOMIC_RELAXED); // increasing cache hits
+    if(*writeBack) pool->diskWritten++;
+
+    // for page replacement 
+    if(bm->strategy==RS_CLOCK) frame->leastrecentlyUsedPage=1;
+    else if(bm->strategy==RS_LRU) frame->leastrecentlyUsedPage=hits;
+
+    unlockBuckets(pool,oldPage,pageNum);
+    return TRUE;
+}
+
+// ends the I/O of a frame taken over by takeFrame, the pool latch is held, the frame's ioLatch is not
+// on failure the new page leaves the page table, and an old page whose write-back did not succeed
+// goes back into the frame still dirty, the frame is free again once the pins waiting on it are dropped
+static void endFrameIO(PoolData *pool, int i, RC rc, bool writeBackFailed){
+    PgFrame *frame = &pool->frames[i];
+    PageNumber pageNum = frame->pgNumber;
+    PageNumber restored = rc != RC_OK && writeBackFailed ? frame->writingPage : NO_PAGE;
+
+    lockBuckets(pool,pageNum,restored);
+    if(rc != RC_OK){
+        setFramePage(pool,i,restored);
+        if(restored != NO_PAGE) frame->isDirty = TRUE;
+    }
+    frame->ioBusy = FALSE;
+    frame->writingPage = NO_PAGE;
+    unlockBuckets(pool,pageNum,restored);
+    if(rc != RC_OK) dropPin(pool,i);
+}
+
+// waits for another pin's I/O on a frame, on failure the waiting pin is dropped and the error returned
+static RC waitFrameIO(PoolData *pool, int i){
+    PgFrame *frame = &pool->frames[i];
+    pthread_mutex_lock(&frame->ioLatch);
+    pthread_mutex_unlock(&frame->ioLatch);
+
+    // the flag is set before the ioLatch is let go, and stays until the frame is taken again, which this pin prevents
+    if(!frame->ioFailed) return RC_OK;
+    releasePin(pool,i);
+    return RC_ERROR;
 }
 
 // to pin a page in the buffer pool
+// a page that is in the pool is pinned under the latch of its bucket, a missing one takes the pool latch to
+// choose a frame, the write-back of the old page and the read of the new one happen under the frame's ioLatch,
+// so pins of other pages and hits on pages already in the pool go on meanwhile
 extern RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum)
 {
-    //printf("\npage pinned!\n");
-    //update pin counter in page table
-    PgFrame *ptr = (PgFrame*)bm -> mgmtData;
-    if(ptr[0].pgNumber != -1){ // first page is available
-       bool bufferOverflow = true;
-        for(int i = 0; i < bufferSize; i++)
-        {
-            if(ptr[i].pgNumber!=-1){ // if page exist
-               
-                if(ptr[i].pgNumber == pageNum) // if page is found
-                {
-                    ptr[i].pageCounter++; // increasing the page counter
-                    bufferOverflow = false; // setting the buffer as not full
-                    cache++; // increasing cache hits
-                
-                    // updating flags of page replacement algorithms
-                    if(bm->strategy==RS_LRU) ptr[i].leastrecentlyUsedPage= cache;
-                    else if(bm->strategy==RS_CLOCK) ptr[i].leastrecentlyUsedPage=1;
-                    else if(bm->strategy==RS_LFU) ptr[i].leastFrequentlyUsedPage++;
-
-                    // Output data
-                    page->pageNum= pageNum; // setting the page number
-                    page->data = ptr[i].pageData; // setting the page handler data
-
-                    lastPageInClock++; // move the clock pointer
-
-                    break;
-                }
-            }
-            else{
-                SM_FileHandle fh;
-                openPageFile(bm->pageFile, &fh);
-
-                ptr[i].pageData = (SM_PageHandle) malloc(PAGE_SIZE); // allocation of page data
-
-                readBlock(pageNum,&fh,ptr[i].pageData); // reading the page data
-                
-                ptr[i].pgNumber = pageNum; // updating the page number
-                ptr[i].pageCounter =1; // setting the page counter
-                ptr[i].leastFrequentlyUsedPage=0; // for LFU
-                diskRead++;
-                cache++;
-
-                //updating based on the strategy
-                if(bm->strategy==RS_CLOCK) ptr[i].leastrecentlyUsedPage=1;
-                else if(bm->strategy==RS_LRU) ptr[i].leastrecentlyUsedPage=cache;
-
-                
-                bufferOverflow=false; 
-
-                // output data
-                page->pageNum=pageNum;
-                page->data = ptr[i].pageData;
-                
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    PgFrame *ptr = pool->frames;
+    pthread_mutex_t *latch = bucketLatch(pool,pageNum);
+    bool loading = FALSE, taken = FALSE, writeBack = FALSE;
+    int i;
+
+    pthread_mutex_lock(latch);
+    i = findFrame(pool,pageNum);
+    if(i >= 0){ // if page is found
+        pinFound(bm,pool,i);
+        loading = ptr[i].ioBusy;
+    }
+    pthread_mutex_unlock(latch);
+
+    if(i < 0){
+        pthread_mutex_lock(&pool->poolLatch);
+        while(1){
+            // another pin may have brought the page in meanwhile
+            i = findFrame(pool,pageNum);
+            if(i >= 0){
+                pinFound(bm,pool,i);
+                loading = ptr[i].ioBusy;
                 break;
+            }
+
+            // the page may still be on its way out of another frame, reading it now could miss the write
+            int writing = writingFrame(bm,pool,pageNum);
+            if(writing >= 0){
+                pthread_mutex_unlock(&pool->poolLatch);
+                pthread_mutex_lock(&ptr[writing].ioLatch);
+                pthread_mutex_unlock(&ptr[writing].ioLatch);
+                pthread_mutex_lock(&pool->poolLatch);
+                continue;
+            }
 
+            i = chooseFrame(bm,pool);
+            if(i < 0){
+                // every frame is in use, wait for an unpin; one that came before the count went up left a frame the second look finds
+                __atomic_add_fetch(&pool->frameWaiters,1,__ATOMIC_SEQ_CST);
+                i = chooseFrame(bm,pool);
+                if(i < 0) pthread_cond_wait(&pool->frameFreed,&pool->poolLatch);
+                __atomic_sub_fetch(&pool->frameWaiters,1,__ATOMIC_SEQ_CST);
             }
+            if(i >= 0 && takeFrame(bm,pool,i,pageNum,&writeBack)){
+                taken = TRUE;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&pool->poolLatch);
+    }
+
+    if(taken){
+        PgFrame *frame = &ptr[i];
+        SM_FileHandle fh;
+        RC rc = openPageFile(bm->pageFile,&fh); // open the page file
+        if(rc == RC_OK && writeBack){ // if the old page is dirty, writting it in the disk
+            rc = writeFrame(bm,&fh,frame->writingPage,frame->pageData);
+            if(rc == RC_OK) writeBack = FALSE; // the old page is safe on disk
         }
+        if(rc == RC_OK) rc = readBlock(pageNum,&fh,frame->pageData); // reading the data into buffer
 
-        if(bufferOverflow==true){ // if buffer is full
-            
-        PgFrame *pageFrame=(PgFrame*)malloc(sizeof(PgFrame)); // allocation page frame memory
-        //SM_FileHandle fh;
-        openPageFile(bm->pageFile,&fh); // open the page file
-        pageFrame->pageData = (SM_PageHandle) malloc(PAGE_SIZE); // allocate memory for page data
-        readBlock(pageNum,&fh,pageFrame->pageData); // reading the data into buffer
-        pageFrame->leastFrequentlyUsedPage=0; // for LFU
-        pageFrame->pgNumber=pageNum; // setting page number
-        pageFrame->isDirty=FALSE; // marking page as not dirty
-        pageFrame->pageCounter=1; // setting the page counter
-        diskRead++; // increasing the disk read count
-        cache++; // increasing cache hits
-
-        // for page replacement 
-        if(bm->strategy==RS_CLOCK) pageFrame->leastrecentlyUsedPage=1;
-        else if(bm->strategy==RS_LRU) pageFrame->leastrecentlyUsedPage=cache;
+        // the ioLatch goes first, the frame stays busy until the flags are cleared, so no pin takes it meanwhile
+        frame->ioFailed = rc != RC_OK;
+        pthread_mutex_unlock(&frame->ioLatch);
+        pthread_mutex_lock(&pool->poolLatch);
+        endFrameIO(pool,i,rc,writeBack);
+        pthread_mutex_unlock(&pool->poolLatch);
 
         // output data
         page->pageNum=pageNum;
-        page->data= pageFrame->pageData;
+        page->data= frame->pageData;
+        return rc;
+    }
 
-        // selecting the strategy
-        switch(bm->strategy){
-            case RS_FIFO:
-                FIFO(bm,pageFrame);
-                break;
-            case RS_CLOCK:
-                CLOCK(bm,pageFrame);
-                break;
-            case RS_LRU:
-                LRU(bm,pageFrame);
-                break;
-            case RS_LFU:
-                LFU(bm,pageFrame);
-                break;
-            default:
-                printf("Strategy not found");
-                break;
-            }
-            free(pageFrame);
+    if(loading){ // another pin is still reading the page in, its ioLatch is free once the data is there
+        RC rc = waitFrameIO(pool,i);
+        if(rc != RC_OK) return rc;
+    }
+
+    // Output data
+    page->pageNum= pageNum; // setting the page number
+    page->data = ptr[i].pageData; // setting the page handler data
+    return RC_OK;
+}
+
+// to pin several pages at once, the missing ones are read with one read per run of consecutive pages
+// frames are only taken while they are free, so fewer pages than asked for may be pinned, always at least the first
+extern RC pinPages(BM_BufferPool *const bm, BM_PageHandle *const pages, PageNumber *pageNums, int count, int *pinned)
+{
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    PgFrame *ptr = pool->frames;
+    int frameOf[PIN_BATCH_PAGES];
+    bool loading[PIN_BATCH_PAGES], taken[PIN_BATCH_PAGES], writeBack[PIN_BATCH_PAGES];
+    int k;
+
+    if(count > PIN_BATCH_PAGES) count = PIN_BATCH_PAGES;
+    *pinned = 0;
+    if(count <= 0) return RC_OK;
+
+    pthread_mutex_lock(&pool->poolLatch);
+    for(k = 0; k < count; k++){
+        int i = findFrame(pool,pageNums[k]);
+        if(i >= 0){
+            pinFound(bm,pool,i);
+            loading[k] = ptr[i].ioBusy;
+            taken[k] = FALSE;
         }
-        //printf("page pinned done!");
-        return RC_OK;
+        else{
+            // a page on its way out of a frame or no free frame ends the batch, it never waits holding frames
+            if(writingFrame(bm,pool,pageNums[k]) >= 0) break;
+            while((i = chooseFrame(bm,pool)) >= 0 && !takeFrame(bm,pool,i,pageNums[k],&writeBack[k]))
+                ; // a hit pinned the chosen frame meanwhile, the next choice passes it over
+            if(i < 0) break;
+            loading[k] = FALSE;
+            taken[k] = TRUE;
+        }
+        frameOf[k] = i;
+    }
+    pthread_mutex_unlock(&pool->poolLatch);
+
+    if(k == 0){ // not even the first page could be taken without waiting
+        *pinned = 1;
+        return pinPage(bm,&pages[0],pageNums[0]);
+    }
+    count = k;
+
+    // the old pages are written back first, then every run of consecutive missing pages is read at once
+    SM_FileHandle fh;
+    RC rc = openPageFile(bm->pageFile,&fh);
+    for(k = 0; k < count && rc == RC_OK; k++){
+        if(taken[k] && writeBack[k]){
+            rc = writeFrame(bm,&fh,ptr[frameOf[k]].writingPage,ptr[frameOf[k]].pageData);
+            if(rc == RC_OK) writeBack[k] = FALSE; // the old page is safe on disk
+        }
+    }
+    SM_PageHandle runPages[PIN_BATCH_PAGES];
+    for(k = 0; k < count && rc == RC_OK; ){
+        if(!taken[k]){
+            k++;
+            continue;
+        }
+        int run = 0;
+        while(k + run < count && taken[k + run] && pageNums[k + run] == pageNums[k] + run){
+            runPages[run] = ptr[frameOf[k + run]].pageData;
+            run++;
+        }
+        rc = readBlocks(pageNums[k],run,&fh,runPages);
+        k += run;
+    }
+
+    for(k = 0; k < count; k++){
+        if(taken[k]){
+            ptr[frameOf[k]].ioFailed = rc != RC_OK;
+            pthread_mutex_unlock(&ptr[frameOf[k]].ioLatch);
+        }
+    }
+    pthread_mutex_lock(&pool->poolLatch);
+    for(k = 0; k < count; k++){
+        if(taken[k]) endFrameIO(pool,frameOf[k],rc,writeBack[k]);
+        else if(rc != RC_OK) dropPin(pool,frameOf[k]);
+    }
+    pthread_mutex_unlock(&pool->poolLatch);
+    if(rc != RC_OK) return rc; // nothing stays pinned
+
+    // pages another pin is reading in are waited for only once this batch holds no ioLatch,
+    // if one of those reads failed the rest of the batch is unpinned as well
+    for(k = 0; k < count; k++){
+        if(loading[k] && (rc = waitFrameIO(pool,frameOf[k])) != RC_OK) break;
+        pages[k].pageNum = pageNums[k];
+        pages[k].data = ptr[frameOf[k]].pageData;
+    }
+    if(rc != RC_OK){
+        for(int j = 0; j < count; j++){
+            // the failed wait dropped its own pin, a frame still loading keeps the pin of the one reading it
+            if(j != k) releasePin(pool,frameOf[j]);
+        }
+        return rc;
+    }
+    *pinned = count;
+    return RC_OK;
+}
+
+
+
+
+// to prefetch pages that will be pinned soon
+extern RC prefetchPages(BM_BufferPool *const bm, PageNumber *pageNums, int count)
+{
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    PageNumber *missing = (PageNumber*) malloc(sizeof(PageNumber) * count);
+    int missingCount = 0;
+
+    pthread_mutex_lock(&pool->poolLatch);
+    for(int index = 0; index < count; index++)
+    {
+        if(findFrame(pool,pageNums[index]) < 0) missing[missingCount++] = pageNums[index]; // the page is not in the pool yet
     }
-    else{ // if first page is empty
-     //SM_FileHandle fh;
+    pthread_mutex_unlock(&pool->poolLatch);
+
+    // the reads are only hinted to the storage manager, frames are taken when the pages are pinned
+    if(missingCount > 0)
+    {
         SM_FileHandle fh;
-        openPageFile(bm->pageFile,&fh);
-
-        ptr[0].pageData = (SM_PageHandle) malloc(PAGE_SIZE); // providing memory for page data
-        ensureCapacity(pageNum,&fh); // ensuring the capacity
-        readBlock(pageNum,&fh,ptr[0].pageData); // reading the page data into buffer
-        
-        // setting the meta data
-        ptr[0].pageCounter++;
-        ptr[0].pgNumber=pageNum;
-        diskRead = cache = 0;
-        ptr[0].leastrecentlyUsedPage = cache;
-        
-        page->pageNum=pageNum; // setting the output page number
-        page->data=ptr[0].pageData; // setting the output data
-        //printf("page pinned done!");
-        return RC_OK;
+        if(openPageFile(bm->pageFile, &fh) == RC_OK) prefetchBlocks(missing, missingCount, &fh);
     }
-    free(ptr);
-    //printf("page pinned done!");
+
+    free(missing);
+    return RC_OK;
 }
 
 
@@ -474,18 +777,16 @@ extern RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page, const Page
 // to get content of each frame
 extern PageNumber *getFrameContents(BM_BufferPool *const bm){
     // creating memory for frame
-    PageNumber *frames= malloc(sizeof(PageNumber) * bufferSize);
+    PageNumber *frames= malloc(sizeof(PageNumber) * bm->numPages);
 
-    PgFrame *existingFrames=(PgFrame*)bm->mgmtData; // getting the frames from buffer pool
-
-    int index=0;
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    PgFrame *existingFrames=pool->frames; // getting the frames from buffer pool
 
-    while(index <bufferSize){
-        // checking whether if the frame have page
-        if(existingFrames[index].pgNumber!=-1) frames[index]=existingFrames[index].pgNumber; // store the page number
-        else frames[index]=NO_PAGE; // store it as no page
-        index++;
+    pthread_mutex_lock(&pool->poolLatch);
+    for(int index=0; index <bm->numPages; index++){
+        frames[index]=existingFrames[index].pgNumber; // store the page number, NO_PAGE for an empty frame
     }
+    pthread_mutex_unlock(&pool->poolLatch);
 
     return frames; // return the frames data
 }
@@ -493,18 +794,17 @@ extern PageNumber *getFrameContents(BM_BufferPool *const bm){
 // get data on dirty flags
 extern bool *getDirtyFlags(BM_BufferPool *const bm){
      // creating memory for frame
-    bool *flags= malloc(sizeof(bool) * bufferSize);
-
-    PgFrame *existingFrames=(PgFrame*)bm->mgmtData; // getting the frames from buffer pool
+    bool *flags= malloc(sizeof(bool) * bm->numPages);
 
-    int index=0;
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    PgFrame *existingFrames=pool->frames; // getting the frames from buffer pool
 
-    while(index <bufferSize){
+    pthread_mutex_lock(&pool->poolLatch);
+    for(int index=0; index <bm->numPages; index++){
         // checking whether if the page is dirty
-        if(existingFrames[index].isDirty==TRUE) flags[index]=TRUE; // if dirty store it as true
-        else flags[index]=FALSE; // if not dirty store it as false
-        index++;
+        flags[index]=existingFrames[index].isDirty==TRUE ? TRUE : FALSE;
     }
+    pthread_mutex_unlock(&pool->poolLatch);
 
     return flags; // return the dirty flags
 }
@@ -512,22 +812,17 @@ extern bool *getDirtyFlags(BM_BufferPool *const bm){
 // count of frames that are fixed for use
 extern int *getFixCounts(BM_BufferPool *const bm){
     //to store the fixed frames count
-    int *fixedFrames= malloc(sizeof(int) * bufferSize);
+    int *fixedFrames= malloc(sizeof(int) * bm->numPages);
 
     // getting the frames from pool
-    PgFrame *pageFrames=(PgFrame*) bm->mgmtData;
-
-    int index =0;
+    PoolData *pool=(PoolData*) bm->mgmtData;
+    PgFrame *pageFrames=pool->frames;
 
-    while(index<bufferSize){
-        if(pageFrames[index].pageCounter!=-1){ // checking if the frame is fixed
-            fixedFrames[index]=pageFrames[index].pageCounter; // if so, storing the count
-        }
-        else{
-            fixedFrames[index]=0; // if not storing it as zero
-        }
-        index++;
+    pthread_mutex_lock(&pool->poolLatch);
+    for(int index=0; index<bm->numPages; index++){
+        fixedFrames[index]=__atomic_load_n(&pageFrames[index].pageCounter,__ATOMIC_SEQ_CST); // storing the count, 0 if the frame is not fixed
     }
+    pthread_mutex_unlock(&pool->poolLatch);
 
     return fixedFrames; // returning the fixedFrames
 
@@ -536,10 +831,10 @@ extern int *getFixCounts(BM_BufferPool *const bm){
 // to get number of read opeations
 extern int getNumReadIO(BM_BufferPool *const bm){
     // the number of read operation is stored in diskread
-    return diskRead+1; // diskread +1 is the number time data is read from disk into buffer
+    return ((PoolData*) bm->mgmtData)->diskRead;
 }
 
 // to get number of disk write operations
 extern int getNumWriteIO(BM_BufferPool *const bm){
-    return diskWritten; // diskWritten has the number of time data is written from buffer into disk
-}
\ No newline at end of file
+    return ((PoolData*) bm->mgmtData)->diskWritten; // diskWritten has the number of time data is written from buffer into disk
+}
@@ -20,6 +20,9 @@ typedef enum ReplacementStrategy {
 typedef int PageNumber;
 #define NO_PAGE -1
 
+// most pages pinPages pins at once
+#define PIN_BATCH_PAGES 64
+
 typedef struct BM_BufferPool {
 	char *pageFile;
 	int numPages;
@@ -27,6 +30,11 @@ typedef struct BM_BufferPool {
 	void *mgmtData; // use this one to store the bookkeeping info your buffer
 	// manager needs for a buffer pool
 	bool isInitialized;
+	// asked before a dirty page is written back whether its log is on disk, under the pool latch, so it must not block
+	RC (*writeBackHook)(PageNumber pageNum, void *hookData);
+	// called outside the pool latch when the answer was no, to get the log onto the disk first
+	RC (*logFlushHook)(PageNumber pageNum, void *hookData);
+	void *hookData;
 
 } BM_BufferPool;
 
@@ -48,6 +56,10 @@ RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
 		void *stratData);
 RC shutdownBufferPool(BM_BufferPool *const bm);
 RC forceFlushPool(BM_BufferPool *const bm);
+// hook tells with RC_OK or RC_LOG_NOT_FLUSHED whether a dirty page may be written back now, flush is called
+// for a page that may not before it is written, both get hookData, NULL removes them
+RC setWriteBackHook(BM_BufferPool *const bm, RC (*hook)(PageNumber pageNum, void *hookData),
+		RC (*flush)(PageNumber pageNum, void *hookData), void *hookData);
 
 // Buffer Manager Interface Access Pages
 RC markDirty (BM_BufferPool *const bm, BM_PageHandle *const page);
@@ -55,6 +67,12 @@ RC unpinPage (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC forcePage (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC pinPage (BM_BufferPool *const bm, BM_PageHandle *const page, 
 		const PageNumber pageNum);
+// pins up to PIN_BATCH_PAGES pages at once, reading each run of consecutive missing pages with one read.
+// Frames are only taken while they are free, *pinned tells how many pages from the first one are pinned,
+// on an error none is.
+RC pinPages (BM_BufferPool *const bm, BM_PageHandle *const pages, PageNumber *pageNums, int count, int *pinned);
+// starts reading the pages that are not in the pool yet, without pinning them or waiting for them
+RC prefetchPages (BM_BufferPool *const bm, PageNumber *pageNums, int count);
 
 // Statistics Interface
 PageNumber *getFrameContents (BM_BufferPool *const bm);
@@ -26,12 +26,15 @@ typedef int RC;
 #define RC_IM_KEY_ALREADY_EXISTS 301
 #define RC_IM_N_TO_LAGE 302
 #define RC_IM_NO_MORE_ENTRIES 303
+#define RC_IM_KEYS_NOT_SORTED 304
+#define RC_IM_KEY_TOO_LONG 305
 
 // Added new definitions for Record Manager
 #define RC_RM_NO_TUPLE_WITH_GIVEN_RID 600
 #define RC_SCAN_CONDITION_NOT_FOUND 601
 #define RC_ERROR 404
 #define RC_PINNED_PAGES_IN_BUFFER 143
+#define RC_LOG_NOT_FLUSHED 144
 /* holder for error messages */
 extern char *RC_message;
 
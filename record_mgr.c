@@ -4,6 +4,7 @@
 #include "record_mgr.h"
 #include "buffer_mgr.h"
 #include "storage_mgr.h"
+#include "btree_mgr.h"
 
 // Record manager structure
 typedef struct RecordManager
@@ -15,6 +16,7 @@ typedef struct RecordManager
     int tupleCount;            // Number of tuples
     int firstPage;             // First page
     int scannedCount;          // Scanned count
+    int numPages;              // Pages in the table file
 } RecordManager;
 
 const int max_page_num = 100;     // Maximum number of pages
@@ -38,6 +40,23 @@ int findFreeSlot(char *data, int recordSize)
     return -1;
 }
 
+// Makes sure the table file holds page pageNum, the buffer pool only pins pages that are in the file
+RC ensureTablePage(RecordManager *rm, int pageNum)
+{
+    if (pageNum < rm->numPages)
+        return RC_OK;
+
+    // The file is extended only when the page lies past its end, the count kept in rm says where that is
+    SM_FileHandle fileHandle;
+    fileHandle.fileName = rm->bufferPool.pageFile;
+    fileHandle.totalNumPages = rm->numPages;
+    fileHandle.curPagePos = 0;
+
+    RC result = ensureCapacity(pageNum + 1, &fileHandle);
+    rm->numPages = fileHandle.totalNumPages;
+    return result;
+}
+
 /*======================================================== Record Manager functions =================================================*/
 // Initialize the record manager
 extern RC initRecordManager(void *mgmtData)
@@ -129,6 +148,14 @@ extern RC openTable(RM_TableData *rel, char *name)
     rel->mgmtData = rm;
     rel->name = name;
 
+    // Count the pages of the table file, insertRecord extends it from there
+    SM_FileHandle fileHandle;
+    RC result = openPageFile(name, &fileHandle);
+    if (result != RC_OK)
+        return result;
+    rm->numPages = fileHandle.totalNumPages;
+    closePageFile(&fileHandle);
+
     // Pin the first page to retrieve metadata
     pinPage(&rm->bufferPool, &rm->pgManager, 0);
 
@@ -143,12 +170,17 @@ extern RC openTable(RM_TableData *rel, char *name)
     numAttributes = *(int *)pagePointer;
     pagePointer = pagePointer + sizeof(int);
 
+    int keySize = *(int *)pagePointer;  // createTable stores the key size before the attributes
+    pagePointer = pagePointer + sizeof(int);
+
     Schema *schema;
 
     schema = (Schema *)malloc(sizeof(Schema));
     
     // Get data from record manager and assign those to schema
     schema->numAttr = numAttributes;
+    schema->keySize = keySize;
+    schema->keyAttrs = NULL;
     schema->attrNames = (char **)malloc(sizeof(char *) * numAttributes);
     schema->dataTypes = (DataType *)malloc(sizeof(DataType) * numAttributes);
     schema->typeLength = (int *)malloc(sizeof(int) * numAttributes);
@@ -224,7 +256,11 @@ extern RC insertRecord(RM_TableData *rel, Record *record)
     rid->page = rm->firstPage;
 
     // Pin the page where the record will be inserted
-    pinPage(&rm->bufferPool, &rm->pgManager, rid->page);
+    RC result = ensureTablePage(rm, rid->page);
+    if (result == RC_OK)
+        result = pinPage(&rm->bufferPool, &rm->pgManager, rid->page);
+    if (result != RC_OK)
+        return result;
 
     pageData = rm->pgManager.data;
 
@@ -237,7 +273,12 @@ extern RC insertRecord(RM_TableData *rel, Record *record)
         unpinPage(&rm->bufferPool, &rm->pgManager);
         rid->page++;
 
-        pinPage(&rm->bufferPool, &rm->pgManager, rid->page);
+        // A page past the end of the file is added as an empty one
+        result = ensureTablePage(rm, rid->page);
+        if (result == RC_OK)
+            result = pinPage(&rm->bufferPool, &rm->pgManager, rid->page);
+        if (result != RC_OK)
+            return result;
         pageData = rm->pgManager.data;
 
         rid->slot = findFreeSlot(pageData, sizeOfRecord);
@@ -640,4 +681,446 @@ RC build (Schema *schema, int attrNum, int *result)
     return RC_OK;
 }
 
-//**************************************************************************************************************************************************
\ No newline at end of file
+//**************************************************************************************************************************************************
+
+//Index build
+
+#define SORT_BUFFER_PAGES 64    // pages of memory an index build sorts in, a merge pass reads one page of up to 63 runs
+#define INDEX_BUILD_FILL 0.9    // fill factor of the leaves of a built index, leaving room for later inserts
+
+// A run of sorted entries in the sort file
+typedef struct SortRun
+{
+    int firstPage;  // first page of the run
+    int entries;    // number of entries in the run
+} SortRun;
+
+// External sort of the (key, RID) entries of an index build. An entry is the RID followed by the key bytes,
+// a string key with its terminator, and the entries are packed into the pages of the sort file.
+typedef struct IndexSort
+{
+    DataType keyType;          // type of the key attribute
+    int keyOffset;             // offset of the key attribute in a record
+    int keyBytes;              // bytes of the key in an entry
+    int entrySize;             // bytes of an entry
+    int perPage;               // entries in a page of the sort file
+    char *buffer;              // SORT_BUFFER_PAGES pages, the run being built or one page per run being merged
+    int count;                 // entries in the buffer
+    int position;              // next entry of the buffer to hand out when the table fit in memory
+    int duplicates;            // whether two entries were seen with the same key
+    char *fileName;            // sort file, created with the first run
+    SM_FileHandle fileHandle;
+    int filePages;             // pages written to the sort file
+    SortRun *runs;             // runs in the sort file
+    int runCount;
+    int runCapacity;
+    int mergeFirst;            // first run being merged
+    int mergeCount;            // number of runs being merged
+    int mergeRead[SORT_BUFFER_PAGES];  // entries read of each run being merged
+    char *current;             // copy of the entry handed out last
+    RC error;                  // error of a read during a merge
+} IndexSort;
+
+static _Thread_local DataType sortKeyType;  // key type the comparator of qsort uses, per thread since qsort passes no context
+
+// Turns a float into bits that compare as unsigned like the index encodes the float: -0 is 0,
+// a negative float has all of its bits flipped, any other its sign bit, so NaNs end up past the infinities
+unsigned int floatSortBits(char *value)
+{
+    float number;
+    unsigned int bits;
+    memcpy(&number, value, sizeof(float));
+    if (number == 0)
+        number = 0;
+    memcpy(&bits, &number, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+// Compares two keys of the given type like the index orders them
+int compareSortKeys(DataType keyType, char *left, char *right)
+{
+    if (keyType == DT_STRING)
+        return strcmp(left, right);
+
+    if (keyType == DT_FLOAT)
+    {
+        // a < on the floats would find a NaN equal to every key, qsort needs a total order
+        unsigned int leftBits = floatSortBits(left), rightBits = floatSortBits(right);
+        return (leftBits > rightBits) - (leftBits < rightBits);
+    }
+
+    if (keyType == DT_BOOL)
+    {
+        bool leftValue, rightValue;
+        memcpy(&leftValue, left, sizeof(bool));
+        memcpy(&rightValue, right, sizeof(bool));
+        return (leftValue != 0) - (rightValue != 0);
+    }
+
+    int leftValue, rightValue;
+    memcpy(&leftValue, left, sizeof(int));
+    memcpy(&rightValue, right, sizeof(int));
+    return (leftValue > rightValue) - (leftValue < rightValue);
+}
+
+// Orders entries by key, then by RID, so the records of a key come in page order
+int compareSortEntries(const void *left, const void *right)
+{
+    int result = compareSortKeys(sortKeyType, (char *)left + sizeof(RID), (char *)right + sizeof(RID));
+    if (result != 0)
+        return result;
+
+    RID leftRid, rightRid;
+    memcpy(&leftRid, left, sizeof(RID));
+    memcpy(&rightRid, right, sizeof(RID));
+    if (leftRid.page != rightRid.page)
+        return leftRid.page < rightRid.page ? -1 : 1;
+    return (leftRid.slot > rightRid.slot) - (leftRid.slot < rightRid.slot);
+}
+
+// Sorts the entries in the buffer and notes whether two of them have the same key
+RC sortBuffer(IndexSort *sort)
+{
+    sortKeyType = sort->keyType;
+    qsort(sort->buffer, sort->count, sort->entrySize, compareSortEntries);
+
+    for (int index = 1; index < sort->count && !sort->duplicates; index++)
+    {
+        char *entry = sort->buffer + (long)index * sort->entrySize;
+        if (compareSortKeys(sort->keyType, entry - sort->entrySize + sizeof(RID), entry + sizeof(RID)) == 0)
+            sort->duplicates = 1;
+    }
+    return RC_OK;
+}
+
+// Remembers a run written to the sort file
+RC addRun(IndexSort *sort, int firstPage, int entries)
+{
+    if (sort->runCount == sort->runCapacity)
+    {
+        sort->runCapacity = sort->runCapacity > 0 ? sort->runCapacity * 2 : 16;
+        sort->runs = (SortRun *)realloc(sort->runs, sort->runCapacity * sizeof(SortRun));
+    }
+    sort->runs[sort->runCount].firstPage = firstPage;
+    sort->runs[sort->runCount].entries = entries;
+    sort->runCount++;
+    return RC_OK;
+}
+
+// Writes one page of packed entries behind the last page of the sort file
+RC writeSortPage(IndexSort *sort, char *pageData)
+{
+    RC result = ensureCapacity(sort->filePages + 1, &sort->fileHandle);
+    if (result != RC_OK)
+        return result;
+
+    result = writeBlock(sort->filePages, &sort->fileHandle, pageData);
+    if (result != RC_OK)
+        return result;
+
+    sort->filePages++;
+    return RC_OK;
+}
+
+// Sorts the full buffer and spills it to the sort file as a new run
+RC writeRun(IndexSort *sort)
+{
+    RC result;
+
+    if (sort->runCount == 0)
+    {
+        if ((result = createPageFile(sort->fileName)) != RC_OK)
+            return result;
+        if ((result = openPageFile(sort->fileName, &sort->fileHandle)) != RC_OK)
+            return result;
+    }
+
+    sortBuffer(sort);
+
+    int firstPage = sort->filePages;
+    for (int index = 0; index < sort->count; index += sort->perPage)
+    {
+        if ((result = writeSortPage(sort, sort->buffer + (long)index * sort->entrySize)) != RC_OK)
+            return result;
+    }
+
+    addRun(sort, firstPage, sort->count);
+    sort->count = 0;
+    return RC_OK;
+}
+
+// Reads the page of a run being merged that holds its next entry into the run's page of the buffer
+RC loadRunPage(IndexSort *sort, int run)
+{
+    SortRun *sortRun = &sort->runs[sort->mergeFirst + run];
+    int page = sortRun->firstPage + sort->mergeRead[run] / sort->perPage;
+    return readBlock(page, &sort->fileHandle, sort->buffer + (long)run * PAGE_SIZE);
+}
+
+// Starts merging count runs from the given one, each of them gets a page of the buffer
+RC startMerge(IndexSort *sort, int first, int count)
+{
+    RC result;
+
+    sort->mergeFirst = first;
+    sort->mergeCount = count;
+    sort->error = RC_OK;
+
+    for (int run = 0; run < count; run++)
+    {
+        sort->mergeRead[run] = 0;
+        if ((result = loadRunPage(sort, run)) != RC_OK)
+            return result;
+    }
+    return RC_OK;
+}
+
+// Copies the smallest entry left in the runs being merged to sort->current, returns NULL once all are read
+char *nextMergedEntry(IndexSort *sort)
+{
+    char *smallest = NULL;
+    int from = -1;
+
+    for (int run = 0; run < sort->mergeCount; run++)
+    {
+        int read = sort->mergeRead[run];
+        if (read == sort->runs[sort->mergeFirst + run].entries)
+            continue;
+
+        char *entry = sort->buffer + (long)run * PAGE_SIZE + (read % sort->perPage) * sort->entrySize;
+        if (smallest == NULL || compareSortEntries(entry, smallest) < 0)
+        {
+            smallest = entry;
+            from = run;
+        }
+    }
+
+    if (smallest == NULL)
+        return NULL;
+
+    memcpy(sort->current, smallest, sort->entrySize);
+
+    // the run moves on to its next page once the entry was the last one of its page
+    sort->mergeRead[from]++;
+    int read = sort->mergeRead[from];
+    if (read % sort->perPage == 0 && read < sort->runs[sort->mergeFirst + from].entries)
+    {
+        RC result = loadRunPage(sort, from);
+        if (result != RC_OK)
+        {
+            sort->error = result;
+            return NULL;
+        }
+    }
+    return sort->current;
+}
+
+// Merges count runs from the given one into a new run, the last page of the buffer collects its entries
+RC mergeIntoRun(IndexSort *sort, int first, int count)
+{
+    RC result = startMerge(sort, first, count);
+    if (result != RC_OK)
+        return result;
+
+    char *output = sort->buffer + (long)(SORT_BUFFER_PAGES - 1) * PAGE_SIZE;
+    int firstPage = sort->filePages;
+    int entries = 0;
+    char *entry;
+
+    while ((entry = nextMergedEntry(sort)) != NULL)
+    {
+        char *slot = output + (entries % sort->perPage) * sort->entrySize;
+
+        // the entry written before is still in the output page, even right after the page went out
+        if (entries > 0 && !sort->duplicates)
+        {
+            char *previous = output + ((entries - 1) % sort->perPage) * sort->entrySize;
+            if (compareSortKeys(sort->keyType, previous + sizeof(RID), entry + sizeof(RID)) == 0)
+                sort->duplicates = 1;
+        }
+
+        memcpy(slot, entry, sort->entrySize);
+        entries++;
+
+        if (entries % sort->perPage == 0 && (result = writeSortPage(sort, output)) != RC_OK)
+            return result;
+    }
+
+    if (sort->error != RC_OK)
+        return sort->error;
+
+    if (entries % sort->perPage != 0 && (result = writeSortPage(sort, output)) != RC_OK)
+        return result;
+
+    addRun(sort, firstPage, entries);
+    return RC_OK;
+}
+
+// Bulk load iterator over the sorted entries, from the buffer or from the final merge of the runs
+RC nextIndexEntry(BT_BulkIterator *iterator, Value *key, RID *rid)
+{
+    IndexSort *sort = iterator->mgmtData;
+    char *entry;
+
+    if (sort->runCount == 0)
+    {
+        if (sort->position == sort->count)
+            return RC_IM_NO_MORE_ENTRIES;
+        entry = sort->buffer + (long)sort->position * sort->entrySize;
+        sort->position++;
+    }
+    else if ((entry = nextMergedEntry(sort)) == NULL)
+    {
+        return sort->error != RC_OK ? sort->error : RC_IM_NO_MORE_ENTRIES;
+    }
+
+    memcpy(rid, entry, sizeof(RID));
+    char *keyData = entry + sizeof(RID);
+    key->dt = sort->keyType;
+
+    if (sort->keyType == DT_STRING)
+        key->v.stringV = keyData;
+    else if (sort->keyType == DT_FLOAT)
+        memcpy(&key->v.floatV, keyData, sizeof(float));
+    else if (sort->keyType == DT_BOOL)
+        memcpy(&key->v.boolV, keyData, sizeof(bool));
+    else
+        memcpy(&key->v.intV, keyData, sizeof(int));
+
+    return RC_OK;
+}
+
+// Reads the key of every record of the table into sorted runs, the table's pages are read once in order
+RC scanTableKeys(RM_TableData *rel, IndexSort *sort)
+{
+    RecordManager *rm = rel->mgmtData;
+    SM_FileHandle fileHandle;
+    BM_PageHandle page;
+    RC result;
+
+    // insertRecord extends the file to every page it puts a record on, so the file holds all pages with records
+    if ((result = openPageFile(rm->bufferPool.pageFile, &fileHandle)) != RC_OK)
+        return result;
+    int totalPages = fileHandle.totalNumPages;
+    closePageFile(&fileHandle);
+
+    int recordSize = getRecordSize(rel->schema);
+    int slotsInPage = PAGE_SIZE / recordSize;
+    int capacity = SORT_BUFFER_PAGES * sort->perPage;
+    int stringKey = sort->keyType == DT_STRING;
+
+    for (int pageNum = 1; pageNum < totalPages; pageNum++)
+    {
+        pinPage(&rm->bufferPool, &page, pageNum);
+
+        for (int slot = 0; slot < slotsInPage; slot++)
+        {
+            char *record = page.data + slot * recordSize;
+            if (*record != '+')
+                continue;
+
+            if (sort->count == capacity && (result = writeRun(sort)) != RC_OK)
+            {
+                unpinPage(&rm->bufferPool, &page);
+                return result;
+            }
+
+            char *entry = sort->buffer + (long)sort->count * sort->entrySize;
+            RID rid = {pageNum, slot};
+            memcpy(entry, &rid, sizeof(RID));
+            memcpy(entry + sizeof(RID), record + sort->keyOffset, sort->keyBytes - stringKey);
+            if (stringKey)
+                entry[sizeof(RID) + sort->keyBytes - 1] = '\0';
+            sort->count++;
+        }
+
+        unpinPage(&rm->bufferPool, &page);
+    }
+
+    // the last run only goes to the file when others are there already, a table that fits is sorted in memory
+    if (sort->runCount > 0 && sort->count > 0)
+        return writeRun(sort);
+    if (sort->runCount == 0)
+        sortBuffer(sort);
+    return RC_OK;
+}
+
+// Builds a new index named idxId over the attribute attrNum of an open table, a unique one fails on a repeated key
+extern RC createIndexOnTable(RM_TableData *rel, int attrNum, char *idxId, bool unique)
+{
+    if (rel == NULL || rel->mgmtData == NULL || idxId == NULL || attrNum < 0 || attrNum >= rel->schema->numAttr)
+        return RC_ERROR;
+
+    IndexSort sort;
+    memset(&sort, 0, sizeof(IndexSort));
+    sort.keyType = rel->schema->dataTypes[attrNum];
+
+    if (sort.keyType == DT_STRING)
+        sort.keyBytes = rel->schema->typeLength[attrNum] + 1;
+    else if (sort.keyType == DT_INT)
+        sort.keyBytes = sizeof(int);
+    else if (sort.keyType == DT_FLOAT)
+        sort.keyBytes = sizeof(float);
+    else if (sort.keyType == DT_BOOL)
+        sort.keyBytes = sizeof(bool);
+    else
+        return RC_RM_UNKOWN_DATATYPE;
+
+    build(rel->schema, attrNum, &sort.keyOffset);
+    sort.entrySize = sizeof(RID) + sort.keyBytes;
+    sort.perPage = PAGE_SIZE / sort.entrySize;
+    if (sort.perPage == 0)
+        return RC_IM_KEY_TOO_LONG;
+
+    sort.buffer = (char *)calloc(SORT_BUFFER_PAGES, PAGE_SIZE);
+    sort.current = (char *)malloc(sort.entrySize);
+    sort.fileName = (char *)malloc(strlen(idxId) + 6);
+    sprintf(sort.fileName, "%s.sort", idxId);
+
+    RC result = scanTableKeys(rel, &sort);
+
+    // merging groups of runs into longer ones until one merge can take all that are left
+    int first = 0;
+    while (result == RC_OK && sort.runCount - first > SORT_BUFFER_PAGES - 1)
+    {
+        result = mergeIntoRun(&sort, first, SORT_BUFFER_PAGES - 1);
+        first += SORT_BUFFER_PAGES - 1;
+    }
+    if (result == RC_OK && sort.runCount > 0)
+        result = startMerge(&sort, first, sort.runCount - first);
+
+    if (result == RC_OK)
+    {
+        BT_BulkIterator iterator = {nextIndexEntry, &sort};
+        DataType keyType = sort.keyType;
+
+        if (unique && sort.duplicates) // the repeated key was seen while sorting, no tree is written
+            result = RC_IM_KEY_ALREADY_EXISTS;
+        else
+        {
+            if (unique)
+                result = bulkLoadCompositeBtree(idxId, 1, &keyType, &iterator, INDEX_BUILD_FILL);
+            else
+                result = bulkLoadNonUniqueBtree(idxId, 1, &keyType, &iterator, INDEX_BUILD_FILL);
+
+            // a bulk load that stopped partway leaves a half written index, it goes like the sort file
+            if (result != RC_OK)
+                deleteBtree(idxId);
+
+            // the merged entries are in order, so the bulk load only finds one out of order where a key repeats
+            if (result == RC_IM_KEYS_NOT_SORTED)
+                result = RC_IM_KEY_ALREADY_EXISTS;
+        }
+    }
+
+    if (sort.runCount > 0)
+    {
+        closePageFile(&sort.fileHandle);
+        destroyPageFile(sort.fileName);
+    }
+    free(sort.buffer);
+    free(sort.current);
+    free(sort.fileName);
+    free(sort.runs);
+    return result;
+}
@@ -43,4 +43,7 @@ extern RC freeRecord (Record *record);
 extern RC getAttr (Record *record, Schema *schema, int attrNum, Value **value);
 extern RC setAttr (Record *record, Schema *schema, int attrNum, Value *value);
 
+// building an index over an attribute of a table, unique or not
+extern RC createIndexOnTable (RM_TableData *rel, int attrNum, char *idxId, bool unique);
+
 #endif // RECORD_MGR_H
@@ -4,17 +4,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-FILE *globalFile;
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+// every call opens its own descriptor, so threads can read and write blocks of the same file at once
+static pthread_mutex_t extendLatch = PTHREAD_MUTEX_INITIALIZER; // one extension of a file at a time
 
 // dummy function, as it has no use we have left it empty
 extern void initStorageManager (){ } // empty as we have no use for this
 
 // creating a single page
 extern RC createPageFile(char *fileName){
-    globalFile=fopen(fileName,"w+"); // open file in read and write mode
+    FILE *file=fopen(fileName,"w+"); // open file in read and write mode
     //printf("File is opened!...........\n");
 
-    if(globalFile==NULL){ // checking whether the file exist or not
+    if(file==NULL){ // checking whether the file exist or not
         //printf("File create failed!........\n");
         return RC_WRITE_FAILED;
     }
@@ -23,7 +29,7 @@ extern RC createPageFile(char *fileName){
     SM_PageHandle newPage=(SM_PageHandle)calloc(PAGE_SIZE,sizeof(char));
 
     if(newPage==NULL){
-        fclose(globalFile); // closing the file as page create failed
+        fclose(file); // closing the file as page create failed
         //printf("Page create failed!.......");
         return RC_WRITE_FAILED;
     }
@@ -31,16 +37,16 @@ extern RC createPageFile(char *fileName){
     //printf("Page is created!......");
 
     //adding the page into the file
-    int writtenBlockSize=fwrite(newPage,sizeof(char),PAGE_SIZE,globalFile);
+    int writtenBlockSize=fwrite(newPage,sizeof(char),PAGE_SIZE,file);
 
     if(writtenBlockSize<PAGE_SIZE){ //out of space in file to write all data
         //printf("Out of space in file!......");
         free(newPage); // remove the allocated memory
-        fclose(globalFile); // close the file
+        fclose(file); // close the file
         return RC_WRITE_FAILED;
     }
 
-    fclose(globalFile); //close the file
+    fclose(file); //close the file
     
     free(newPage); // free the allocated space
    
@@ -49,47 +55,39 @@ extern RC createPageFile(char *fileName){
 
 // opening page file
 extern RC openPageFile(char *fileName, SM_FileHandle *fHandle){ 
-    globalFile=fopen(fileName,"r"); // opening the a binary file in read and write mode
-    
-    if(globalFile==NULL){ // check whether the file exist or not
+    struct stat info;
+
+    // the file is only looked up, no stream is opened, so a pin that misses the pool allocates nothing
+    if(stat(fileName,&info)<0){ // check whether the file exist or not
         //printf("File not found!");
         return RC_FILE_NOT_FOUND;
     }
 
-    struct stat info;
-    int stat=fstat(fileno(globalFile),&info); // getting file info
-
-    if(stat<0) return RC_ERROR; // checking whether info is found
-
     //setting other metadata
     fHandle->totalNumPages=info.st_size/PAGE_SIZE; // setting total page size
     fHandle->fileName=fileName; // setting file name
     fHandle->curPagePos=0; // setting current position
 
-    fclose(globalFile);
-
     return RC_OK;
 }
 
 //closing page file
 extern RC closePageFile(SM_FileHandle *fHandle){
-  
-    if(globalFile!=NULL) // check if file is present
-        globalFile=NULL; // if exist, setting it to NULL
+    (void)fHandle; // nothing stays open between calls
     return RC_OK;
 }
 
 //delete page file
 extern RC destroyPageFile(char *fileName){
     
-    globalFile=fopen(fileName,"r"); // opening the file in read mode, to check its existence 
+    FILE *file=fopen(fileName,"r"); // opening the file in read mode, to check its existence 
     
-    if(globalFile==NULL){
+    if(file==NULL){
         //printf("File Destroy: file not found!");
         return RC_FILE_NOT_FOUND;
     }
 
-    if(fclose(globalFile)==0){ // checking whether the file is closed
+    if(fclose(file)==0){ // checking whether the file is closed
         //printf("file closed\n");
         remove(fileName); // deleting the file
     }
@@ -110,31 +108,105 @@ extern RC readBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage)
         return RC_READ_NON_EXISTING_PAGE;
     }
 
-    // Get the file
-   globalFile = fopen(fHandle->fileName,"r");
+    // Get the file, a descriptor rather than a stream, which would allocate its buffer
+    int fd = open(fHandle->fileName, O_RDONLY);
+    if(fd < 0) {
+        return RC_FILE_NOT_FOUND;
+    }
 
     // Get the position of the file to begin the read
     long pos = (long) pageNum * PAGE_SIZE;
 
-    // Check if the read position is in right direction
-    if(fseek(globalFile,pos,SEEK_SET) != 0) {
-        return RC_READ_NON_EXISTING_PAGE;
-    }
-
     // add the read page data into mempage
-    size_t bRead = fread(memPage, sizeof(char), PAGE_SIZE, globalFile);
+    ssize_t bRead = pread(fd, memPage, PAGE_SIZE, pos);
+    close(fd);
 
     //printf("An error occured when attempting read");
-    if(bRead<PAGE_SIZE) return RC_READ_NON_EXISTING_PAGE; // checking if the file is read
+    if(bRead<PAGE_SIZE){ // checking if the file is read
+        return RC_READ_NON_EXISTING_PAGE;
+    }
 
     // Update the read page position in the file handle
-    fHandle->curPagePos = ftell(globalFile);
+    fHandle->curPagePos = pos + PAGE_SIZE;
+
+    return RC_OK;
+}
+
+// reading count consecutive blocks into the given pages with one read, the pages need not be next to each other
+extern RC readBlocks(int pageNum, int count, SM_FileHandle *fHandle, SM_PageHandle *memPages) {
+
+    if(pageNum < 0 || count <= 0 || pageNum + count > fHandle->totalNumPages) {
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+
+    int fd = open(fHandle->fileName, O_RDONLY);
+    if(fd < 0) {
+        return RC_FILE_NOT_FOUND;
+    }
+
+    // 64 blocks per read, a longer run takes several
+    RC rc = RC_OK;
+    struct iovec blocks[64];
+    for(int done = 0; done < count && rc == RC_OK; ) {
+        int run = count - done < 64 ? count - done : 64;
+        for(int index = 0; index < run; index++) {
+            blocks[index].iov_base = memPages[done + index];
+            blocks[index].iov_len = PAGE_SIZE;
+        }
+        ssize_t bRead = preadv(fd, blocks, run, (off_t) (pageNum + done) * PAGE_SIZE);
+        if(bRead < (ssize_t) run * PAGE_SIZE) {
+            rc = RC_READ_NON_EXISTING_PAGE;
+        }
+        done += run;
+    }
+    close(fd);
+
+    if(rc == RC_OK) {
+        fHandle->curPagePos = (pageNum + count) * PAGE_SIZE;
+    }
+    return rc;
+}
+
+// asking the operating system to read blocks ahead, the call does not wait for the reads
+extern RC prefetchBlocks(int *pageNums, int count, SM_FileHandle *fHandle) {
+
+#ifdef POSIX_FADV_WILLNEED
+    int fd = open(fHandle->fileName, O_RDONLY);
+    if(fd < 0) {
+        return RC_FILE_NOT_FOUND;
+    }
 
-    fclose(globalFile);
+    // runs of consecutive blocks are hinted as one range
+    int index = 0;
+    while(index < count) {
+        int first = pageNums[index], last = first;
+        index++;
+        while(index < count && pageNums[index] == last + 1) {
+            last = pageNums[index++];
+        }
+        if(first >= 0 && last < fHandle->totalNumPages) {
+            posix_fadvise(fd, (off_t) first * PAGE_SIZE, (off_t) (last - first + 1) * PAGE_SIZE, POSIX_FADV_WILLNEED);
+        }
+    }
+    close(fd);
+#endif
 
     return RC_OK;
 }
 
+// making the blocks written so far durable, the operating system may still hold them in its cache
+extern RC syncPageFile(SM_FileHandle *fHandle) {
+
+    int fd = open(fHandle->fileName, O_WRONLY);
+    if(fd < 0) {
+        return RC_FILE_NOT_FOUND;
+    }
+    int synced = fsync(fd);
+    close(fd);
+
+    return synced == 0 ? RC_OK : RC_WRITE_FAILED;
+}
+
 // get a block position
 extern RC getBlockPos(SM_FileHandle *fHandle) {
     // Gets the block position in the fHandle
@@ -180,32 +252,18 @@ extern RC writeBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage)
         return RC_READ_NON_EXISTING_PAGE;
     }
 
-    globalFile=fopen(fHandle->fileName,"r+"); // open the file
+    int fd=open(fHandle->fileName,O_WRONLY); // open the file
+    if(fd<0) return RC_FILE_NOT_FOUND;
 
     /*Calculating the sum to required page*/
-    int sum = pageNum * PAGE_SIZE;
+    long sum = (long) pageNum * PAGE_SIZE;
 
-    if(pageNum!=0){ // if page number is not zero
-        fHandle->curPagePos=sum; // setting the page position
-        fclose(globalFile); // closing the file
-        writeCurrentBlock(fHandle,memPage); // writing the block
-    }
-    else{ // if it's the first page
-        if(fseek(globalFile, sum, SEEK_SET) != 0) // seek the pointer 
-        {
-            fclose(globalFile);
-            return RC_WRITE_FAILED;
-        }
+    ssize_t written = pwrite(fd,memPage,PAGE_SIZE,sum); // writting the whole page, a write at the end of the file appends the block
+    close(fd); // close the file
+    if(written<PAGE_SIZE) return RC_WRITE_FAILED;
 
-        /*Writing data from memPage to file*/   
-        for(int i=0;i<PAGE_SIZE;i++){
-            if(feof(globalFile)) appendEmptyBlock(fHandle);
-            fputc(memPage[i],globalFile);
-        }
-
-        fHandle->curPagePos=ftell(globalFile); // update the position in page handler
-        fclose(globalFile); // close the file
-    }
+    fHandle->curPagePos=sum+PAGE_SIZE; // update the position in page handler
+    if(pageNum==fHandle->totalNumPages) fHandle->totalNumPages++; // the block was appended
 
     return RC_OK;
 }
@@ -213,55 +271,50 @@ extern RC writeBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage)
 // write in the current block
 extern RC writeCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage)
 {
-    globalFile=fopen(fHandle->fileName,"r+"); // opening the file in read and write mode
+    // appending empty blocks only when the write goes past the end of the file
+    if(fHandle->curPagePos / PAGE_SIZE > fHandle->totalNumPages)
+        ensureCapacity(fHandle->curPagePos / PAGE_SIZE, fHandle);
 
-    if(globalFile!=NULL){ // if file exist
-
-        appendEmptyBlock(fHandle); // appending empty block
-
-        fseek(globalFile,fHandle->curPagePos,SEEK_SET); // seeking the pointer in the file
-
-        fwrite(memPage,sizeof(char),strlen(memPage),globalFile); // writting the data
-
-        fHandle->curPagePos=ftell(globalFile); // updating the postion
-
-        fclose(globalFile); // closing the file
-
-        return RC_OK;
-    }
-    return RC_FILE_NOT_FOUND; // if file not found
+    return writeBlock(fHandle->curPagePos / PAGE_SIZE, fHandle, memPage);
 }
 
 // appending empty block
 extern RC appendEmptyBlock (SM_FileHandle *fHandle)
 {
-
-    SM_PageHandle newblock = (SM_PageHandle)calloc(PAGE_SIZE,sizeof(char)); // allocation memory for new block
-
-    if(fseek(globalFile,0,SEEK_END) != 0){ // moving the pointer
-        free(newblock);
-        return RC_WRITE_FAILED; // if there is issue in writting the file
-    }
-    else{
-        fwrite(newblock,sizeof(char),PAGE_SIZE,globalFile); // empty block is created
-    }
-
-    free(newblock);
-    fHandle->totalNumPages++; // updating the total page number
-    return RC_OK;
-
+    return ensureCapacity(fHandle->totalNumPages+1, fHandle);
 }
 
 // checking the capacity
 extern RC ensureCapacity (int numberOfPages, SM_FileHandle *fHandle)
 {
+    RC rc=RC_OK;
 
-    globalFile=fopen(fHandle->fileName,"a"); // opening the file and pointer position will at EOF if there is any data
+    pthread_mutex_lock(&extendLatch);
+    FILE *file=fopen(fHandle->fileName,"a"); // opening the file and pointer position will at EOF if there is any data
+    if(file==NULL){
+        pthread_mutex_unlock(&extendLatch);
+        return RC_FILE_NOT_FOUND;
+    }
 
-    while(numberOfPages>fHandle->totalNumPages) // if the given page number is less than total page number, adding blocks till they become unequal
-        appendEmptyBlock(fHandle);
-    
-    fclose(globalFile); // closing the file
+    // another handle may have extended the file already, so the blocks are counted on the file itself
+    struct stat info;
+    if(fstat(fileno(file),&info)<0){
+        fclose(file);
+        pthread_mutex_unlock(&extendLatch);
+        return RC_ERROR;
+    }
+    int pages=info.st_size/PAGE_SIZE;
 
-    return RC_OK;
-}
\ No newline at end of file
+    SM_PageHandle newblock = (SM_PageHandle)calloc(PAGE_SIZE,sizeof(char)); // allocation memory for new block
+    while(numberOfPages>pages && rc==RC_OK){ // adding blocks till the file holds the given number of pages
+        if(fwrite(newblock,sizeof(char),PAGE_SIZE,file)<PAGE_SIZE) rc=RC_WRITE_FAILED;
+        else pages++;
+    }
+    free(newblock);
+
+    fclose(file); // closing the file
+    pthread_mutex_unlock(&extendLatch);
+
+    if(pages>fHandle->totalNumPages) fHandle->totalNumPages=pages; // updating the total page number
+    return rc;
+}
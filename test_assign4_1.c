@@ -1,8 +1,17 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "dberror.h"
 #include "expr.h"
 #include "btree_mgr.h"
+#include "buffer_mgr.h"
+#include "storage_mgr.h"
+#include "record_mgr.h"
 #include "tables.h"
 #include "test_helper.h"
 
@@ -15,11 +24,69 @@
 static void testInsertAndFind (void);
 static void testDelete (void);
 static void testIndexScan (void);
+static void testBulkLoad (void);
+static void testRangeScan (void);
+static void testLargeScan (void);
+static void testDeleteShrinks (void);
+static void testTwoIndexes (void);
+static void testConcurrentAccess (void);
+static void testBatchInsert (void);
+static void testBatchLookup (void);
+static void testCrashRecovery (void);
+static void testStringKeys (void);
+static void testCompositeKeys (void);
+static void testNonUniqueKeys (void);
+static void testIntSearch (void);
+static void testBlockedLayout (void);
+static void testInnerNodeCache (void);
+static void testFrameChanges (void);
+static void testShortSeparators (void);
+static void testFreePageList (void);
+static void testTreeStats (void);
+static void testIndexOnTable (void);
+static void testIndexOnlyScan (void);
+static void testDescendingScan (void);
+static void testStringBulkLoad (void);
+static void testFailedPageIO (void);
 
 // helper methods
 static Value **createValues (char **stringVals, int size);
 static void freeValues (Value **vals, int size);
 static int *createPermutation (int size);
+static RC nextBulkEntry (BT_BulkIterator *iterator, Value *key, RID *rid);
+static RC nextStatusEntry (BT_BulkIterator *iterator, Value *key, RID *rid);
+static RC nextMixedEntry (BT_BulkIterator *iterator, Value *key, RID *rid);
+static int countRange (BTreeHandle *tree, Value *lo, Value *hi, int flags, int first);
+static void *concurrentWriter (void *arg);
+static void *concurrentReader (void *arg);
+static void *concurrentScanner (void *arg);
+static void *concurrentBatcher (void *arg);
+static void copyFile (char *from, char *to);
+static void stringKey (char *buffer, int k);
+
+// sorted input for the bulk loader: key i*3 maps to RID (i/50+1, i%50)
+typedef struct BulkInput {
+  int pos;
+  int size;
+} BulkInput;
+
+// sorted string input for the bulk loader: longKeys keys of 250 bytes, then short ones, entry i maps to RID (i+1, i%7)
+typedef struct MixedInput {
+  int pos;
+  int size;
+  int longKeys;
+  char key[BT_MAX_KEY_LENGTH + 1];
+} MixedInput;
+
+// work of one thread in the concurrency test: key k always maps to RID (k+1, k%7)
+typedef struct ThreadWork {
+  BTreeHandle *tree;
+  int first;
+  int step;
+  int size;
+  int delete;
+  int errors;
+} ThreadWork;
 
 // test name
 char *testName;
@@ -33,6 +100,30 @@ main (void)
   testInsertAndFind();
   testDelete();
   testIndexScan();
+  testBulkLoad();
+  testRangeScan();
+  testLargeScan();
+  testDeleteShrinks();
+  testTwoIndexes();
+  testConcurrentAccess();
+  testBatchInsert();
+  testBatchLookup();
+  testCrashRecovery();
+  testStringKeys();
+  testCompositeKeys();
+  testNonUniqueKeys();
+  testIntSearch();
+  testBlockedLayout();
+  testInnerNodeCache();
+  testFrameChanges();
+  testShortSeparators();
+  testFreePageList();
+  testTreeStats();
+  testIndexOnTable();
+  testIndexOnlyScan();
+  testDescendingScan();
+  testStringBulkLoad();
+  testFailedPageIO();
 
   return 0;
 }
@@ -266,25 +357,2366 @@ testIndexScan (void)
 }
 
 // ************************************************************ 
-int *
-createPermutation (int size)
+void
+testBulkLoad (void)
 {
-  int *result = (int *) malloc(size * sizeof(int));
-  int i;
+  int numKeys = 5000;
+  BulkInput input = { 0, numKeys };
+  BT_BulkIterator iter = { nextBulkEntry, &input };
 
-  for(i = 0; i < size; result[i] = i, i++);
+  testName = "bulk loading sorted keys";
+  int i, testint, rc;
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  RID rid;
 
-  for(i = 0; i < 100; i++)
+  // init
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(bulkLoadBtree("testidx", DT_INT, &iter, 0.7));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+
+  // check index stats
+  TEST_CHECK(getNumEntries(tree, &testint));
+  ASSERT_EQUALS_INT(numKeys, testint, "number of entries in btree");
+
+  // search for keys
+  for(i = 0; i < 1000; i++)
     {
-      int l, r, temp;
-      l = rand() % size;
-      r = rand() % size;
-      temp = result[l];
-      result[l] = result[r];
-      result[r] = temp;
+      int pos = rand() % numKeys;
+      Value key;
+      key.dt = DT_INT;
+      key.v.intV = pos * 3;
+
+      TEST_CHECK(findKey(tree, &key, &rid));
+      ASSERT_TRUE(rid.page == pos / 50 + 1 && rid.slot == pos % 50, "did we find the correct RID?");
+
+      key.v.intV = pos * 3 + 1;
+      ASSERT_TRUE(findKey(tree, &key, &rid) == RC_IM_KEY_NOT_FOUND, "key between loaded keys is not found");
     }
-  
-  return result;
+
+  // a scan returns the entries in load order
+  TEST_CHECK(openTreeScan(tree, &sc));
+  i = 0;
+  while((rc = nextEntry(sc, &rid)) == RC_OK)
+    {
+      if (rid.page != i / 50 + 1 || rid.slot != i % 50)
+        break;
+      i++;
+    }
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "scan ran to the end in key order");
+  ASSERT_EQUALS_INT(numKeys, i, "have seen all entries");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testRangeScan (void)
+{
+  int numInserts = 30;
+  int i, *permute;
+  BTreeHandle *tree = NULL;
+  Value lo, hi;
+
+  testName = "range scans with lower and upper bounds";
+  lo.dt = hi.dt = DT_INT;
+
+  // init, keys 0,2,...,58 in random order
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_INT, 2));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+
+  permute = createPermutation(numInserts);
+  for(i = 0; i < numInserts; i++)
+    {
+      Value key;
+      RID rid = { permute[i] + 1, permute[i] % 7 };
+      key.dt = DT_INT;
+      key.v.intV = permute[i] * 2;
+      TEST_CHECK(insertKey(tree, &key, rid));
+    }
+
+  lo.v.intV = 10;
+  hi.v.intV = 20;
+  ASSERT_EQUALS_INT(6, countRange(tree, &lo, &hi, BT_LOWER_INCLUSIVE | BT_UPPER_INCLUSIVE, 5), "inclusive range");
+  ASSERT_EQUALS_INT(4, countRange(tree, &lo, &hi, 0, 6), "exclusive range");
+  lo.v.intV = 9;
+  hi.v.intV = 21;
+  ASSERT_EQUALS_INT(6, countRange(tree, &lo, &hi, 0, 5), "bounds between keys");
+  hi.v.intV = 7;
+  ASSERT_EQUALS_INT(4, countRange(tree, NULL, &hi, BT_UPPER_INCLUSIVE, 0), "open lower bound");
+  lo.v.intV = 51;
+  ASSERT_EQUALS_INT(4, countRange(tree, &lo, NULL, BT_LOWER_INCLUSIVE, 26), "open upper bound");
+  ASSERT_EQUALS_INT(numInserts, countRange(tree, NULL, NULL, 0, 0), "unbounded range");
+  lo.v.intV = 100;
+  ASSERT_EQUALS_INT(0, countRange(tree, &lo, NULL, BT_LOWER_INCLUSIVE, 0), "range past the last key");
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testLargeScan (void)
+{
+  int numInserts = 1000;
+  int i, rc, *permute;
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  RID rid;
+
+  testName = "full scan over many leaves";
+
+  // init, with n = 2 the tree ends up with far more than 100 leaves
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_INT, 2));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+
+  permute = createPermutation(numInserts);
+  for(i = 0; i < numInserts; i++)
+    {
+      Value key;
+      RID r = { permute[i] + 1, permute[i] % 7 };
+      key.dt = DT_INT;
+      key.v.intV = permute[i];
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+
+  // the scan follows the sibling links, so every entry comes back in key order
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(i = 0; (rc = nextEntry(sc, &rid)) == RC_OK; i++)
+    {
+      RID expRid = { i + 1, i % 7 };
+      ASSERT_EQUALS_RID(expRid, rid, "scan returns the entries in key order");
+    }
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "scan ends cleanly");
+  ASSERT_EQUALS_INT(numInserts, i, "scan visits every entry");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testDeleteShrinks (void)
+{
+  int numInserts = 500;
+  int i, nodes, grownNodes, entries, *permute;
+  BTreeHandle *tree = NULL;
+  Value key;
+  RID rid;
+
+  testName = "deletes merge nodes and reuse their pages";
+  key.dt = DT_INT;
+
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_INT, 2));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+
+  permute = createPermutation(numInserts);
+  for(i = 0; i < numInserts; i++)
+    {
+      RID r = { permute[i] + 1, permute[i] % 7 };
+      key.v.intV = permute[i];
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+  TEST_CHECK(getNumNodes(tree, &grownNodes));
+
+  // delete all but every tenth key in random order
+  for(i = 0; i < numInserts; i++)
+    if (permute[i] % 10 != 0)
+      {
+        key.v.intV = permute[i];
+        TEST_CHECK(deleteKey(tree, &key));
+      }
+  TEST_CHECK(getNumEntries(tree, &entries));
+  ASSERT_EQUALS_INT(numInserts / 10, entries, "entries are counted down");
+  TEST_CHECK(getNumNodes(tree, &nodes));
+  ASSERT_TRUE(nodes < grownNodes / 4, "merges give nodes back");
+
+  for(i = 0; i < numInserts; i++)
+    {
+      key.v.intV = i;
+      if (i % 10 == 0)
+        {
+          RID expRid = { i + 1, i % 7 };
+          TEST_CHECK(findKey(tree, &key, &rid));
+          ASSERT_EQUALS_RID(expRid, rid, "remaining keys survive the merges");
+        }
+      else
+        ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(tree, &key, &rid), "deleted keys are gone");
+    }
+
+  // deleting the rest leaves a single empty root leaf
+  for(i = 0; i < numInserts; i += 10)
+    {
+      key.v.intV = i;
+      TEST_CHECK(deleteKey(tree, &key));
+    }
+  TEST_CHECK(getNumNodes(tree, &nodes));
+  ASSERT_EQUALS_INT(1, nodes, "tree shrinks down to its root");
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testTwoIndexes (void)
+{
+  int numInserts = 200;
+  int i, rc1, rc2, entries;
+  BTreeHandle *primary = NULL, *secondary = NULL;
+  BT_ScanHandle *sc1 = NULL, *sc2 = NULL;
+  Value key;
+  RID rid1, rid2;
+
+  testName = "two indexes open at the same time";
+  key.dt = DT_INT;
+
+  // both trees are filled in turns, neither may see the other's entries,
+  // the second one has a pool that holds all of its pages
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_INT, 2));
+  TEST_CHECK(createBtree("testidx2", DT_INT, 3));
+  TEST_CHECK(openBtree(&primary, "testidx"));
+  TEST_CHECK(openBtreeWithPoolSize(&secondary, "testidx2", 256));
+
+  for(i = 0; i < numInserts; i++)
+    {
+      RID r1 = { i + 1, i % 7 };
+      RID r2 = { numInserts - i, i % 5 };
+      key.v.intV = i;
+      TEST_CHECK(insertKey(primary, &key, r1));
+      key.v.intV = -i;
+      TEST_CHECK(insertKey(secondary, &key, r2));
+    }
+  TEST_CHECK(getNumEntries(primary, &entries));
+  ASSERT_EQUALS_INT(numInserts, entries, "first index counts its own entries");
+  TEST_CHECK(getNumEntries(secondary, &entries));
+  ASSERT_EQUALS_INT(numInserts, entries, "second index counts its own entries");
+  key.v.intV = -5;
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(primary, &key, &rid1), "keys do not leak between indexes");
+
+  // one scan on each tree, advanced in lockstep
+  TEST_CHECK(openTreeScan(primary, &sc1));
+  TEST_CHECK(openTreeScan(secondary, &sc2));
+  for(i = 0; (rc1 = nextEntry(sc1, &rid1)) == RC_OK && (rc2 = nextEntry(sc2, &rid2)) == RC_OK; i++)
+    {
+      RID exp1 = { i + 1, i % 7 };
+      RID exp2 = { i + 1, (numInserts - 1 - i) % 5 };
+      ASSERT_EQUALS_RID(exp1, rid1, "first scan keeps its position");
+      ASSERT_EQUALS_RID(exp2, rid2, "second scan keeps its position");
+    }
+  ASSERT_EQUALS_INT(numInserts, i, "both scans see every entry");
+  TEST_CHECK(closeTreeScan(sc1));
+  TEST_CHECK(closeTreeScan(sc2));
+
+  // cleanup
+  TEST_CHECK(closeBtree(primary));
+  TEST_CHECK(closeBtree(secondary));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(deleteBtree("testidx2"));
+  TEST_CHECK(shutdownIndexManager());
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testConcurrentAccess (void)
+{
+  int numKeys = 2000, numWriters = 4, numReaders = 2;
+  int i, rc, entries, count;
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  pthread_t threads[8];
+  ThreadWork work[8];
+  RID rid;
+
+  testName = "concurrent inserts, deletes, lookups and scans";
+
+  // a small fanout makes the writers split and merge all the time
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_INT, 4));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+
+  // writers insert interleaved keys while readers look them up and a scanner checks the order
+  for(i = 0; i < numWriters + numReaders + 1; i++)
+    {
+      work[i].tree = tree;
+      work[i].first = i;
+      work[i].step = numWriters;
+      work[i].size = numKeys;
+      work[i].delete = 0;
+      work[i].errors = 0;
+      if (i < numWriters)
+        pthread_create(&threads[i], NULL, concurrentWriter, &work[i]);
+      else if (i < numWriters + numReaders)
+        pthread_create(&threads[i], NULL, concurrentReader, &work[i]);
+      else
+        pthread_create(&threads[i], NULL, concurrentScanner, &work[i]);
+    }
+  for(i = 0; i < numWriters + numReaders + 1; i++)
+    {
+      pthread_join(threads[i], NULL);
+      ASSERT_EQUALS_INT(0, work[i].errors, "thread saw a consistent tree while inserting");
+    }
+  TEST_CHECK(getNumEntries(tree, &entries));
+  ASSERT_EQUALS_INT(numKeys, entries, "every concurrent insert is counted");
+
+  // the same again with writers deleting all keys that are not a multiple of five
+  for(i = 0; i < numWriters + numReaders + 1; i++)
+    {
+      work[i].delete = 1;
+      work[i].errors = 0;
+      if (i < numWriters)
+        pthread_create(&threads[i], NULL, concurrentWriter, &work[i]);
+      else if (i < numWriters + numReaders)
+        pthread_create(&threads[i], NULL, concurrentReader, &work[i]);
+      else
+        pthread_create(&threads[i], NULL, concurrentScanner, &work[i]);
+    }
+  for(i = 0; i < numWriters + numReaders + 1; i++)
+    {
+      pthread_join(threads[i], NULL);
+      ASSERT_EQUALS_INT(0, work[i].errors, "thread saw a consistent tree while deleting");
+    }
+  TEST_CHECK(getNumEntries(tree, &entries));
+  ASSERT_EQUALS_INT(numKeys / 5, entries, "every concurrent delete is counted");
+
+  // exactly the multiples of five are left, in order
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    {
+      RID expRid = { count * 5 + 1, (count * 5) % 7 };
+      ASSERT_EQUALS_RID(expRid, rid, "remaining entries are in key order");
+    }
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "scan ends cleanly");
+  ASSERT_EQUALS_INT(numKeys / 5, count, "scan sees every remaining entry");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testBatchInsert (void)
+{
+  int numKeys = 1000, batchSize = 250;
+  int i, rc, entries, count, *permute;
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  Value *keys, key;
+  RID *rids, rid;
+
+  testName = "batched inserts";
+  key.dt = DT_INT;
+
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_INT, 2));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+
+  // a few keys are already there before the batches arrive
+  for(i = 0; i < numKeys; i += 100)
+    {
+      RID r = { i + 1, i % 7 };
+      key.v.intV = i;
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+
+  // unsorted batches, each one also repeats one of its keys
+  permute = createPermutation(numKeys);
+  keys = (Value *) malloc((batchSize + 1) * sizeof(Value));
+  rids = (RID *) malloc((batchSize + 1) * sizeof(RID));
+  for(i = 0; i < numKeys; i += batchSize)
+    {
+      int j;
+      for(j = 0; j < batchSize; j++)
+        {
+          int k = permute[i + j];
+          keys[j].dt = DT_INT;
+          keys[j].v.intV = k;
+          rids[j].page = k + 1;
+          rids[j].slot = k % 7;
+        }
+      keys[batchSize] = keys[0];
+      rids[batchSize].page = -1;
+      rids[batchSize].slot = -1;
+      ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, insertKeys(tree, keys, rids, batchSize + 1), "repeated and existing keys are reported");
+    }
+  TEST_CHECK(getNumEntries(tree, &entries));
+  ASSERT_EQUALS_INT(numKeys, entries, "every new key of the batches is counted once");
+
+  for(i = 0; i < numKeys; i++)
+    {
+      RID expRid = { i + 1, i % 7 };
+      key.v.intV = i;
+      TEST_CHECK(findKey(tree, &key, &rid));
+      ASSERT_EQUALS_RID(expRid, rid, "batched keys keep their RID");
+    }
+
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    {
+      RID expRid = { count + 1, count % 7 };
+      ASSERT_EQUALS_RID(expRid, rid, "leaves split by batches stay in order");
+    }
+  ASSERT_EQUALS_INT(numKeys, count, "scan sees every batched entry");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // a sorted batch into an empty tree splits the root leaf into many pieces at once
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(createBtree("testidx", DT_INT, 3));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  for(i = 0; i < batchSize; i++)
+    {
+      keys[i].dt = DT_INT;
+      keys[i].v.intV = i * 2;
+      rids[i].page = i + 1;
+      rids[i].slot = i % 7;
+    }
+  TEST_CHECK(insertKeys(tree, keys, rids, batchSize));
+  key.v.intV = 101;
+  TEST_CHECK(insertKey(tree, &key, rids[0]));
+  key.v.intV = 100;
+  TEST_CHECK(findKey(tree, &key, &rid));
+  ASSERT_EQUALS_RID(rids[50], rid, "tree built from one batch takes single inserts");
+  TEST_CHECK(getNumEntries(tree, &entries));
+  ASSERT_EQUALS_INT(batchSize + 1, entries, "sorted batch is counted");
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+
+  // interleaved batches from several threads split the same leaves and parents
+  TEST_CHECK(createBtree("testidx", DT_INT, 3));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  {
+    pthread_t threads[4];
+    ThreadWork work[4];
+    for(i = 0; i < 4; i++)
+      {
+        work[i].tree = tree;
+        work[i].first = i;
+        work[i].step = 4;
+        work[i].size = 4 * numKeys;
+        work[i].delete = 0;
+        work[i].errors = 0;
+        pthread_create(&threads[i], NULL, concurrentBatcher, &work[i]);
+      }
+    for(i = 0; i < 4; i++)
+      {
+        pthread_join(threads[i], NULL);
+        ASSERT_EQUALS_INT(0, work[i].errors, "every batch of the thread went in");
+      }
+  }
+  TEST_CHECK(getNumEntries(tree, &entries));
+  ASSERT_EQUALS_INT(4 * numKeys, entries, "concurrent batches are counted");
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    {
+      RID expRid = { count + 1, count % 7 };
+      ASSERT_EQUALS_RID(expRid, rid, "leaves split by concurrent batches stay in order");
+    }
+  ASSERT_EQUALS_INT(4 * numKeys, count, "scan sees every concurrently batched entry");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+  free(keys);
+  free(rids);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testBatchLookup (void)
+{
+  int numKeys = 20000, batchSize = 500;
+  int i, *permute;
+  BTreeHandle *tree = NULL;
+  BT_BulkIterator iterator;
+  BulkInput input;
+  Value *keys;
+  RID *rids;
+  RC *rcs;
+
+  testName = "batched lookups";
+
+  // keys 0, 3, 6, .. 3 * (numKeys - 1) are in the tree, all others are missing,
+  // the leaves take several batches of pins through the 10 frames of the pool
+  TEST_CHECK(initIndexManager(NULL));
+  iterator.next = nextBulkEntry;
+  input.pos = 0;
+  input.size = numKeys;
+  iterator.mgmtData = &input;
+  TEST_CHECK(bulkLoadBtree("testidx", DT_INT, &iterator, 3));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+
+  // unsorted probes, both present and missing, some asked for twice and some past the last key
+  permute = createPermutation(batchSize);
+  keys = (Value *) malloc(batchSize * sizeof(Value));
+  rids = (RID *) malloc(batchSize * sizeof(RID));
+  rcs = (RC *) malloc(batchSize * sizeof(RC));
+  for(i = 0; i < batchSize; i++)
+    {
+      keys[i].dt = DT_INT;
+      keys[i].v.intV = permute[i] * 13 % (3 * numKeys + 100);
+    }
+  keys[batchSize - 1] = keys[0];
+  TEST_CHECK(findKeys(tree, keys, rids, rcs, batchSize));
+
+  for(i = 0; i < batchSize; i++)
+    {
+      int k = keys[i].v.intV;
+      if (k % 3 == 0 && k < 3 * numKeys)
+        {
+          RID expRid = { k / 3 / 50 + 1, k / 3 % 50 };
+          ASSERT_EQUALS_INT(RC_OK, rcs[i], "present key is found in the batch");
+          ASSERT_EQUALS_RID(expRid, rids[i], "batched lookup returns the key's RID");
+        }
+      else
+        ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, rcs[i], "missing key is reported per probe");
+    }
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+  free(keys);
+  free(rids);
+  free(rcs);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testCrashRecovery (void)
+{
+  int numKeys = 600;
+  int i, rc, entries, count, *permute;
+  int unfinished[5] = { 2, 1000000, 1, 0, PAGE_SIZE }; // a change of the whole page 1
+  char *garbage;
+  BTreeHandle *tree = NULL, *recovered = NULL;
+  BT_ScanHandle *sc = NULL;
+  Value key;
+  RID rid;
+  FILE *log;
+
+  testName = "recovery from the log";
+  key.dt = DT_INT;
+
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_INT, 4));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  ASSERT_EQUALS_INT(RC_ERROR, setDurability(tree, 7), "unknown durability level is rejected");
+
+  // the pool holds only a few pages, so most of the splits and merges never reach the index file
+  permute = createPermutation(numKeys);
+  for(i = 0; i < numKeys; i++)
+    {
+      RID r = { permute[i] + 1, permute[i] % 7 };
+      key.v.intV = permute[i];
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+  TEST_CHECK(setDurability(tree, BT_DURABILITY_ASYNC));
+  for(i = 0; i < numKeys; i += 3)
+    {
+      key.v.intV = i;
+      TEST_CHECK(deleteKey(tree, &key));
+    }
+  TEST_CHECK(flushBtree(tree));
+
+  // a crash leaves the index file and the log as they are, copying both while the tree is open does the same
+  copyFile("testidx", "crashidx");
+  copyFile("testidx.wal", "crashidx.wal");
+
+  // an operation that never committed and a record cut short are appended to the log
+  garbage = (char *) malloc(PAGE_SIZE);
+  memset(garbage, 0xff, PAGE_SIZE);
+  log = fopen("crashidx.wal", "ab");
+  fwrite(unfinished, sizeof(int), 5, log);
+  fwrite(garbage, 1, PAGE_SIZE, log);
+  fwrite(unfinished, sizeof(int), 5, log);
+  fwrite(garbage, 1, 100, log);
+  fclose(log);
+  free(garbage);
+
+  TEST_CHECK(openBtree(&recovered, "crashidx"));
+  TEST_CHECK(getNumEntries(recovered, &entries));
+  ASSERT_EQUALS_INT(numKeys - numKeys / 3, entries, "entries are recounted after recovery");
+  for(i = 0; i < numKeys; i++)
+    {
+      key.v.intV = i;
+      if (i % 3 == 0)
+        ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(recovered, &key, &rid), "deleted key stays deleted");
+      else
+        {
+          RID expRid = { i + 1, i % 7 };
+          TEST_CHECK(findKey(recovered, &key, &rid));
+          ASSERT_EQUALS_RID(expRid, rid, "committed key is recovered");
+        }
+    }
+
+  // the recovered tree takes new changes and keeps them over a clean close
+  key.v.intV = 0;
+  TEST_CHECK(insertKey(recovered, &key, rid));
+  TEST_CHECK(closeBtree(recovered));
+  ASSERT_TRUE(fopen("crashidx.wal", "rb") == NULL, "clean close leaves no log");
+  TEST_CHECK(openBtree(&recovered, "crashidx"));
+  TEST_CHECK(openTreeScan(recovered, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++);
+  ASSERT_EQUALS_INT(numKeys - numKeys / 3 + 1, count, "leaves are linked after recovery");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // cleanup
+  TEST_CHECK(closeBtree(recovered));
+  TEST_CHECK(deleteBtree("crashidx"));
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testStringKeys (void)
+{
+  int numKeys = 3000, batchSize = 500;
+  int i, k, nodes, grownNodes, entries, count, last, *permute;
+  char name[64], lo[64], hi[64], tooLong[BT_MAX_KEY_LENGTH + 2];
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  Value key, loKey, hiKey, *keys;
+  RID rid, *rids;
+  RC rc, *rcs;
+
+  testName = "string keys with shared prefixes";
+  key.dt = DT_STRING;
+  key.v.stringV = name;
+
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_STRING, 0));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+
+  // key k maps to RID (k+1, k%7)
+  permute = createPermutation(numKeys);
+  for(i = 0; i < numKeys; i++)
+    {
+      RID r = { permute[i] + 1, permute[i] % 7 };
+      stringKey(name, permute[i]);
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+  ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, insertKey(tree, &key, rid), "a string key is only stored once");
+  memset(tooLong, 'x', BT_MAX_KEY_LENGTH + 1);
+  tooLong[BT_MAX_KEY_LENGTH + 1] = '\0';
+  key.v.stringV = tooLong;
+  ASSERT_EQUALS_INT(RC_IM_KEY_TOO_LONG, insertKey(tree, &key, rid), "overlong key is rejected");
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(tree, &key, &rid), "overlong key is not found");
+  key.v.stringV = name;
+
+  // the prefix of a page is stored once, so the nodes take less room than the full keys
+  TEST_CHECK(getNumEntries(tree, &entries));
+  ASSERT_EQUALS_INT(numKeys, entries, "number of entries in btree");
+  TEST_CHECK(getNumNodes(tree, &grownNodes));
+  ASSERT_TRUE(grownNodes < numKeys * (int) (strlen(name) + sizeof(RID)) / PAGE_SIZE, "shared prefixes are compressed");
+
+  for(i = 0; i < numKeys; i++)
+    {
+      RID expRid = { i + 1, i % 7 };
+      stringKey(name, i);
+      TEST_CHECK(findKey(tree, &key, &rid));
+      ASSERT_EQUALS_RID(expRid, rid, "did we find the correct string key");
+    }
+  strcpy(name, "customers/eu-west-1/accounts/");
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(tree, &key, &rid), "the shared prefix alone is no key");
+
+  // accounts 1001 to 1999 come out in order, every fifth key is a sku elsewhere in the tree
+  loKey.dt = hiKey.dt = DT_STRING;
+  loKey.v.stringV = lo;
+  hiKey.v.stringV = hi;
+  stringKey(lo, 1001);
+  stringKey(hi, 1999);
+  TEST_CHECK(openTreeRangeScan(tree, &loKey, &hiKey, BT_LOWER_INCLUSIVE | BT_UPPER_INCLUSIVE, &sc));
+  for(count = 0, last = 1001; (rc = nextEntry(sc, &rid)) == RC_OK; count++, last = rid.page)
+    ASSERT_TRUE(rid.page > last && (rid.page - 1) % 5 != 0, "string range scan runs in key order");
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "string range scan ends cleanly");
+  ASSERT_EQUALS_INT(999 - 199, count, "string range scan sees every key in the range");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // a batch of new keys, then a batch of lookups with missing keys in between
+  keys = (Value *) malloc(batchSize * sizeof(Value));
+  rids = (RID *) malloc(batchSize * sizeof(RID));
+  rcs = (RC *) malloc(batchSize * sizeof(RC));
+  for(i = 0; i < batchSize; i++)
+    {
+      k = numKeys + i * 7 % batchSize;
+      keys[i].dt = DT_STRING;
+      keys[i].v.stringV = (char *) malloc(64);
+      stringKey(keys[i].v.stringV, k);
+      rids[i].page = k + 1;
+      rids[i].slot = k % 7;
+    }
+  TEST_CHECK(insertKeys(tree, keys, rids, batchSize));
+  TEST_CHECK(getNumEntries(tree, &entries));
+  ASSERT_EQUALS_INT(numKeys + batchSize, entries, "batched string keys are counted");
+  for(i = 1; i < batchSize; i += 2)
+    strcat(keys[i].v.stringV, "-closed");
+  TEST_CHECK(findKeys(tree, keys, rids, rcs, batchSize));
+  for(i = 0; i < batchSize; i++)
+    {
+      k = numKeys + i * 7 % batchSize;
+      RID expRid = { k + 1, k % 7 };
+      if (i % 2 == 1)
+        ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, rcs[i], "missing string key is reported per probe");
+      else
+        {
+          ASSERT_EQUALS_INT(RC_OK, rcs[i], "batched lookup finds the string key");
+          ASSERT_EQUALS_RID(expRid, rids[i], "batched lookup returns the string key's RID");
+        }
+    }
+
+  // deleting all but every tenth key merges the leaves again
+  for(i = 0; i < numKeys + batchSize; i++)
+    if (i % 10 != 0)
+      {
+        stringKey(name, i);
+        TEST_CHECK(deleteKey(tree, &key));
+      }
+  TEST_CHECK(getNumNodes(tree, &nodes));
+  ASSERT_TRUE(nodes < grownNodes / 3, "merges give string nodes back");
+
+  // the slotted pages are read back after reopening, the sku keys sort behind the accounts
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0, last = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++, last = rid.page)
+    ASSERT_TRUE(rid.page > last || count == (numKeys + batchSize) / 10 - (numKeys + batchSize) / 50, "reopened tree scans in key order");
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "scan of the reopened tree ends cleanly");
+  ASSERT_EQUALS_INT((numKeys + batchSize) / 10, count, "every remaining string key is scanned");
+  TEST_CHECK(closeTreeScan(sc));
+  stringKey(name, 10);
+  TEST_CHECK(findKey(tree, &key, &rid));
+  ASSERT_EQUALS_INT(11, rid.page, "remaining string key is found after reopening");
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  for(i = 0; i < batchSize; i++)
+    free(keys[i].v.stringV);
+  free(keys);
+  free(rids);
+  free(rcs);
+  free(permute);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testCompositeKeys (void)
+{
+  int numTenants = 5, numTimes = 100;
+  int i, t, j, keyAttrs, count;
+  int *permute;
+  DataType types[BT_MAX_KEY_ATTRS], keyType;
+  DataType tenantTime[] = { DT_INT, DT_FLOAT };
+  DataType nameFlagRank[] = { DT_STRING, DT_BOOL, DT_INT };
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  Value key[3], lo[2], hi[2];
+  RID rid;
+  RC rc;
+
+  testName = "composite and float keys";
+
+  // (tenant, timestamp) keys with negative tenants and timestamps, inserted in random order
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createCompositeBtree("testidx", 2, tenantTime, 0));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  TEST_CHECK(getKeyAttrs(tree, &keyAttrs, types));
+  ASSERT_TRUE(keyAttrs == 2 && types[0] == DT_INT && types[1] == DT_FLOAT, "key attributes are kept");
+  key[0].dt = lo[0].dt = hi[0].dt = DT_INT;
+  key[1].dt = lo[1].dt = hi[1].dt = DT_FLOAT;
+  permute = createPermutation(numTenants * numTimes);
+  for(i = 0; i < numTenants * numTimes; i++)
+    {
+      t = permute[i] / numTimes;
+      j = permute[i] % numTimes;
+      RID r = { t + 10, j };
+      key[0].v.intV = t - 2;
+      key[1].v.floatV = (j - numTimes / 2) * 0.5f;
+      TEST_CHECK(insertKey(tree, key, r));
+    }
+  ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, insertKey(tree, key, rid), "a composite key is only stored once");
+  key[1].dt = DT_INT;
+  ASSERT_EQUALS_INT(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, insertKey(tree, key, rid), "attributes must have their types");
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(tree, key, &rid), "a key of other types is not found");
+  key[1].dt = DT_FLOAT;
+
+  for(t = 0; t < numTenants; t++)
+    for(j = 0; j < numTimes; j++)
+      {
+        RID expRid = { t + 10, j };
+        key[0].v.intV = t - 2;
+        key[1].v.floatV = (j - numTimes / 2) * 0.5f;
+        TEST_CHECK(findKey(tree, key, &rid));
+        ASSERT_EQUALS_RID(expRid, rid, "did we find the correct composite key");
+      }
+
+  // all timestamps of one tenant in time order, negative ones first
+  key[0].v.intV = -1;
+  TEST_CHECK(openTreePrefixScan(tree, key, 1, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    ASSERT_TRUE(rid.page == 11 && rid.slot == count, "prefix scan runs over one tenant in time order");
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "prefix scan ends at the next tenant");
+  ASSERT_EQUALS_INT(numTimes, count, "prefix scan sees every timestamp of the tenant");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // a time window of one tenant, from -5.0 up to but not including 5.0
+  lo[0].v.intV = hi[0].v.intV = 1;
+  lo[1].v.floatV = -5.0f;
+  hi[1].v.floatV = 5.0f;
+  TEST_CHECK(openTreeRangeScan(tree, lo, hi, BT_LOWER_INCLUSIVE, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    ASSERT_TRUE(rid.page == 13 && rid.slot == numTimes / 2 - 10 + count, "time window comes out in order");
+  ASSERT_EQUALS_INT(20, count, "time window sees every timestamp in it");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // the attributes are read back with the tree
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  TEST_CHECK(getKeyType(tree, &keyType));
+  ASSERT_EQUALS_INT(DT_INT, keyType, "key type of a composite key is its first attribute's");
+  key[0].v.intV = 2;
+  key[1].v.floatV = 0.0f;
+  TEST_CHECK(findKey(tree, key, &rid));
+  ASSERT_TRUE(rid.page == 14 && rid.slot == numTimes / 2, "composite key is found after reopening");
+  key[1].v.floatV = -0.0f;
+  TEST_CHECK(findKey(tree, key, &rid));
+  ASSERT_TRUE(rid.page == 14 && rid.slot == numTimes / 2, "negative zero is the same timestamp");
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  free(permute);
+
+  // float keys on their own, in random order
+  TEST_CHECK(createBtree("testidx", DT_FLOAT, 0));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  TEST_CHECK(getKeyType(tree, &keyType));
+  ASSERT_EQUALS_INT(DT_FLOAT, keyType, "float key type is kept");
+  permute = createPermutation(numTimes);
+  key[0].dt = DT_FLOAT;
+  for(i = 0; i < numTimes; i++)
+    {
+      RID r = { permute[i] + 1, 0 };
+      key[0].v.floatV = (permute[i] - numTimes / 2) * 1.25f;
+      TEST_CHECK(insertKey(tree, key, r));
+    }
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    ASSERT_EQUALS_INT(count + 1, rid.page, "float keys come out in order");
+  ASSERT_EQUALS_INT(numTimes, count, "every float key is scanned");
+  TEST_CHECK(closeTreeScan(sc));
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  free(permute);
+
+  // a string attribute ends before any longer string, whatever follows it
+  TEST_CHECK(createCompositeBtree("testidx", 3, nameFlagRank, 0));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  key[0].dt = DT_STRING;
+  key[1].dt = DT_BOOL;
+  key[2].dt = DT_INT;
+  char *names[] = { "ab", "a", "a\002", "a", "" };
+  bool flags[] = { FALSE, TRUE, FALSE, FALSE, TRUE };
+  int ranks[] = { 0, 1, 0, 5, 9 };
+  int order[] = { 5, 3, 4, 2, 1 }; // each key's place in the tree
+  for(i = 0; i < 5; i++)
+    {
+      RID r = { order[i], 0 };
+      key[0].v.stringV = names[i];
+      key[1].v.boolV = flags[i];
+      key[2].v.intV = ranks[i];
+      TEST_CHECK(insertKey(tree, key, r));
+    }
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    ASSERT_EQUALS_INT(count + 1, rid.page, "mixed keys come out attribute by attribute");
+  ASSERT_EQUALS_INT(5, count, "every mixed key is scanned");
+  TEST_CHECK(closeTreeScan(sc));
+  key[0].v.stringV = "a";
+  TEST_CHECK(openTreePrefixScan(tree, key, 1, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    ASSERT_EQUALS_INT(count + 2, rid.page, "prefix scan on a string attribute leaves out longer strings");
+  ASSERT_EQUALS_INT(2, count, "prefix scan sees both keys of the string");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testNonUniqueKeys (void)
+{
+  int numRecords = 2000, numStatus = 4;
+  int i, r, count, numEntries;
+  int *permute;
+  DataType statusType = DT_INT;
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  Value key, lo, hi, keys[5];
+  RID rid, last, results[5];
+  RC rc, rcs[5];
+
+  testName = "non-unique keys";
+
+  // record r has status r % numStatus and RID (r/10+1, r%10), the records are inserted in random order
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createNonUniqueBtree("testidx", 1, &statusType, 0));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  key.dt = lo.dt = hi.dt = DT_INT;
+  permute = createPermutation(numRecords);
+  for(i = 0; i < numRecords; i++)
+    {
+      r = permute[i];
+      RID rec = { r / 10 + 1, r % 10 };
+      key.v.intV = r % numStatus;
+      TEST_CHECK(insertKey(tree, &key, rec));
+    }
+  RID dup = { 1, 0 };
+  key.v.intV = 0;
+  ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, insertKey(tree, &key, dup), "the same record is only stored once for a key");
+  TEST_CHECK(getNumEntries(tree, &numEntries));
+  ASSERT_EQUALS_INT(numRecords, numEntries, "every record of a key is an entry");
+
+  // the records of one status come out in page order
+  key.v.intV = 2;
+  TEST_CHECK(openTreeRangeScan(tree, &key, &key, BT_LOWER_INCLUSIVE | BT_UPPER_INCLUSIVE, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    {
+      r = (rid.page - 1) * 10 + rid.slot;
+      ASSERT_TRUE(r % numStatus == 2, "scan only sees records of the status");
+      ASSERT_TRUE(count == 0 || rid.page > last.page || (rid.page == last.page && rid.slot > last.slot), "records come out in page order");
+      last = rid;
+    }
+  ASSERT_EQUALS_INT(numRecords / numStatus, count, "scan sees every record of the status");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // an exclusive lower bound skips every record of its key
+  lo.v.intV = 1;
+  hi.v.intV = 2;
+  TEST_CHECK(openTreeRangeScan(tree, &lo, &hi, BT_UPPER_INCLUSIVE, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    ASSERT_TRUE(((rid.page - 1) * 10 + rid.slot) % numStatus == 2, "exclusive bound leaves out its key");
+  ASSERT_EQUALS_INT(numRecords / numStatus, count, "range sees every record of the upper key");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // findKey and findKeys return the first record of a key
+  key.v.intV = 3;
+  TEST_CHECK(findKey(tree, &key, &rid));
+  ASSERT_TRUE(rid.page == 1 && rid.slot == 3, "findKey returns the first record of the key");
+  for(i = 0; i < 5; i++)
+    {
+      keys[i].dt = DT_INT;
+      keys[i].v.intV = i == 4 ? 7 : i;
+    }
+  TEST_CHECK(findKeys(tree, keys, results, rcs, 5));
+  for(i = 0; i < numStatus; i++)
+    {
+      TEST_CHECK(rcs[i]);
+      ASSERT_TRUE(results[i].page == 1 && results[i].slot == i, "findKeys returns the first record of each key");
+    }
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, rcs[4], "findKeys does not find a missing key");
+
+  // deleting one record of a key, then all records of another one
+  RID gone = { 1, 2 };
+  key.v.intV = 2;
+  TEST_CHECK(deleteEntry(tree, &key, gone));
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, deleteEntry(tree, &key, gone), "a deleted record is gone");
+  TEST_CHECK(findKey(tree, &key, &rid));
+  ASSERT_TRUE(rid.page == 1 && rid.slot == 6, "the key keeps its other records");
+  key.v.intV = 0;
+  TEST_CHECK(deleteKey(tree, &key));
+  ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(tree, &key, &rid), "deleteKey removes every record of the key");
+  TEST_CHECK(getNumEntries(tree, &numEntries));
+  ASSERT_EQUALS_INT(numRecords - numRecords / numStatus - 1, numEntries, "deletes are counted per record");
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  free(permute);
+
+  // bulk loading three statuses of 100 records each
+  BulkInput input = { 0, 300 };
+  BT_BulkIterator iterator = { nextStatusEntry, &input };
+  TEST_CHECK(bulkLoadNonUniqueBtree("testidx", 1, &statusType, &iterator, 0.5));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  key.v.intV = 1;
+  TEST_CHECK(openTreeRangeScan(tree, &key, &key, BT_LOWER_INCLUSIVE | BT_UPPER_INCLUSIVE, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    ASSERT_EQUALS_INT(count + 1, rid.page, "bulk loaded records come out in page order");
+  ASSERT_EQUALS_INT(100, count, "scan sees every bulk loaded record of the key");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testIntSearch (void)
+{
+  int keys[400];
+  int count, i, k, upper, expected;
+  int values[] = { INT_MIN, -7, 0, 1, 2, 3, 299, 400, 401, INT_MAX };
+
+  testName = "in-node search of int keys";
+
+  // the keys are 0, 2, 4, ... with INT_MIN and INT_MAX at the ends, every method must agree with a scan
+  for(count = 0; count <= 400; count += count < 80 ? 1 : 53)
+    {
+      for(i = 0; i < count; i++)
+        keys[i] = i == 0 ? INT_MIN : i == count - 1 && count > 1 ? INT_MAX : 2 * i;
+      for(k = 0; k < 10; k++)
+        for(upper = 0; upper < 2; upper++)
+          {
+            for(expected = 0; expected < count && (keys[expected] < values[k] || (upper && keys[expected] == values[k])); expected++)
+              ;
+            ASSERT_TRUE(searchIntKeys(keys, count, values[k], upper, BT_SEARCH_LINEAR) == expected
+                        && searchIntKeys(keys, count, values[k], upper, BT_SEARCH_BINARY) == expected
+                        && searchIntKeys(keys, count, values[k], upper, BT_SEARCH_SIMD) == expected,
+                        "every search finds the same position");
+          }
+    }
+  printf("in-node search of int keys uses %s\n", getIntSearchName());
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testBlockedLayout (void)
+{
+  int numKeys = 5000, n = 40;
+  int i, count;
+  int *permute;
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  Value key, *keys;
+  RID rid, *results;
+  RC rc, *rcs;
+  int *nodeKeys;
+  char *pages[2];
+
+  testName = "blocked layout of inner nodes";
+
+  ASSERT_EQUALS_INT(RC_ERROR, createBtreeWithLayout("testidx", DT_STRING, 0, BT_LAYOUT_BLOCKED), "only int keys have the blocked layout");
+
+  // small nodes give three levels, every inner node has up to three lines of keys
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtreeWithLayout("testidx", DT_INT, n, BT_LAYOUT_BLOCKED));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  key.dt = DT_INT;
+  permute = createPermutation(numKeys);
+  for(i = 0; i < numKeys; i++)
+    {
+      RID r = { permute[i] + 1, 0 };
+      key.v.intV = permute[i] * 2;
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+  for(i = 0; i < numKeys; i += 3)
+    {
+      key.v.intV = i * 2;
+      TEST_CHECK(deleteKey(tree, &key));
+    }
+
+  // the lines are rebuilt whenever a node is written, after splits and merges alike
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  for(i = 0; i < numKeys; i++)
+    {
+      key.v.intV = i * 2;
+      rc = findKey(tree, &key, &rid);
+      if (i % 3 == 0)
+        ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, rc, "deleted key is gone");
+      else
+        ASSERT_TRUE(rc == RC_OK && rid.page == i + 1, "key is found through the lines");
+      key.v.intV = i * 2 + 1;
+      ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(tree, &key, &rid), "key between two others is not found");
+    }
+
+  // the batch lookup searches the same frames
+  keys = (Value *) malloc(numKeys * sizeof(Value));
+  results = (RID *) malloc(numKeys * sizeof(RID));
+  rcs = (RC *) malloc(numKeys * sizeof(RC));
+  for(i = 0; i < numKeys; i++)
+    {
+      keys[i].dt = DT_INT;
+      keys[i].v.intV = permute[i] * 2;
+    }
+  TEST_CHECK(findKeys(tree, keys, results, rcs, numKeys));
+  for(count = 0, i = 0; i < numKeys; i++)
+    if (rcs[i] == RC_OK && results[i].page == permute[i] + 1)
+      count++;
+  ASSERT_EQUALS_INT(numKeys - (numKeys + 2) / 3, count, "findKeys finds every key left");
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0; nextEntry(sc, &rid) == RC_OK; count++)
+    ;
+  ASSERT_EQUALS_INT(numKeys - (numKeys + 2) / 3, count, "scan sees every key left");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // a full inner page of either layout picks the same child for every key, at the ends and between lines
+  nodeKeys = (int *) malloc(340 * sizeof(int));
+  pages[0] = (char *) aligned_alloc(64, PAGE_SIZE);
+  pages[1] = (char *) aligned_alloc(64, PAGE_SIZE);
+  for(i = 0; i < 340; i++)
+    nodeKeys[i] = 2 * i;
+  TEST_CHECK(formatIntNode(pages[0], nodeKeys, 340, BT_LAYOUT_SORTED));
+  TEST_CHECK(formatIntNode(pages[1], nodeKeys, 340, BT_LAYOUT_BLOCKED));
+  ASSERT_EQUALS_INT(RC_ERROR, formatIntNode(pages[0], nodeKeys, 341, BT_LAYOUT_SORTED), "a node holds no more keys than a page");
+  for(count = 0, i = -1; i <= 680; i++)
+    if (searchIntNode(pages[0], i, 1, BT_LAYOUT_SORTED) == searchIntKeys(nodeKeys, 340, i, 1, BT_SEARCH_BINARY)
+        && searchIntNode(pages[1], i, 1, BT_LAYOUT_BLOCKED) == searchIntKeys(nodeKeys, 340, i, 1, BT_SEARCH_BINARY))
+      count++;
+  ASSERT_EQUALS_INT(682, count, "both layouts search a full page like the sorted keys");
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+  free(keys);
+  free(results);
+  free(rcs);
+  free(nodeKeys);
+  free(pages[0]);
+  free(pages[1]);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testInnerNodeCache (void)
+{
+  int numKeys = 5000, n = 20, numThreads = 5;
+  int i, count, nodes, cachedNodes, entries;
+  long bytes;
+  pthread_t threads[5];
+  ThreadWork work[5];
+  int *permute;
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  Value key, *keys;
+  RID rid, *results;
+  RC rc, *rcs;
+
+  testName = "cache of decoded inner nodes";
+
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_INT, n));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  key.dt = DT_INT;
+  permute = createPermutation(numKeys);
+  for(i = 0; i < numKeys / 2; i++)
+    {
+      RID r = { permute[i] + 1, 0 };
+      key.v.intV = permute[i] * 2;
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+
+  // the cache fills as lookups pass the inner nodes
+  TEST_CHECK(getInnerNodeCacheSize(tree, &cachedNodes, &bytes));
+  ASSERT_TRUE(cachedNodes == 0 && bytes == 0, "the cache is off by default");
+  TEST_CHECK(setInnerNodeCache(tree, TRUE));
+  for(i = 0; i < numKeys / 2; i++)
+    {
+      key.v.intV = permute[i] * 2;
+      TEST_CHECK(findKey(tree, &key, &rid));
+    }
+  TEST_CHECK(getInnerNodeCacheSize(tree, &cachedNodes, &bytes));
+  TEST_CHECK(getNumNodes(tree, &nodes));
+  ASSERT_TRUE(cachedNodes > 0 && cachedNodes * 2 < nodes, "only inner nodes are cached");
+  ASSERT_TRUE(bytes > cachedNodes * n * (long) sizeof(int), "the cache reports its memory");
+
+  // splits and merges drop the nodes they write, lookups find every change
+  for(i = numKeys / 2; i < numKeys; i++)
+    {
+      RID r = { permute[i] + 1, 0 };
+      key.v.intV = permute[i] * 2;
+      TEST_CHECK(insertKey(tree, &key, r));
+      key.v.intV = permute[i - numKeys / 2] * 2;
+      TEST_CHECK(findKey(tree, &key, &rid));
+    }
+  for(i = 0; i < numKeys; i += 3)
+    {
+      key.v.intV = i * 2;
+      TEST_CHECK(deleteKey(tree, &key));
+      key.v.intV = (numKeys - 1 - i) * 2;
+      findKey(tree, &key, &rid);
+    }
+  for(i = 0; i < numKeys; i++)
+    {
+      key.v.intV = i * 2;
+      rc = findKey(tree, &key, &rid);
+      if (i % 3 == 0)
+        ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, rc, "deleted key is gone");
+      else
+        ASSERT_TRUE(rc == RC_OK && rid.page == i + 1, "key is found through the cache");
+    }
+
+  // the batch lookup and scans descend through the same nodes
+  keys = (Value *) malloc(numKeys * sizeof(Value));
+  results = (RID *) malloc(numKeys * sizeof(RID));
+  rcs = (RC *) malloc(numKeys * sizeof(RC));
+  for(i = 0; i < numKeys; i++)
+    {
+      keys[i].dt = DT_INT;
+      keys[i].v.intV = permute[i] * 2;
+    }
+  TEST_CHECK(findKeys(tree, keys, results, rcs, numKeys));
+  for(count = 0, i = 0; i < numKeys; i++)
+    if (rcs[i] == RC_OK && results[i].page == permute[i] + 1)
+      count++;
+  ASSERT_EQUALS_INT(numKeys - (numKeys + 2) / 3, count, "findKeys finds every key left");
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0; nextEntry(sc, &rid) == RC_OK; count++)
+    ;
+  ASSERT_EQUALS_INT(numKeys - (numKeys + 2) / 3, count, "scan sees every key left");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // turning it off frees the nodes
+  TEST_CHECK(setInnerNodeCache(tree, FALSE));
+  TEST_CHECK(getInnerNodeCacheSize(tree, &cachedNodes, &bytes));
+  ASSERT_TRUE(cachedNodes == 0 && bytes == 0, "the cache is empty once off");
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+
+  // readers share cached nodes while writers split and merge them
+  TEST_CHECK(createBtree("testidx", DT_INT, 4));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  TEST_CHECK(setInnerNodeCache(tree, TRUE));
+  for(count = 0; count < 2; count++)
+    {
+      for(i = 0; i < numThreads; i++)
+        {
+          work[i].tree = tree;
+          work[i].first = i;
+          work[i].step = 3;
+          work[i].size = 1500;
+          work[i].delete = count;
+          work[i].errors = 0;
+          pthread_create(&threads[i], NULL, i < 3 ? concurrentWriter : concurrentReader, &work[i]);
+        }
+      for(i = 0; i < numThreads; i++)
+        {
+          pthread_join(threads[i], NULL);
+          ASSERT_EQUALS_INT(0, work[i].errors, "thread saw a consistent tree through the cache");
+        }
+    }
+  TEST_CHECK(getNumEntries(tree, &entries));
+  ASSERT_EQUALS_INT(1500 / 5, entries, "every concurrent change is counted");
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+  free(keys);
+  free(results);
+  free(rcs);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testFrameChanges (void)
+{
+  int numKeys = 3000;
+  int i, entries, count, *permute;
+  char buffer[64];
+  BTreeHandle *tree = NULL, *recovered = NULL;
+  BT_ScanHandle *sc = NULL;
+  Value key;
+  RID rid;
+
+  testName = "leaves changed in their frames";
+  key.dt = DT_STRING;
+  key.v.stringV = buffer;
+
+  // the skus fall outside the prefix of the other keys' leaves, those inserts take the decoded path
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_STRING, 0));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  permute = createPermutation(numKeys);
+  for(i = 0; i < numKeys; i++)
+    {
+      RID r = { permute[i] + 1, permute[i] % 7 };
+      stringKey(buffer, permute[i]);
+      TEST_CHECK(insertKey(tree, &key, r));
+      ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, insertKey(tree, &key, r), "key already in the frame is found");
+    }
+  for(i = 0; i < numKeys; i += 3)
+    {
+      stringKey(buffer, i);
+      TEST_CHECK(deleteKey(tree, &key));
+      ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, deleteKey(tree, &key), "key deleted from the frame is gone");
+    }
+  TEST_CHECK(flushBtree(tree));
+
+  // the frame changes are logged like any other, a copy of the open tree recovers them
+  copyFile("testidx", "crashidx");
+  copyFile("testidx.wal", "crashidx.wal");
+  TEST_CHECK(openBtree(&recovered, "crashidx"));
+  TEST_CHECK(getNumEntries(recovered, &entries));
+  ASSERT_EQUALS_INT(numKeys - (numKeys + 2) / 3, entries, "entries are recounted after recovery");
+  for(i = 0; i < numKeys; i++)
+    {
+      stringKey(buffer, i);
+      if (i % 3 == 0)
+        ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(recovered, &key, &rid), "deleted key stays deleted");
+      else
+        {
+          RID expRid = { i + 1, i % 7 };
+          TEST_CHECK(findKey(recovered, &key, &rid));
+          ASSERT_EQUALS_RID(expRid, rid, "key is found in the recovered leaf");
+        }
+    }
+  TEST_CHECK(openTreeScan(recovered, &sc));
+  for(count = 0; nextEntry(sc, &rid) == RC_OK; count++)
+    ;
+  ASSERT_EQUALS_INT(entries, count, "scan sees every key left");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // cleanup
+  TEST_CHECK(closeBtree(recovered));
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("crashidx"));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testShortSeparators (void)
+{
+  int numKeys = 3000;
+  int i, count, *permute;
+  BT_Stats stats;
+  char buffer[256];
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  Value key;
+  RID rid;
+
+  testName = "separators cut to the shortest prefix";
+  key.dt = DT_STRING;
+  key.v.stringV = buffer;
+
+  // long keys that already differ in their first six bytes
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_STRING, 0));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  permute = createPermutation(numKeys);
+  for(i = 0; i < numKeys; i++)
+    {
+      RID r = { permute[i] + 1, permute[i] % 7 };
+      sprintf(buffer, "%06d/%0150d", permute[i], 0);
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+  TEST_CHECK(getTreeStats(tree, &stats));
+  ASSERT_TRUE(stats.separators > 0, "leaves were split");
+  ASSERT_TRUE(stats.avgSeparatorLength <= 6, "separators keep only the bytes that tell the leaves apart");
+
+  // merges and borrows move the short separators around
+  for(i = 0; i < numKeys; i += 2)
+    {
+      sprintf(buffer, "%06d/%0150d", i, 0);
+      TEST_CHECK(deleteKey(tree, &key));
+    }
+  for(i = 0; i < numKeys; i++)
+    {
+      sprintf(buffer, "%06d/%0150d", i, 0);
+      if (i % 2 == 0)
+        ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, findKey(tree, &key, &rid), "deleted key is gone");
+      else
+        {
+          RID expRid = { i + 1, i % 7 };
+          TEST_CHECK(findKey(tree, &key, &rid));
+          ASSERT_EQUALS_RID(expRid, rid, "key is found below a short separator");
+        }
+    }
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0; nextEntry(sc, &rid) == RC_OK; count++)
+    ASSERT_EQUALS_INT(2 * count + 2, rid.page, "scan returns the keys in order");
+  ASSERT_EQUALS_INT(numKeys / 2, count, "scan sees every key left");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // cleanup
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testFreePageList (void)
+{
+  // the second size frees more pages than page 0 can list
+  int sizes[] = { 500, 4000 };
+  int s, i, numKeys, nodes, freePages, total, *permute;
+  BTreeHandle *tree = NULL;
+  Value key;
+  RID rid;
+
+  testName = "free pages are kept across close and reused";
+  key.dt = DT_INT;
+
+  TEST_CHECK(initIndexManager(NULL));
+  for(s = 0; s < 2; s++)
+    {
+      numKeys = sizes[s];
+      TEST_CHECK(createBtree("testidx", DT_INT, 2));
+      TEST_CHECK(openBtree(&tree, "testidx"));
+      permute = createPermutation(numKeys);
+      for(i = 0; i < numKeys; i++)
+        {
+          RID r = { permute[i] + 1, permute[i] % 7 };
+          key.v.intV = permute[i];
+          TEST_CHECK(insertKey(tree, &key, r));
+        }
+      for(i = 0; i < numKeys; i++)
+        if (permute[i] % 10 != 0)
+          {
+            key.v.intV = permute[i];
+            TEST_CHECK(deleteKey(tree, &key));
+          }
+      TEST_CHECK(getNumNodes(tree, &nodes));
+      TEST_CHECK(getNumFreePages(tree, &freePages));
+      ASSERT_TRUE(freePages > nodes, "merged away pages are free");
+      total = nodes + freePages;
+
+      TEST_CHECK(closeBtree(tree));
+      TEST_CHECK(openBtree(&tree, "testidx"));
+      TEST_CHECK(getNumFreePages(tree, &i));
+      ASSERT_EQUALS_INT(freePages, i, "free pages are read back from page 0");
+      key.v.intV = 10;
+      TEST_CHECK(findKey(tree, &key, &rid));
+
+      // new nodes take the free pages before the file grows
+      for(i = 0; i < numKeys && freePages > total / 4; i++)
+        if (permute[i] % 10 != 0)
+          {
+            RID r = { permute[i] + 1, permute[i] % 7 };
+            key.v.intV = permute[i];
+            TEST_CHECK(insertKey(tree, &key, r));
+            TEST_CHECK(getNumFreePages(tree, &freePages));
+          }
+      TEST_CHECK(getNumNodes(tree, &nodes));
+      ASSERT_EQUALS_INT(total, nodes + freePages, "no page is added while free ones are left");
+
+      TEST_CHECK(closeBtree(tree));
+      TEST_CHECK(deleteBtree("testidx"));
+      free(permute);
+    }
+  TEST_CHECK(shutdownIndexManager());
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testTreeStats (void)
+{
+  int numKeys = 2000;
+  int t, i, level, pages, nodes, *permute;
+  char buffer[64];
+  BTreeHandle *tree = NULL;
+  BT_Stats stats, counters;
+  Value key;
+
+  testName = "tree statistics and their counters";
+
+  TEST_CHECK(initIndexManager(NULL));
+  permute = createPermutation(numKeys);
+  for(t = 0; t < 2; t++)
+    {
+      // small int nodes for many levels, then string pages that share prefixes
+      key.dt = t == 0 ? DT_INT : DT_STRING;
+      key.v.stringV = buffer;
+      TEST_CHECK(createBtree("testidx", key.dt, t == 0 ? 4 : 0));
+      TEST_CHECK(openBtree(&tree, "testidx"));
+      for(i = 0; i < numKeys; i++)
+        {
+          RID r = { permute[i] + 1, permute[i] % 7 };
+          if (t == 0)
+            key.v.intV = permute[i];
+          else
+            stringKey(buffer, permute[i]);
+          TEST_CHECK(insertKey(tree, &key, r));
+        }
+      for(i = 0; i < numKeys; i += 2)
+        {
+          if (t == 0)
+            key.v.intV = i;
+          else
+            stringKey(buffer, i);
+          TEST_CHECK(deleteKey(tree, &key));
+        }
+
+      TEST_CHECK(getTreeStats(tree, &stats));
+      TEST_CHECK(getNumNodes(tree, &nodes));
+      ASSERT_EQUALS_INT(numKeys / 2, stats.entries, "the pass counts every entry");
+      ASSERT_EQUALS_INT(nodes, stats.nodes, "the pass counts every node");
+      ASSERT_EQUALS_INT(1, stats.pages[0], "the root is a level of its own");
+      for(level = 0, pages = 0; level < stats.height; level++)
+        {
+          pages += stats.pages[level];
+          ASSERT_TRUE(stats.minFill[level] <= stats.avgFill[level] && stats.avgFill[level] <= stats.maxFill[level], "the average fill is between the extremes");
+          ASSERT_TRUE(stats.maxFill[level] <= 1, "no page is fuller than full");
+        }
+      ASSERT_EQUALS_INT(nodes, pages, "levels add up to the nodes");
+      if (t == 0)
+        {
+          ASSERT_TRUE(stats.minFill[stats.height - 1] >= 0.5, "leaves stay half full");
+          ASSERT_EQUALS_INT(4 * numKeys / 2, (int) stats.keyBytes, "an int key takes four bytes");
+        }
+      else
+        ASSERT_TRUE(stats.storedKeyBytes < stats.keyBytes, "shared prefixes are stored once");
+
+      // the counters agree with the pass, also once the tree was closed
+      TEST_CHECK(closeBtree(tree));
+      TEST_CHECK(openBtree(&tree, "testidx"));
+      TEST_CHECK(getTreeCounters(tree, &counters));
+      ASSERT_EQUALS_INT(stats.height, counters.height, "height is counted");
+      ASSERT_EQUALS_INT(stats.nodes, counters.nodes, "nodes are counted");
+      ASSERT_EQUALS_INT(stats.entries, counters.entries, "entries are counted");
+      ASSERT_EQUALS_INT((int) stats.keyBytes, (int) counters.keyBytes, "key bytes are counted");
+      ASSERT_EQUALS_INT(stats.freePages, counters.freePages, "free pages are counted");
+      ASSERT_EQUALS_INT(0, counters.pages[0], "counters read no page");
+
+      TEST_CHECK(closeBtree(tree));
+      TEST_CHECK(deleteBtree("testidx"));
+    }
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testIndexOnTable (void)
+{
+  int numRows = 1000;
+  int i, count, rc, *permute;
+  char *names[] = { "a", "b", "c" };
+  DataType types[] = { DT_INT, DT_STRING, DT_INT };
+  int lengths[] = { 0, 600, 0 };
+  int keys[] = { 0 };
+  char buffer[64], longValue[301];
+  RID *rids, rid;
+  RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+  Schema *schema;
+  Record *record;
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  DataType keyType;
+  Value value, *key;
+  DataType floatType[] = { DT_FLOAT };
+  float floats[] = { 3.25f, -0.0f, NAN, -2.5f, INFINITY, 1.5f, -INFINITY };
+  int floatOrder[] = { 6, 3, 1, 5, 0, 4, 2 };
+  Schema *floatSchema;
+
+  testName = "building an index over a table";
+
+  // a unique int column, a wide string column whose last row repeats the first one, and a column of few values
+  TEST_CHECK(initRecordManager(NULL));
+  schema = createSchema(3, names, types, lengths, 1, keys);
+  TEST_CHECK(createTable("testidx_table", schema));
+  TEST_CHECK(openTable(table, "testidx_table"));
+  TEST_CHECK(createRecord(&record, table->schema));
+  permute = createPermutation(numRows);
+  rids = (RID *) malloc(sizeof(RID) * numRows);
+  for(i = 0; i < numRows; i++)
+    {
+      value.dt = DT_INT;
+      value.v.intV = permute[i];
+      TEST_CHECK(setAttr(record, table->schema, 0, &value));
+      value.dt = DT_STRING;
+      value.v.stringV = buffer;
+      sprintf(buffer, "row/%04d", i < numRows - 1 ? i : 0);
+      TEST_CHECK(setAttr(record, table->schema, 1, &value));
+      value.dt = DT_INT;
+      value.v.intV = i % 7;
+      TEST_CHECK(setAttr(record, table->schema, 2, &value));
+      TEST_CHECK(insertRecord(table, record));
+      rids[i] = record->id;
+    }
+  TEST_CHECK(deleteRecord(table, rids[5]));
+
+  TEST_CHECK(initIndexManager(NULL));
+
+  // unique int keys give a plain int tree
+  TEST_CHECK(createIndexOnTable(table, 0, "testidx", TRUE));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  TEST_CHECK(getKeyType(tree, &keyType));
+  ASSERT_EQUALS_INT(DT_INT, keyType, "an int column is indexed by int keys");
+  TEST_CHECK(getNumEntries(tree, &count));
+  ASSERT_EQUALS_INT(numRows - 1, count, "every record but the deleted one is indexed");
+  value.dt = DT_INT;
+  for(i = 0; i < numRows; i++)
+    {
+      value.v.intV = permute[i];
+      rc = findKey(tree, &value, &rid);
+      if (i == 5)
+        ASSERT_EQUALS_INT(RC_IM_KEY_NOT_FOUND, rc, "a deleted record is not indexed");
+      else
+        ASSERT_EQUALS_RID(rids[i], rid, "the key leads to its record");
+    }
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+
+  // the wide keys spill sorted runs, the repeated key is only met while merging them
+  ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, createIndexOnTable(table, 1, "testidx", TRUE), "a unique index refuses a key repeated between runs");
+  ASSERT_TRUE(access("testidx", F_OK) != 0, "a refused unique index leaves no file behind");
+  TEST_CHECK(createIndexOnTable(table, 1, "testidx", FALSE));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  TEST_CHECK(getNumEntries(tree, &count));
+  ASSERT_EQUALS_INT(numRows - 1, count, "runs are merged into every entry");
+  value.dt = DT_STRING;
+  value.v.stringV = buffer;
+  for(i = 0; i < numRows - 1; i += 37)
+    {
+      sprintf(buffer, "row/%04d", i);
+      TEST_CHECK(findKey(tree, &value, &rid));
+      ASSERT_EQUALS_RID(rids[i], rid, "the key leads to its first record");
+    }
+  sprintf(buffer, "row/%04d", 0);
+  TEST_CHECK(openTreeRangeScan(tree, &value, &value, BT_LOWER_INCLUSIVE | BT_UPPER_INCLUSIVE, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    ASSERT_EQUALS_RID(rids[count == 0 ? 0 : numRows - 1], rid, "the records of a key come in page order");
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "the key scan ends cleanly");
+  ASSERT_EQUALS_INT(2, count, "a non-unique index keeps both records of the repeated key");
+  TEST_CHECK(closeTreeScan(sc));
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+
+  // keys that repeat within the table's pages are seen while sorting
+  ASSERT_EQUALS_INT(RC_IM_KEY_ALREADY_EXISTS, createIndexOnTable(table, 2, "testidx", TRUE), "a unique index refuses a key repeated within a run");
+  ASSERT_TRUE(access("testidx", F_OK) != 0, "a refused unique index leaves no file behind");
+  TEST_CHECK(createIndexOnTable(table, 2, "testidx", FALSE));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  TEST_CHECK(getNumEntries(tree, &count));
+  ASSERT_EQUALS_INT(numRows - 1, count, "every record of a repeated key is indexed");
+  key = stringToValue("i3");
+  TEST_CHECK(openTreeRangeScan(tree, key, key, BT_LOWER_INCLUSIVE | BT_UPPER_INCLUSIVE, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++);
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "the key scan ends cleanly");
+  ASSERT_EQUALS_INT((numRows - 3 + 6) / 7, count, "every record of the key is found");
+  TEST_CHECK(closeTreeScan(sc));
+  freeVal(key);
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+
+  // a key too long for a tree is only met once the bulk load has written the leaves before it
+  memset(longValue, 'z', 300);
+  longValue[300] = '\0';
+  value.dt = DT_STRING;
+  value.v.stringV = longValue;
+  TEST_CHECK(setAttr(record, table->schema, 1, &value));
+  TEST_CHECK(insertRecord(table, record));
+  ASSERT_EQUALS_INT(RC_IM_KEY_TOO_LONG, createIndexOnTable(table, 1, "testidx", FALSE), "a key over BT_MAX_KEY_LENGTH bytes fails the build");
+  ASSERT_TRUE(access("testidx", F_OK) != 0, "a failed build leaves no file behind");
+
+  ASSERT_EQUALS_INT(RC_ERROR, createIndexOnTable(table, 3, "testidx", FALSE), "the attribute has to be in the schema");
+
+  TEST_CHECK(closeTable(table));
+  TEST_CHECK(deleteTable("testidx_table"));
+  free(record->data);
+  freeRecord(record);
+  free(schema);
+  free(table->schema);
+
+  // float keys sort like the tree orders them, a NaN after the infinities and -0 as 0
+  TEST_CHECK(createTable("testidx_table", floatSchema = createSchema(1, names, floatType, lengths, 1, keys)));
+  TEST_CHECK(openTable(table, "testidx_table"));
+  TEST_CHECK(createRecord(&record, table->schema));
+  value.dt = DT_FLOAT;
+  for(i = 0; i < 7; i++)
+    {
+      value.v.floatV = floats[i];
+      TEST_CHECK(setAttr(record, table->schema, 0, &value));
+      TEST_CHECK(insertRecord(table, record));
+      rids[i] = record->id;
+    }
+  TEST_CHECK(createIndexOnTable(table, 0, "testidx", TRUE));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  TEST_CHECK(getNumEntries(tree, &count));
+  ASSERT_EQUALS_INT(7, count, "a NaN and -0 are indexed as keys of their own");
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    ASSERT_EQUALS_RID(rids[floatOrder[count]], rid, "float keys come in the tree's order");
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "the float scan ends cleanly");
+  ASSERT_EQUALS_INT(7, count, "the scan finds every float key");
+  TEST_CHECK(closeTreeScan(sc));
+  value.v.floatV = 0;
+  TEST_CHECK(findKey(tree, &value, &rid));
+  ASSERT_EQUALS_RID(rids[1], rid, "0 finds the record of -0");
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+
+  TEST_CHECK(shutdownIndexManager());
+  TEST_CHECK(closeTable(table));
+  TEST_CHECK(deleteTable("testidx_table"));
+  TEST_CHECK(shutdownRecordManager());
+  free(record->data);
+  freeRecord(record);
+  free(floatSchema);
+  free(table->schema);
+  free(table);
+  free(permute);
+  free(rids);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testIndexOnlyScan (void)
+{
+  int numKeys = 2000;
+  int i, k, count, *permute;
+  DataType nameScoreFlag[] = { DT_STRING, DT_FLOAT, DT_BOOL };
+  char buffer[64], last[64];
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  Value key[3], lo, hi;
+  RID rid;
+  RC rc;
+
+  testName = "index-only scans hand out keys";
+
+  // int keys of a range come with their RIDs
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_INT, 4));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  permute = createPermutation(numKeys);
+  key[0].dt = lo.dt = hi.dt = DT_INT;
+  for(i = 0; i < numKeys; i++)
+    {
+      RID r = { permute[i] + 1, permute[i] % 7 };
+      key[0].v.intV = permute[i];
+      TEST_CHECK(insertKey(tree, key, r));
+    }
+  lo.v.intV = 100;
+  hi.v.intV = 200;
+  TEST_CHECK(openTreeRangeScan(tree, &lo, &hi, BT_LOWER_INCLUSIVE, &sc));
+  for(count = 0; (rc = nextEntryWithKey(sc, key, &rid)) == RC_OK; count++)
+    {
+      RID expRid = { 100 + count + 1, (100 + count) % 7 };
+      ASSERT_TRUE(key[0].dt == DT_INT && key[0].v.intV == 100 + count, "the scan hands out the keys of the range in order");
+      ASSERT_EQUALS_RID(expRid, rid, "each key comes with its RID");
+    }
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "the scan ends at the upper bound");
+  ASSERT_EQUALS_INT(100, count, "the scan sees the whole range");
+  TEST_CHECK(closeTreeScan(sc));
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+
+  // string keys come back whole from prefix-compressed leaves
+  TEST_CHECK(createBtree("testidx", DT_STRING, 0));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  key[0].dt = DT_STRING;
+  key[0].v.stringV = buffer;
+  for(i = 0; i < numKeys; i++)
+    {
+      RID r = { permute[i] + 1, permute[i] % 7 };
+      stringKey(buffer, permute[i]);
+      TEST_CHECK(insertKey(tree, key, r));
+    }
+  TEST_CHECK(openTreeScan(tree, &sc));
+  last[0] = '\0';
+  for(count = 0; (rc = nextEntryWithKey(sc, key, &rid)) == RC_OK; count++)
+    {
+      k = atoi(key[0].v.stringV + strlen(key[0].v.stringV) - 7);
+      stringKey(buffer, k);
+      ASSERT_TRUE(key[0].dt == DT_STRING && strcmp(buffer, key[0].v.stringV) == 0, "the whole key is handed out");
+      ASSERT_TRUE(strcmp(last, key[0].v.stringV) < 0, "keys come in order");
+      ASSERT_TRUE(rid.page == k + 1 && rid.slot == k % 7, "each key comes with its RID");
+      strcpy(last, key[0].v.stringV);
+    }
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "the scan ends after the last key");
+  ASSERT_EQUALS_INT(numKeys, count, "the scan sees every key");
+  TEST_CHECK(closeTreeScan(sc));
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+
+  // encoded keys of a non-unique tree are decoded, escaped bytes and negative floats included
+  TEST_CHECK(createNonUniqueBtree("testidx", 3, nameScoreFlag, 0));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  for(i = 0; i < numKeys; i++)
+    {
+      RID r = { i + 1, 0 };
+      sprintf(buffer, "%c%02d", i % 3 == 0 ? 1 : i % 3 == 1 ? 2 : 'n', i % 50);
+      key[0].dt = DT_STRING;
+      key[0].v.stringV = buffer;
+      key[1].dt = DT_FLOAT;
+      key[1].v.floatV = (i % 20 - 10) * 0.25f;
+      key[2].dt = DT_BOOL;
+      key[2].v.boolV = i % 2;
+      TEST_CHECK(insertKey(tree, key, r));
+    }
+  TEST_CHECK(openTreeScan(tree, &sc));
+  for(count = 0; (rc = nextEntryWithKey(sc, key, &rid)) == RC_OK; count++)
+    {
+      i = rid.page - 1;
+      sprintf(buffer, "%c%02d", i % 3 == 0 ? 1 : i % 3 == 1 ? 2 : 'n', i % 50);
+      ASSERT_TRUE(key[0].dt == DT_STRING && strcmp(buffer, key[0].v.stringV) == 0, "a string attribute is decoded");
+      ASSERT_TRUE(key[1].dt == DT_FLOAT && key[1].v.floatV == (i % 20 - 10) * 0.25f, "a float attribute is decoded");
+      ASSERT_TRUE(key[2].dt == DT_BOOL && key[2].v.boolV == i % 2, "a bool attribute is decoded");
+    }
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "the scan ends after the last entry");
+  ASSERT_EQUALS_INT(numKeys, count, "the scan sees every entry");
+  TEST_CHECK(closeTreeScan(sc));
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testDescendingScan (void)
+{
+  int numKeys = 2000, numRecords = 6;
+  int i, k, count, previous, *permute;
+  char buffer[64];
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  BulkInput input = { 0, numKeys };
+  BT_BulkIterator iter = { nextBulkEntry, &input };
+  DataType statusType = DT_STRING;
+  Value key, lo, hi;
+  RID rid;
+  RC rc;
+
+  testName = "descending scans";
+
+  // small nodes that lost every third key, so leaves were split and merged on the way
+  TEST_CHECK(initIndexManager(NULL));
+  TEST_CHECK(createBtree("testidx", DT_INT, 4));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  permute = createPermutation(numKeys);
+  key.dt = lo.dt = hi.dt = DT_INT;
+  for(i = 0; i < numKeys; i++)
+    {
+      RID r = { permute[i] + 1, permute[i] % 7 };
+      key.v.intV = permute[i];
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+  for(i = 0; i < numKeys; i += 3)
+    {
+      key.v.intV = i;
+      TEST_CHECK(deleteKey(tree, &key));
+    }
+
+  // the whole tree from the largest key down, through the left sibling links
+  TEST_CHECK(openTreeRangeScan(tree, NULL, NULL, BT_DESCENDING, &sc));
+  for(count = 0, k = numKeys - 1; (rc = nextEntryWithKey(sc, &key, &rid)) == RC_OK; count++, k--)
+    {
+      if (k % 3 == 0)
+        k--;
+      RID expRid = { k + 1, k % 7 };
+      ASSERT_EQUALS_INT(k, key.v.intV, "keys come in descending order");
+      ASSERT_EQUALS_RID(expRid, rid, "each key comes with its RID");
+    }
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "the scan ends at the smallest key");
+  ASSERT_EQUALS_INT(numKeys - (numKeys + 2) / 3, count, "the scan sees every key");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // from an inclusive upper bound down to an exclusive lower one
+  lo.v.intV = 1000;
+  hi.v.intV = 1501;
+  TEST_CHECK(openTreeRangeScan(tree, &lo, &hi, BT_DESCENDING | BT_UPPER_INCLUSIVE, &sc));
+  for(count = 0; (rc = nextEntryWithKey(sc, &key, &rid)) == RC_OK; count++)
+    ASSERT_TRUE(key.v.intV > 1000 && key.v.intV <= 1501 && key.v.intV % 3 != 0, "keys stay within the bounds");
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "the scan ends at the lower bound");
+  ASSERT_EQUALS_INT(334, count, "the scan sees the whole range");
+  TEST_CHECK(closeTreeScan(sc));
+
+  // the latest keys only, then keys put back behind the scan show up once their leaf is reached
+  TEST_CHECK(openTreeRangeScan(tree, NULL, NULL, BT_DESCENDING, &sc));
+  for(count = 0; count < 100 && nextEntryWithKey(sc, &key, &rid) == RC_OK; count++);
+  previous = key.v.intV;
+  for(i = 0; i < numKeys; i += 3)
+    {
+      RID r = { i + 1, i % 7 };
+      key.v.intV = i;
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+  for(count = 0; (rc = nextEntryWithKey(sc, &key, &rid)) == RC_OK; count++)
+    {
+      ASSERT_TRUE(key.v.intV < previous, "keys keep descending while the tree changes");
+      previous = key.v.intV;
+    }
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "the scan ends at the smallest key");
+  ASSERT_TRUE(count >= 1800 - (1800 + 2) / 3 - 1, "no key that was there all along is missed");
+  TEST_CHECK(closeTreeScan(sc));
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+
+  // bulk loaded leaves are linked both ways
+  TEST_CHECK(bulkLoadBtree("testidx", DT_INT, &iter, 1));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  TEST_CHECK(openTreeRangeScan(tree, NULL, NULL, BT_DESCENDING, &sc));
+  for(count = 0; (rc = nextEntryWithKey(sc, &key, &rid)) == RC_OK; count++)
+    ASSERT_EQUALS_INT((numKeys - 1 - count) * 3, key.v.intV, "bulk loaded keys come in descending order");
+  ASSERT_EQUALS_INT(numKeys, count, "the scan sees every bulk loaded key");
+  TEST_CHECK(closeTreeScan(sc));
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+
+  // the records of a key in a non-unique tree come in descending page order
+  TEST_CHECK(createNonUniqueBtree("testidx", 1, &statusType, 0));
+  TEST_CHECK(openBtree(&tree, "testidx"));
+  key.dt = lo.dt = hi.dt = DT_STRING;
+  key.v.stringV = buffer;
+  for(i = 0; i < numKeys; i++)
+    {
+      RID r = { permute[i] + 1, 0 };
+      stringKey(buffer, permute[i] / numRecords);
+      TEST_CHECK(insertKey(tree, &key, r));
+    }
+  lo.v.stringV = hi.v.stringV = buffer;
+  stringKey(buffer, 7);
+  TEST_CHECK(openTreeRangeScan(tree, &lo, &hi, BT_DESCENDING | BT_LOWER_INCLUSIVE | BT_UPPER_INCLUSIVE, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++)
+    ASSERT_EQUALS_INT(7 * numRecords + numRecords - count, rid.page, "records of a key come in descending page order");
+  ASSERT_EQUALS_INT(numRecords, count, "the scan sees every record of the key");
+  TEST_CHECK(closeTreeScan(sc));
+  TEST_CHECK(openTreeRangeScan(tree, &lo, &hi, BT_DESCENDING, &sc));
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, nextEntry(sc, &rid), "exclusive bounds leave the key out");
+  TEST_CHECK(closeTreeScan(sc));
+  TEST_CHECK(openTreeRangeScan(tree, &lo, NULL, BT_DESCENDING, &sc));
+  for(count = 0; (rc = nextEntry(sc, &rid)) == RC_OK; count++);
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "the scan ends at the lower bound");
+  stringKey(buffer, 7);
+  for(i = 0, k = 0; i < (numKeys + numRecords - 1) / numRecords; i++)
+    {
+      char other[64];
+      stringKey(other, i);
+      if (strcmp(other, buffer) > 0)
+        k += i < numKeys / numRecords ? numRecords : numKeys % numRecords;
+    }
+  ASSERT_EQUALS_INT(k, count, "every record of a larger key is seen");
+  TEST_CHECK(closeTreeScan(sc));
+  TEST_CHECK(closeBtree(tree));
+  TEST_CHECK(deleteBtree("testidx"));
+  TEST_CHECK(shutdownIndexManager());
+  free(permute);
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testStringBulkLoad (void)
+{
+  // the last leaf holds many short keys, the one before it only a few long ones
+  int longKeys[] = { 14, 16, 21, 29, 36 };
+  int t, i, count, rc;
+  BTreeHandle *tree = NULL;
+  BT_ScanHandle *sc = NULL;
+  RID rid;
+
+  testName = "bulk loading long string keys followed by short ones";
+
+  TEST_CHECK(initIndexManager(NULL));
+  for(t = 0; t < 5; t++)
+    {
+      MixedInput input = { 0, longKeys[t] + 20, longKeys[t], "" };
+      BT_BulkIterator iter = { nextMixedEntry, &input };
+
+      TEST_CHECK(bulkLoadBtree("testidx", DT_STRING, &iter, 1.0));
+      TEST_CHECK(openBtree(&tree, "testidx"));
+      TEST_CHECK(getNumEntries(tree, &count));
+      ASSERT_EQUALS_INT(input.size, count, "every entry is loaded");
+
+      // a full scan sees every entry once, in load order
+      TEST_CHECK(openTreeScan(tree, &sc));
+      for(i = 0; (rc = nextEntry(sc, &rid)) == RC_OK; i++)
+        if (rid.page != i + 1 || rid.slot != i % 7)
+          break;
+      ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "scan ran to the end in key order");
+      ASSERT_EQUALS_INT(input.size, i, "have seen all entries");
+      TEST_CHECK(closeTreeScan(sc));
+
+      TEST_CHECK(closeBtree(tree));
+      TEST_CHECK(deleteBtree("testidx"));
+    }
+  TEST_CHECK(shutdownIndexManager());
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+static RC
+logNotFlushed (PageNumber pageNum, void *hookData)
+{
+  return RC_LOG_NOT_FLUSHED;
+}
+
+static RC
+flushFails (PageNumber pageNum, void *hookData)
+{
+  return RC_WRITE_FAILED;
+}
+
+void
+testFailedPageIO (void)
+{
+  BM_BufferPool bm;
+  BM_PageHandle page;
+  SM_FileHandle fh;
+  PageNumber *contents;
+  bool *dirty;
+  int *fixed;
+
+  testName = "pins whose read or write-back fails";
+
+  TEST_CHECK(createPageFile("testbuf"));
+  TEST_CHECK(openPageFile("testbuf", &fh));
+  TEST_CHECK(ensureCapacity(2, &fh));
+  TEST_CHECK(closePageFile(&fh));
+  TEST_CHECK(initBufferPool(&bm, "testbuf", 1, RS_FIFO, NULL));
+
+  // a page that cannot be read leaves the frame empty and unpinned
+  ASSERT_ERROR(pinPage(&bm, &page, 9), "page past the end of the file is not pinned");
+  contents = getFrameContents(&bm);
+  fixed = getFixCounts(&bm);
+  ASSERT_EQUALS_INT(NO_PAGE, contents[0], "frame of the failed read is empty");
+  ASSERT_EQUALS_INT(0, fixed[0], "failed read keeps no pin");
+  free(contents);
+  free(fixed);
+
+  TEST_CHECK(pinPage(&bm, &page, 0));
+  strcpy(page.data, "changed in the pool");
+  TEST_CHECK(markDirty(&bm, &page));
+  TEST_CHECK(unpinPage(&bm, &page));
+
+  // the only frame has to be written back for page 1, the change must survive the failed write
+  TEST_CHECK(setWriteBackHook(&bm, logNotFlushed, flushFails, NULL));
+  ASSERT_ERROR(pinPage(&bm, &page, 1), "write-back of the old page fails");
+  contents = getFrameContents(&bm);
+  dirty = getDirtyFlags(&bm);
+  fixed = getFixCounts(&bm);
+  ASSERT_EQUALS_INT(0, contents[0], "old page is back in its frame");
+  ASSERT_TRUE(dirty[0], "old page is still dirty");
+  ASSERT_EQUALS_INT(0, fixed[0], "failed write-back keeps no pin");
+  free(contents);
+  free(dirty);
+  free(fixed);
+  TEST_CHECK(pinPage(&bm, &page, 0));
+  ASSERT_EQUALS_STRING("changed in the pool", page.data, "change is still in the frame");
+  TEST_CHECK(unpinPage(&bm, &page));
+
+  TEST_CHECK(setWriteBackHook(&bm, NULL, NULL, NULL));
+  TEST_CHECK(forceFlushPool(&bm));
+  TEST_CHECK(shutdownBufferPool(&bm));
+  TEST_CHECK(destroyPageFile("testbuf"));
+
+  TEST_DONE();
+}
+
+// ************************************************************ 
+void *
+concurrentWriter (void *arg)
+{
+  ThreadWork *work = (ThreadWork *) arg;
+  Value key;
+  int k;
+
+  key.dt = DT_INT;
+  for(k = work->first; k < work->size; k += work->step)
+    {
+      RID rid = { k + 1, k % 7 };
+      key.v.intV = k;
+      if (!work->delete && insertKey(work->tree, &key, rid) != RC_OK)
+        work->errors++;
+      if (work->delete && k % 5 != 0 && deleteKey(work->tree, &key) != RC_OK)
+        work->errors++;
+    }
+
+  return NULL;
+}
+
+// ************************************************************ 
+void *
+concurrentBatcher (void *arg)
+{
+  ThreadWork *work = (ThreadWork *) arg;
+  Value keys[50];
+  RID rids[50];
+  int k, n = 0;
+
+  // the thread's keys in batches of 50, each batch spread over the leaves of the other threads' keys
+  for(k = work->first; k < work->size; k += work->step)
+    {
+      keys[n].dt = DT_INT;
+      keys[n].v.intV = k;
+      rids[n].page = k + 1;
+      rids[n].slot = k % 7;
+      if (++n == 50 || k + work->step >= work->size)
+        {
+          if (insertKeys(work->tree, keys, rids, n) != RC_OK)
+            work->errors++;
+          n = 0;
+        }
+    }
+
+  return NULL;
+}
+
+// ************************************************************ 
+void *
+concurrentReader (void *arg)
+{
+  ThreadWork *work = (ThreadWork *) arg;
+  Value key;
+  RID rid;
+  int i, rc;
+
+  // a key is either not there yet or there with its own RID, multiples of five never go away
+  key.dt = DT_INT;
+  for(i = 0; i < 4 * work->size; i++)
+    {
+      key.v.intV = rand() % work->size;
+      rc = findKey(work->tree, &key, &rid);
+      if (rc == RC_OK && (rid.page != key.v.intV + 1 || rid.slot != key.v.intV % 7))
+        work->errors++;
+      if (rc != RC_OK && (rc != RC_IM_KEY_NOT_FOUND || (work->delete && key.v.intV % 5 == 0)))
+        work->errors++;
+    }
+
+  return NULL;
+}
+
+// ************************************************************ 
+void *
+concurrentScanner (void *arg)
+{
+  ThreadWork *work = (ThreadWork *) arg;
+  BT_ScanHandle *sc = NULL;
+  RID rid;
+  int i, last;
+
+  // entries may come and go under the scan, but they always come in ascending key order
+  for(i = 0; i < 20; i++)
+    {
+      last = 0;
+      if (openTreeScan(work->tree, &sc) != RC_OK)
+        {
+          work->errors++;
+          continue;
+        }
+      while(nextEntry(sc, &rid) == RC_OK)
+        {
+          if (rid.page <= last)
+            work->errors++;
+          last = rid.page;
+        }
+      closeTreeScan(sc);
+    }
+
+  return NULL;
+}
+
+// ************************************************************ 
+int
+countRange (BTreeHandle *tree, Value *lo, Value *hi, int flags, int first)
+{
+  BT_ScanHandle *sc = NULL;
+  RID rid;
+  int rc, count = 0;
+
+  // entry i of the range has key (first+i)*2
+  TEST_CHECK(openTreeRangeScan(tree, lo, hi, flags, &sc));
+  while((rc = nextEntry(sc, &rid)) == RC_OK)
+    {
+      RID expRid = { first + count + 1, (first + count) % 7 };
+      ASSERT_EQUALS_RID(expRid, rid, "range scan returns the entries in key order");
+      count++;
+    }
+  ASSERT_EQUALS_INT(RC_IM_NO_MORE_ENTRIES, rc, "range scan ends cleanly");
+  TEST_CHECK(closeTreeScan(sc));
+
+  return count;
+}
+
+// ************************************************************ 
+RC
+nextBulkEntry (BT_BulkIterator *iterator, Value *key, RID *rid)
+{
+  BulkInput *input = (BulkInput *) iterator->mgmtData;
+
+  if (input->pos == input->size)
+    return RC_IM_NO_MORE_ENTRIES;
+
+  key->dt = DT_INT;
+  key->v.intV = input->pos * 3;
+  rid->page = input->pos / 50 + 1;
+  rid->slot = input->pos % 50;
+  input->pos++;
+
+  return RC_OK;
+}
+
+// ************************************************************ 
+RC
+nextStatusEntry (BT_BulkIterator *iterator, Value *key, RID *rid)
+{
+  BulkInput *input = (BulkInput *) iterator->mgmtData;
+
+  // 100 records per status, in page order
+  if (input->pos == input->size)
+    return RC_IM_NO_MORE_ENTRIES;
+
+  key->dt = DT_INT;
+  key->v.intV = input->pos / 100;
+  rid->page = input->pos % 100 + 1;
+  rid->slot = input->pos % 3;
+  input->pos++;
+
+  return RC_OK;
+}
+
+// ************************************************************ 
+RC
+nextMixedEntry (BT_BulkIterator *iterator, Value *key, RID *rid)
+{
+  MixedInput *input = (MixedInput *) iterator->mgmtData;
+
+  if (input->pos == input->size)
+    return RC_IM_NO_MORE_ENTRIES;
+
+  // "a" keys padded to 250 bytes sort before the short "b" ones
+  if (input->pos < input->longKeys)
+    {
+      memset(input->key, 'x', 250);
+      sprintf(input->key, "a%05d", input->pos);
+      input->key[6] = 'x';
+      input->key[250] = '\0';
+    }
+  else
+    sprintf(input->key, "b%05d", input->pos);
+  key->dt = DT_STRING;
+  key->v.stringV = input->key;
+  rid->page = input->pos + 1;
+  rid->slot = input->pos % 7;
+  input->pos++;
+
+  return RC_OK;
+}
+
+// ************************************************************ 
+int *
+createPermutation (int size)
+{
+  int *result = (int *) malloc(size * sizeof(int));
+  int i;
+
+  for(i = 0; i < size; result[i] = i, i++);
+
+  for(i = 0; i < 100; i++)
+    {
+      int l, r, temp;
+      l = rand() % size;
+      r = rand() % size;
+      temp = result[l];
+      result[l] = result[r];
+      result[r] = temp;
+    }
+  
+  return result;
+}
+
+// ************************************************************ 
+void
+copyFile (char *from, char *to)
+{
+  FILE *in = fopen(from, "rb");
+  FILE *out = fopen(to, "wb");
+  char buffer[PAGE_SIZE];
+  size_t read;
+
+  while((read = fread(buffer, 1, PAGE_SIZE, in)) > 0)
+    fwrite(buffer, 1, read, out);
+  fclose(in);
+  fclose(out);
+}
+
+// ************************************************************ 
+void
+stringKey (char *buffer, int k)
+{
+  // most keys share a long prefix, every fifth one is a sku with a prefix of its own
+  if (k % 5 == 0)
+    sprintf(buffer, "sku/%07d", k);
+  else
+    sprintf(buffer, "customers/eu-west-1/accounts/%07d", k);
 }
 
 // ************************************************************ 